@@ -15,17 +15,23 @@
 
 using namespace std;
 
-HackyDbAPI::HackyDbAPI(std::string p) : path_(p) { cm_ = new CatalogManager(p); }
+HackyDbAPI::HackyDbAPI(std::string p) : path_(p), hdl_(NULL) {
+  // the log is replayed before the catalog is read
+  log_ = new LogManager(p);
+  cm_ = new CatalogManager(p, log_);
+}
 
 HackyDbAPI::~HackyDbAPI() {
   // hdl_ is initialized in #Use#
   delete hdl_;
   delete cm_;
+  delete log_;
 }
 
 void HackyDbAPI::Quit() {
   delete hdl_;
   delete cm_;
+  delete log_;
   std::cout << "Quiting..." << std::endl;
 }
 
@@ -48,6 +54,9 @@ void HackyDbAPI::Help() {
   std::cout << "#INSERT#" << std::endl;
   std::cout << "#DELETE#" << std::endl;
   std::cout << "#UPDATE#" << std::endl;
+  std::cout << "#VACUUM#" << std::endl;
+  std::cout << "#SET#" << std::endl;
+  std::cout << "#ANALYZE#" << std::endl;
 }
 
 void HackyDbAPI::CreateDatabase(SQLCreateDatabase &st) {
@@ -71,31 +80,22 @@ void HackyDbAPI::CreateDatabase(SQLCreateDatabase &st) {
 
   cm_->CreateDatabase(st.db_name());
   std::cout << "Catalog written!" << std::endl;
-  cm_->WriteArchiveFile();
+  cm_->WriteDatabase(st.db_name());
+  log_->Commit();
 }
 
 void HackyDbAPI::ShowDatabases() {
-  std::vector<Database> dbs = cm_->dbs();
+  std::list<Database> &dbs = cm_->dbs();
   std::cout << "DATABASE LIST:" << std::endl;
-  for (unsigned int i = 0; i < dbs.size(); ++i) {
-    Database db = dbs[i];
-    std::cout << "\t" << db.db_name() << std::endl;
+  for (std::list<Database>::iterator db = dbs.begin(); db != dbs.end(); ++db) {
+    std::cout << "\t" << db->db_name() << std::endl;
   }
 }
 
 void HackyDbAPI::DropDatabase(SQLDropDatabase &st) {
   std::cout << "Dropping database: " << st.db_name() << std::endl;
 
-  bool found = false;
-
-  std::vector<Database> dbs = cm_->dbs();
-  for (unsigned int i = 0; i < dbs.size(); ++i) {
-    if (dbs[i].db_name() == st.db_name()) {
-      found = true;
-    }
-  }
-
-  if (found == false) {
+  if (cm_->GetDB(st.db_name()) == NULL) {
     throw DatabaseNotExistException();
   }
 
@@ -113,11 +113,13 @@ void HackyDbAPI::DropDatabase(SQLDropDatabase &st) {
 
   cm_->DeleteDatabase(st.db_name());
   std::cout << "Database removed from catalog!" << std::endl;
-  cm_->WriteArchiveFile();
+  cm_->WriteDatabase(st.db_name());
+  log_->Commit();
 
   if (st.db_name() == curr_db_) {
     curr_db_ = "";
     delete hdl_;
+    hdl_ = NULL;
   }
 }
 
@@ -130,11 +132,18 @@ void HackyDbAPI::Use(SQLUse &st) {
 
   if (curr_db_.length() != 0) {
     std::cout << "Closing the old database: " << curr_db_ << std::endl;
-    cm_->WriteArchiveFile();
     delete hdl_;
   }
   curr_db_ = st.db_name();
-  hdl_ = new BufferManager(path_);
+  hdl_ = new BufferManager(path_, log_);
+
+  RecordManager *rm = new RecordManager(cm_, hdl_, curr_db_);
+  rm->MigrateTables();
+  delete rm;
+
+  IndexManager *im = new IndexManager(cm_, hdl_, curr_db_);
+  im->MigrateIndexes();
+  delete im;
 }
 
 void HackyDbAPI::CreateTable(SQLCreateTable &st) {
@@ -166,7 +175,8 @@ void HackyDbAPI::CreateTable(SQLCreateTable &st) {
 
   db->CreateTable(st);
   std::cout << "Catalog written!" << std::endl;
-  cm_->WriteArchiveFile();
+  cm_->WriteTable(curr_db_, st.tb_name());
+  log_->Commit();
 }
 
 void HackyDbAPI::ShowTables() {
@@ -180,9 +190,9 @@ void HackyDbAPI::ShowTables() {
   }
   std::cout << "CURRENT DATABASE: " << curr_db_ << std::endl;
   std::cout << "TABLE LIST:" << std::endl;
-  for (int i = 0; i < db->tbs().size(); ++i) {
-    Table tb = db->tbs()[i];
-    std::cout << "\t" << tb.tb_name() << std::endl;
+  for (std::list<Table>::iterator tb = db->tbs().begin();
+       tb != db->tbs().end(); ++tb) {
+    std::cout << "\t" << tb->tb_name() << std::endl;
   }
 }
 
@@ -217,6 +227,20 @@ void HackyDbAPI::Select(SQLSelect &st) {
   delete rm;
 }
 
+RecordCursor *HackyDbAPI::OpenSelect(SQLSelect &st) {
+  if (curr_db_.length() == 0) {
+    throw NoDatabaseSelectedException();
+  }
+
+  Table *tb = cm_->GetDB(curr_db_)->GetTable(st.tb_name());
+
+  if (tb == NULL) {
+    throw TableNotExistException();
+  }
+
+  return new RecordCursor(cm_, hdl_, curr_db_, st);
+}
+
 void HackyDbAPI::CreateIndex(SQLCreateIndex &st) {
   if (curr_db_.length() == 0) {
     throw NoDatabaseSelectedException();
@@ -253,6 +277,9 @@ void HackyDbAPI::DropTable(SQLDropTable &st) {
     throw TableNotExistException();
   }
 
+  // a checkpoint first, so the log holds no images of the files removed
+  hdl_->WriteToDisk();
+
   std::string file_name(path_ + curr_db_ + "/" + st.tb_name() + ".records");
 
   if (!boost::filesystem::exists(file_name)) {
@@ -276,7 +303,8 @@ void HackyDbAPI::DropTable(SQLDropTable &st) {
 
   db->DropTable(st);
   std::cout << "Catalog written!" << std::endl;
-  cm_->WriteArchiveFile();
+  cm_->WriteTable(curr_db_, st.tb_name());
+  log_->Commit();
 }
 
 void HackyDbAPI::DropIndex(SQLDropIndex &st) {
@@ -299,12 +327,15 @@ void HackyDbAPI::DropIndex(SQLDropIndex &st) {
     std::cout << "Index file doesn't exist!" << std::endl;
     return;
   }
+  hdl_->WriteToDisk();
   boost::filesystem::remove(file_name);
   std::cout << "Index file removed!" << std::endl;
 
+  std::string tb_name = db->GetIndexTable(st.idx_name())->tb_name();
   db->DropIndex(st);
   std::cout << "Catalog written!" << std::endl;
-  cm_->WriteArchiveFile();
+  cm_->WriteTable(curr_db_, tb_name);
+  log_->Commit();
 }
 
 void HackyDbAPI::Delete(SQLDelete &st) {
@@ -347,4 +378,58 @@ void HackyDbAPI::Update(SQLUpdate &st) {
   RecordManager *rm = new RecordManager(cm_, hdl_, curr_db_);
   rm->Update(st);
   delete rm;
-}
\ No newline at end of file
+}
+
+void HackyDbAPI::Vacuum(SQLVacuum &st) {
+  if (curr_db_.length() == 0) {
+    throw NoDatabaseSelectedException();
+  }
+
+  Database *db = cm_->GetDB(curr_db_);
+  if (db == NULL) {
+    throw DatabaseNotExistException();
+  }
+
+  Table *tb = cm_->GetDB(curr_db_)->GetTable(st.tb_name());
+
+  if (tb == NULL) {
+    throw TableNotExistException();
+  }
+
+  std::cout << "Vacuuming table: " << st.tb_name() << std::endl;
+  RecordManager *rm = new RecordManager(cm_, hdl_, curr_db_);
+  rm->Vacuum(tb);
+  delete rm;
+}
+
+void HackyDbAPI::Analyze(SQLAnalyze &st) {
+  if (curr_db_.length() == 0) {
+    throw NoDatabaseSelectedException();
+  }
+
+  Database *db = cm_->GetDB(curr_db_);
+  if (db == NULL) {
+    throw DatabaseNotExistException();
+  }
+
+  Table *tb = cm_->GetDB(curr_db_)->GetTable(st.tb_name());
+
+  if (tb == NULL) {
+    throw TableNotExistException();
+  }
+
+  std::cout << "Analyzing table: " << st.tb_name() << std::endl;
+  RecordManager *rm = new RecordManager(cm_, hdl_, curr_db_);
+  rm->Analyze(tb);
+  delete rm;
+}
+
+void HackyDbAPI::Set(SQLSet &st) {
+  if (st.name() != "synchronous_commit") {
+    throw SettingNotExistException();
+  }
+  if (st.value() != "on" && st.value() != "off") {
+    throw SyntaxErrorException();
+  }
+  log_->set_synchronous_commit(st.value() == "on");
+}
@@ -5,7 +5,9 @@
 #include <string>
 
 #include "../Core/Buffer/Buffer_manager/buffer_manager.h"
+#include "../Core/Log/Log_manager/log_manager.h"
 #include "../managers/Catalog_manager/catalog_manager.h"
+#include "../managers/Record_manager/record_cursor.h"
 #include "../SQL/sql_statement.h"
 
 class HackyDbAPI {
@@ -13,6 +15,7 @@ private:
   std::string path_;
   CatalogManager *cm_;
   BufferManager *hdl_;
+  LogManager *log_;
   std::string curr_db_;
 
 public:
@@ -30,9 +33,15 @@ public:
   void ShowTables();
   void Insert(SQLInsert &st);
   void Select(SQLSelect &st);
+  // Streams the rows of a SELECT instead of printing them. The caller
+  // deletes the cursor, before running anything else on this database.
+  RecordCursor *OpenSelect(SQLSelect &st);
   void CreateIndex(SQLCreateIndex &st);
   void Delete(SQLDelete &st);
   void Update(SQLUpdate &st);
+  void Vacuum(SQLVacuum &st);
+  void Set(SQLSet &st);
+  void Analyze(SQLAnalyze &st);
 };
 
 #endif /* HackyDb_HackyDb_API_H_ */
@@ -37,13 +37,9 @@ BlockInfo *BlockHandle::GetUsableBlock() {
   return p;
 }
 
+// the first block is a list head that is never handed out
 void BlockHandle::FreeBlock(BlockInfo *block) {
-  if (bcount_ == 0) {
-    first_block_ = block;
-    block->set_next(block);
-  } else {
-    block->set_next(first_block_->next());
-    first_block_->set_next(block);
-  }
+  block->set_next(first_block_->next());
+  first_block_->set_next(block);
   bcount_++;
 }
\ No newline at end of file
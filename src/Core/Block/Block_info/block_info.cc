@@ -1,5 +1,6 @@
 #include "block_info.h"
 
+#include <cstring>   // For memset
 #include <fstream>   // For file read/write
 #include "../../../Includes/commons.h" // Contains shared constants like FORMAT_INDEX, etc.
 
@@ -23,7 +24,9 @@ void BlockInfo::ReadInfo(std::string path) {
   // Move the read pointer to the correct offset for this block
   ifs.seekg(block_num_ * 4 * 1024); // Each block is 4KB
 
-  // Read 4KB of block data into memory buffer `data_`
+  // Read 4KB of block data into memory buffer `data_`; blocks past the end
+  // of the file read back as zeros instead of a recycled block's contents
+  memset(data_, 0, 4 * 1024);
   ifs.read(data_, 4 * 1024);
 
   // Close the file
@@ -42,8 +45,9 @@ void BlockInfo::WriteInfo(std::string path) {
     path += ".records"; // Data records file
   }
 
-  // Open file in binary mode for writing
-  ofstream ofs(path, ios::binary);
+  // Open file in binary mode for in-place update; a plain ofstream would
+  // truncate the file and drop every other block
+  fstream ofs(path, ios::in | ios::out | ios::binary);
 
   // Move the write pointer to the correct offset for this block
   ofs.seekp(block_num_ * 4 * 1024); // Each block is 4KB
@@ -54,3 +58,80 @@ void BlockInfo::WriteInfo(std::string path) {
   // Close the file
   ofs.close();
 }
+
+// Removes the bytes of a record from the data area, moving the records
+// stored before it up to close the gap. The slot is left as it is.
+void BlockInfo::Compact(int slot) {
+  int offset = GetSlot(slot)[0];
+  int length = GetSlot(slot)[1];
+  int start = GetDataStart();
+
+  memmove(data_ + start + length, data_ + start, offset - start);
+  for (int i = 0; i < GetRecordCount(); ++i) {
+    if (!IsFreeSlot(i) && GetSlot(i)[0] < offset) {
+      GetSlot(i)[0] += length;
+    }
+  }
+  SetDataStart(start + length);
+}
+
+// The number of slots that hold a record
+int BlockInfo::CountRecords() {
+  int records = 0;
+  for (int i = 0; i < GetRecordCount(); ++i) {
+    if (!IsFreeSlot(i)) {
+      ++records;
+    }
+  }
+  return records;
+}
+
+// Stores a record in the first free slot, or a new one, and returns the
+// slot, or -1 if the block has no room for it
+int BlockInfo::AddRecord(const char *record, int length) {
+  int slot = 0;
+  while (slot < GetRecordCount() && !IsFreeSlot(slot)) {
+    ++slot;
+  }
+  int needed = slot == GetRecordCount() ? length + 4 : length;
+  if (needed > GetFreeSpace()) {
+    return -1;
+  }
+  int start = GetDataStart() - length;
+  memcpy(data_ + start, record, length);
+  SetDataStart(start);
+  if (slot == GetRecordCount()) {
+    SetRecordCount(slot + 1);
+  }
+  GetSlot(slot)[0] = start;
+  GetSlot(slot)[1] = length;
+  return slot;
+}
+
+// Stores a new version of a record under the same slot; false if the block
+// has no room for it, and then the record is unchanged
+bool BlockInfo::ReplaceRecord(int slot, const char *record, int length) {
+  if (length - GetRecordLength(slot) > GetFreeSpace()) {
+    return false;
+  }
+  Compact(slot);
+  int start = GetDataStart() - length;
+  memcpy(data_ + start, record, length);
+  SetDataStart(start);
+  GetSlot(slot)[0] = start;
+  GetSlot(slot)[1] = length;
+  return true;
+}
+
+// Removes a record and frees its slot. Free slots at the end of the
+// directory are dropped from it.
+void BlockInfo::RemoveRecord(int slot) {
+  Compact(slot);
+  GetSlot(slot)[0] = 0;
+  GetSlot(slot)[1] = 0;
+  int count = GetRecordCount();
+  while (count > 0 && IsFreeSlot(count - 1)) {
+    --count;
+  }
+  SetRecordCount(count);
+}
@@ -15,12 +15,18 @@ private:
   int block_num_;
   char *data_;
   bool dirty_;
+  bool logged_;
+  long long lsn_;
   long age_;
+  int pin_count_;
   BlockInfo *next_;
 
+  void Compact(int slot);
+
 public:
   BlockInfo(int num)
-      : dirty_(false), next_(NULL), file_(NULL), age_(0), block_num_(num) {
+      : dirty_(false), logged_(true), lsn_(0), next_(NULL), file_(NULL),
+        age_(0), pin_count_(0), block_num_(num) {
     data_ = new char[4 * 1024];
   }
   virtual ~BlockInfo() { delete[] data_; }
@@ -35,7 +41,20 @@ public:
   long age() { return age_; }
 
   bool dirty() { return dirty_; }
-  void set_dirty(bool dt) { dirty_ = true; }
+  // A change leaves the block ahead of its last image in the log.
+  void set_dirty(bool dt) {
+    dirty_ = dt;
+    logged_ = logged_ && !dt;
+  }
+
+  // The LSN of the last image of the block in the write-ahead log. The
+  // block is written back only once the log is on disk up to it.
+  long long lsn() { return lsn_; }
+  bool logged() { return logged_; }
+  void set_lsn(long long lsn) {
+    lsn_ = lsn;
+    logged_ = true;
+  }
 
   BlockInfo *next() { return next_; }
   void set_next(BlockInfo *block) { next_ = block; }
@@ -43,6 +62,10 @@ public:
   void IncreaseAge() { ++age_; }
   void ResetAge() { age_ = 0; }
 
+  bool pinned() { return pin_count_ > 0; }
+  void Pin() { ++pin_count_; }
+  void Unpin() { --pin_count_; }
+
   void SetPrevBlockNum(int num) { *(int *)(data_) = num; }
 
   int GetPrevBlockNum() { return *(int *)(data_); }
@@ -59,6 +82,40 @@ public:
 
   char *GetContentAddress() { return data_ + 12; }
 
+  // Record blocks are slotted pages. The record count is the number of
+  // slots, each an (offset, length) pair of shorts in a directory after the
+  // header. The records are packed at the end of the block, from the data
+  // start, kept where the next block number used to be, to 4096. A deleted
+  // record leaves its slot free, with offset 0, for a later insert, so the
+  // slots never move and a record keeps its RID until it is deleted.
+  void InitPage() {
+    SetRecordCount(0);
+    SetDataStart(4096);
+  }
+
+  int GetDataStart() { return *(int *)(data_ + 4); }
+
+  void SetDataStart(int start) { *(int *)(data_ + 4) = start; }
+
+  unsigned short *GetSlot(int slot) {
+    return (unsigned short *)(data_ + 12 + 4 * slot);
+  }
+
+  char *GetRecord(int slot) { return data_ + GetSlot(slot)[0]; }
+
+  int GetRecordLength(int slot) { return GetSlot(slot)[1]; }
+
+  bool IsFreeSlot(int slot) { return GetSlot(slot)[0] == 0; }
+
+  int CountRecords();
+
+  // Bytes between the slot directory and the records.
+  int GetFreeSpace() { return GetDataStart() - 12 - 4 * GetRecordCount(); }
+
+  int AddRecord(const char *record, int length);
+  bool ReplaceRecord(int slot, const char *record, int length);
+  void RemoveRecord(int slot);
+
   void ReadInfo(std::string path);
   void WriteInfo(std::string path);
 };
@@ -2,7 +2,11 @@
 
 #include "buffer_manager.h"
 
+#include <cstring>
 #include <fstream>
+#include <vector>
+
+#include <boost/filesystem.hpp>
 
 #include "../../../Includes/commons.h"
 
@@ -10,44 +14,161 @@ using namespace std;
 
 BlockInfo *BufferManager::GetFileBlock(string db_name, string tb_name,
                                        int file_type, int block_num) {
+  lock_guard<mutex> guard(mutex_);
+  return LoadBlock(db_name, tb_name, file_type, block_num);
+}
 
-  fhandle_->IncreaseAge();
+BlockInfo *BufferManager::PinFileBlock(string db_name, string tb_name,
+                                       int file_type, int block_num) {
+  lock_guard<mutex> guard(mutex_);
+  BlockInfo *block = LoadBlock(db_name, tb_name, file_type, block_num);
+  block->Pin();
+  return block;
+}
 
-  FileInfo *file = fhandle_->GetFileInfo(db_name, tb_name, file_type);
+void BufferManager::UnpinBlock(BlockInfo *block) {
+  lock_guard<mutex> guard(mutex_);
+  block->Unpin();
+}
+
+void BufferManager::ReadAhead(string db_name, string tb_name, int file_type,
+                              int first, int count) {
+  lock_guard<mutex> guard(mutex_);
+  FileInfo *file = GetFile(db_name, tb_name, file_type);
 
-  if (file) {
-    BlockInfo *block = fhandle_->GetBlockInfo(file, block_num);
-    if (block) {
-      return block;
-    } else {
-      BlockInfo *bp = GetUsableBlock();
-      bp->set_block_num(block_num);
-      bp->set_file(file);
-      bp->ReadInfo(path_);
-      fhandle_->AddBlockInfo(bp);
-      return bp;
+  // only the run from the first to the last block not buffered is read
+  int last = first + count - 1;
+  while (first <= last && fhandle_->GetBlockInfo(file, first) != NULL) {
+    ++first;
+  }
+  while (last >= first && fhandle_->GetBlockInfo(file, last) != NULL) {
+    --last;
+  }
+  if (first > last) {
+    return;
+  }
+
+  string path = path_ + db_name + "/" + tb_name +
+                (file_type == FORMAT_INDEX ? ".index" : ".records");
+  vector<char> data((last - first + 1) * 4 * 1024, 0);
+  ifstream ifs(path, ios::binary);
+  ifs.seekg((long long)first * 4 * 1024);
+  ifs.read(data.data(), data.size());
+  ifs.close();
+
+  fhandle_->IncreaseAge();
+  for (int i = first; i <= last; ++i) {
+    if (fhandle_->GetBlockInfo(file, i) != NULL) {
+      continue;
     }
-  } else {
     BlockInfo *bp = GetUsableBlock();
-    bp->set_block_num(block_num);
-    FileInfo *fp = new FileInfo(db_name, file_type, tb_name, 0, 0, NULL, NULL);
-    fhandle_->AddFileInfo(fp);
-    bp->set_file(fp);
-    bp->ReadInfo(path_);
+    bp->set_block_num(i);
+    bp->set_file(file);
+    memcpy(bp->data(), &data[(i - first) * 4 * 1024], 4 * 1024);
     fhandle_->AddBlockInfo(bp);
-    return bp;
   }
-  return 0;
+}
+
+void BufferManager::TruncateFile(string db_name, string tb_name,
+                                 int file_type, int blocks) {
+  lock_guard<mutex> guard(mutex_);
+  FileInfo *file = GetFile(db_name, tb_name, file_type);
+  BlockInfo *bp;
+  while ((bp = fhandle_->RemoveBlockInfo(file, blocks)) != NULL) {
+    bhandle_->FreeBlock(bp);
+  }
+
+  string path = path_ + db_name + "/" + tb_name +
+                (file_type == FORMAT_INDEX ? ".index" : ".records");
+  boost::filesystem::resize_file(path, (long long)blocks * 4 * 1024);
+}
+
+FileInfo *BufferManager::GetFile(string db_name, string tb_name,
+                                 int file_type) {
+  FileInfo *file = fhandle_->GetFileInfo(db_name, tb_name, file_type);
+  if (file == NULL) {
+    file = new FileInfo(db_name, file_type, tb_name, 0, 0, NULL, NULL);
+    fhandle_->AddFileInfo(file);
+  }
+  return file;
+}
+
+BlockInfo *BufferManager::LoadBlock(string db_name, string tb_name,
+                                    int file_type, int block_num) {
+  fhandle_->IncreaseAge();
+
+  FileInfo *file = GetFile(db_name, tb_name, file_type);
+  BlockInfo *block = fhandle_->GetBlockInfo(file, block_num);
+  if (block) {
+    return block;
+  }
+
+  BlockInfo *bp = GetUsableBlock();
+  bp->set_block_num(block_num);
+  bp->set_file(file);
+  bp->ReadInfo(path_);
+  fhandle_->AddBlockInfo(bp);
+  return bp;
 }
 
 BlockInfo *BufferManager::GetUsableBlock() {
+  BlockInfo *block;
   if (bhandle_->bcount() > 0) {
-    return bhandle_->GetUsableBlock();
+    block = bhandle_->GetUsableBlock();
   } else {
-    return fhandle_->RecycleBlock();
+    block = fhandle_->RecycleBlock();
+    if (block->dirty()) {
+      WriteBack(block);
+    }
+  }
+  block->set_dirty(false);
+  block->set_lsn(0);
+  return block;
+}
+
+void BufferManager::LogBlock(BlockInfo *block) {
+  FileInfo *file = block->file();
+  block->set_lsn(log_->AppendPage(
+      LogManager::FileName(file->db_name(), file->file_name(), file->type()),
+      block->block_num(), block->data(), 4 * 1024));
+}
+
+// A block recycled in the middle of a statement is logged first, as part
+// of the statement, since the log must reach disk before the block does.
+// What it overwrites is saved too, in case the statement never commits.
+void BufferManager::WriteBack(BlockInfo *block) {
+  if (!block->logged()) {
+    FileInfo *file = block->file();
+    log_->AppendUndo(
+        LogManager::FileName(file->db_name(), file->file_name(), file->type()),
+        block->block_num());
+    LogBlock(block);
   }
+  log_->Flush(block->lsn());
+  block->WriteInfo(path_);
+  block->set_dirty(false);
 }
 
 void BufferManager::WriteBlock(BlockInfo *block) { block->set_dirty(true); }
 
-void BufferManager::WriteToDisk() { fhandle_->WriteToDisk(); }
\ No newline at end of file
+void BufferManager::Commit() {
+  {
+    lock_guard<mutex> guard(mutex_);
+    vector<BlockInfo *> blocks = fhandle_->GetChangedBlocks();
+    for (unsigned int i = 0; i < blocks.size(); ++i) {
+      LogBlock(blocks[i]);
+    }
+  }
+  log_->Commit();
+
+  if (log_->size() > WAL_CHECKPOINT_BYTES) {
+    WriteToDisk();
+  }
+}
+
+void BufferManager::WriteToDisk() {
+  lock_guard<mutex> guard(mutex_);
+  log_->Flush();
+  fhandle_->WriteToDisk();
+  log_->Truncate();
+}
\ No newline at end of file
@@ -3,30 +3,60 @@
 #ifndef HackyDb_BUFFER_MANAGER_H_
 #define HackyDb_BUFFER_MANAGER_H_
 
+#include <mutex>
 #include <string>
 
 #include "../../Block/Block_handle/block_handle.h"
 #include "../../File/File_handle/file_handle.h"
+#include "../../Log/Log_manager/log_manager.h"
+
+#define READ_AHEAD_BLOCKS 16
 
 class BufferManager {
 private:
   BlockHandle *bhandle_;
   FileHandle *fhandle_;
+  LogManager *log_;
   std::string path_;
+  std::mutex mutex_;
 
   BlockInfo *GetUsableBlock();
+  void LogBlock(BlockInfo *block);
+  void WriteBack(BlockInfo *block);
+  FileInfo *GetFile(std::string db_name, std::string tb_name, int file_type);
+  BlockInfo *LoadBlock(std::string db_name, std::string tb_name,
+                       int file_type, int block_num);
 
 public:
-  BufferManager(std::string p)
-      : bhandle_(new BlockHandle(p)), fhandle_(new FileHandle(p)), path_(p) {}
+  BufferManager(std::string p, LogManager *log)
+      : bhandle_(new BlockHandle(p)), fhandle_(new FileHandle(p)), log_(log),
+        path_(p) {}
   ~BufferManager() {
+    WriteToDisk();
     delete bhandle_;
     delete fhandle_;
   }
 
   BlockInfo *GetFileBlock(std::string db_name, std::string tb_name,
                           int file_type, int block_num);
+  // Like GetFileBlock, but the block is not recycled until UnpinBlock.
+  BlockInfo *PinFileBlock(std::string db_name, std::string tb_name,
+                          int file_type, int block_num);
+  void UnpinBlock(BlockInfo *block);
+  // Loads the blocks [first, first + count) of a file with one sequential
+  // read instead of one per block. Blocks already buffered are kept.
+  void ReadAhead(std::string db_name, std::string tb_name, int file_type,
+                 int first, int count);
+  // Cuts a file down to its first blocks. Buffered blocks past them are
+  // dropped unwritten.
+  void TruncateFile(std::string db_name, std::string tb_name, int file_type,
+                    int blocks);
   void WriteBlock(BlockInfo *block);
+  // Ends a statement: the blocks it changed go to the write-ahead log and
+  // stay dirty in the buffer.
+  void Commit();
+  // A checkpoint, taken between statements: writes every dirty block to
+  // its file, then empties the log.
   void WriteToDisk();
 };
 
@@ -1,6 +1,9 @@
 
 #include "file_handle.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <fstream>
 
 #include "../../../Includes/commons.h"
@@ -73,6 +76,27 @@ void FileHandle::AddBlockInfo(BlockInfo *block) {
   block->file()->IncreaseRecordLength();
 }
 
+// Takes a block numbered first or higher off the file's list and returns
+// it, or NULL if there is none.
+BlockInfo *FileHandle::RemoveBlockInfo(FileInfo *file, int first) {
+  BlockInfo *before = NULL;
+  BlockInfo *p = file->first_block();
+  while (p != NULL && p->block_num() < first) {
+    before = p;
+    p = p->next();
+  }
+  if (p == NULL) {
+    return NULL;
+  }
+  if (before == NULL) {
+    file->set_first_block(p->next());
+  } else {
+    before->set_next(p->next());
+  }
+  p->set_next(NULL);
+  return p;
+}
+
 void FileHandle::IncreaseAge() {
   FileInfo *fp = first_file_;
   while (fp != NULL) {
@@ -92,14 +116,15 @@ BlockInfo *FileHandle::RecycleBlock() {
   FileInfo *fp = first_file_;
 
   BlockInfo *oldestbefore = NULL;
-  BlockInfo *oldest = fp->first_block();
+  BlockInfo *oldest = NULL;
 
   while (fp != NULL) {
     BlockInfo *bpbefore = NULL;
     BlockInfo *bp = fp->first_block();
     while (bp != NULL) {
 
-      if (bp->age() > oldest->age()) {
+      // pinned blocks are in use and must keep their contents
+      if (!bp->pinned() && (oldest == NULL || bp->age() > oldest->age())) {
         oldestbefore = bpbefore;
         oldest = bp;
       }
@@ -109,10 +134,6 @@ BlockInfo *FileHandle::RecycleBlock() {
     fp = fp->next();
   }
 
-  if (oldest->dirty()) {
-    oldest->WriteInfo(path_);
-  }
-
   if (oldestbefore == NULL) {
     oldest->file()->set_first_block(oldest->next());
   } else {
@@ -125,8 +146,27 @@ BlockInfo *FileHandle::RecycleBlock() {
   return oldest;
 }
 
-void FileHandle::WriteToDisk() {
+// The dirty blocks changed since their last image in the log.
+std::vector<BlockInfo *> FileHandle::GetChangedBlocks() {
+  vector<BlockInfo *> blocks;
   FileInfo *fp = first_file_;
+  while (fp != NULL) {
+    BlockInfo *bp = fp->first_block();
+    while (bp != NULL) {
+      if (bp->dirty() && !bp->logged()) {
+        blocks.push_back(bp);
+      }
+      bp = bp->next();
+    }
+    fp = fp->next();
+  }
+  return blocks;
+}
+
+// Writes the dirty blocks and syncs every file with blocks buffered, so
+// that the blocks recycled earlier are on disk too.
+void FileHandle::WriteToDisk() {
+  FileInfo *fp = first_file_->next();
   while (fp != NULL) {
     BlockInfo *bp = fp->first_block();
     while (bp != NULL) {
@@ -136,6 +176,14 @@ void FileHandle::WriteToDisk() {
       }
       bp = bp->next();
     }
+
+    string path = path_ + fp->db_name() + "/" + fp->file_name() +
+                  (fp->type() == FORMAT_INDEX ? ".index" : ".records");
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd != -1) {
+      fsync(fd);
+      close(fd);
+    }
     fp = fp->next();
   }
 }
\ No newline at end of file
@@ -4,7 +4,7 @@
 #define HackyDb_FILE_HANDLE_H_
 
 #include <string>
-
+#include <vector>
 
 #include "../../Block/Block_info/block_info.h"
 #include "../File_info/file_info.h"
@@ -21,9 +21,11 @@ public:
                         int file_type);
   BlockInfo *GetBlockInfo(FileInfo *file, int block_pos);
   void AddBlockInfo(BlockInfo *block);
+  BlockInfo *RemoveBlockInfo(FileInfo *file, int first);
   void IncreaseAge();
   BlockInfo *RecycleBlock();
   void AddFileInfo(FileInfo *file);
+  std::vector<BlockInfo *> GetChangedBlocks();
   void WriteToDisk();
 };
 
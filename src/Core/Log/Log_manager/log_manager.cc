@@ -0,0 +1,359 @@
+
+
+#include "log_manager.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+
+#include <boost/filesystem.hpp>
+
+#include "../../../Includes/commons.h"
+
+using namespace std;
+
+// A record is its length, type and statement, the body and a checksum of
+// the rest, so that a record torn by a crash is found and ignored. The file
+// starts with the LSN of its first record.
+#define LOG_HEADER 8
+#define LOG_RECORD_HEADER 16
+#define LOG_RECORD_MIN (LOG_RECORD_HEADER + 4)
+
+static unsigned int Checksum(const char *data, int length) {
+  unsigned int hash = 2166136261u;
+  for (int i = 0; i < length; ++i) {
+    hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// records are not aligned in the log
+template <class T> static T ReadAt(const char *data) {
+  T value;
+  memcpy(&value, data, sizeof(T));
+  return value;
+}
+
+string LogManager::FileName(string db_name, string tb_name, int file_type) {
+  return db_name + "/" + tb_name +
+         (file_type == FORMAT_INDEX ? ".index" : ".records");
+}
+
+LogManager::LogManager(string p)
+    : path_(p), fd_(-1), base_lsn_(0), next_lsn_(0), flushed_lsn_(0),
+      wanted_lsn_(0), txn_(1), synchronous_commit_(true), flushing_(false),
+      stop_(false) {
+  boost::filesystem::create_directories(p);
+  fd_ = open((path_ + "wal").c_str(), O_RDWR | O_CREAT, 0644);
+  Recover();
+  flusher_ = thread(&LogManager::Run, this);
+}
+
+// The buffer and the catalog are closed first, so the files hold all the
+// log does and a clean shutdown leaves it empty.
+LogManager::~LogManager() {
+  Truncate();
+  {
+    lock_guard<mutex> guard(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  flusher_.join();
+  close(fd_);
+}
+
+long long LogManager::Append(int type, const string &body) {
+  int length = LOG_RECORD_MIN + body.size();
+  unsigned long start = buffer_.size();
+  buffer_.resize(start + length);
+  char *record = &buffer_[start];
+  memcpy(record, &length, 4);
+  memcpy(record + 4, &type, 4);
+  memcpy(record + 8, &txn_, 8);
+  memcpy(record + LOG_RECORD_HEADER, body.data(), body.size());
+  unsigned int sum = Checksum(record, length - 4);
+  memcpy(record + length - 4, &sum, 4);
+
+  long long lsn = next_lsn_;
+  next_lsn_ += length;
+  return lsn;
+}
+
+// An image is the block number, the file name and the contents.
+long long LogManager::AppendImage(int type, const string &file_name,
+                                  int block_num, const char *data,
+                                  int length) {
+  string body;
+  body.append((char *)&block_num, 4);
+  unsigned short name_length = file_name.size();
+  body.append((char *)&name_length, 2);
+  body.append(file_name);
+  body.append(data, length);
+  return Append(type, body);
+}
+
+long long LogManager::AppendPage(string file_name, int block_num,
+                                 const char *data, int length) {
+  lock_guard<mutex> guard(mutex_);
+  return AppendImage(LOG_PAGE, file_name, block_num, data, length);
+}
+
+// A write is the offset, the file name and the bytes. It is also kept to
+// be made at the next checkpoint.
+long long LogManager::AppendWrite(string file_name, long long offset,
+                                  const char *data, int length) {
+  string body;
+  body.append((char *)&offset, 8);
+  unsigned short name_length = file_name.size();
+  body.append((char *)&name_length, 2);
+  body.append(file_name);
+  body.append(data, length);
+
+  lock_guard<mutex> guard(mutex_);
+  writes_.push_back(LogWrite(file_name, offset, string(data, length)));
+  return Append(LOG_WRITE, body);
+}
+
+long long LogManager::AppendUndo(string file_name, int block_num) {
+  {
+    lock_guard<mutex> guard(mutex_);
+    if (saved_.count(make_pair(file_name, block_num)) > 0) {
+      return -1;
+    }
+  }
+
+  // blocks past the end of the file are zeros, as the buffer reads them
+  vector<char> data(4 * 1024, 0);
+  ifstream ifs(path_ + file_name, ios::binary);
+  ifs.seekg((long long)block_num * 4 * 1024);
+  ifs.read(data.data(), data.size());
+  ifs.close();
+
+  lock_guard<mutex> guard(mutex_);
+  saved_.insert(make_pair(file_name, block_num));
+  return AppendImage(LOG_UNDO, file_name, block_num, data.data(),
+                     data.size());
+}
+
+void LogManager::Commit() {
+  long long lsn;
+  {
+    lock_guard<mutex> guard(mutex_);
+    lsn = Append(LOG_COMMIT, "");
+    ++txn_;
+    saved_.clear();
+  }
+  if (synchronous_commit_) {
+    Flush(lsn);
+  }
+}
+
+void LogManager::Flush(long long lsn) {
+  unique_lock<mutex> lock(mutex_);
+  if (flushed_lsn_ > lsn) {
+    return;
+  }
+  wanted_lsn_ = max(wanted_lsn_, lsn + 1);
+  wake_.notify_one();
+  flushed_.wait(lock, [this, lsn] { return flushed_lsn_ > lsn; });
+}
+
+void LogManager::Flush() {
+  long long lsn;
+  {
+    lock_guard<mutex> guard(mutex_);
+    lsn = next_lsn_ - 1;
+  }
+  Flush(lsn);
+}
+
+void LogManager::Truncate() {
+  Flush();
+  unique_lock<mutex> lock(mutex_);
+  flushed_.wait(lock, [this] { return !flushing_; });
+
+  set<string> files;
+  for (unsigned int i = 0; i < writes_.size(); ++i) {
+    WriteAt(path_ + writes_[i].file_name, writes_[i].offset,
+            writes_[i].data.data(), writes_[i].data.size());
+    files.insert(path_ + writes_[i].file_name);
+  }
+  writes_.clear();
+  SyncFiles(files);
+  Reset();
+}
+
+long long LogManager::size() {
+  lock_guard<mutex> guard(mutex_);
+  return next_lsn_ - base_lsn_;
+}
+
+// Writes the bytes at the offset and cuts the file after them, creating it
+// if need be.
+void LogManager::WriteAt(string path, long long offset, const char *data,
+                         int length) {
+  if (!boost::filesystem::exists(path)) {
+    ofstream create(path, ios::binary);
+    create.close();
+  }
+  fstream ofs(path, ios::in | ios::out | ios::binary);
+  ofs.seekp(offset);
+  ofs.write(data, length);
+  ofs.close();
+  boost::filesystem::resize_file(path, offset + length);
+}
+
+void LogManager::SyncFiles(const set<string> &files) {
+  for (set<string>::const_iterator iter = files.begin(); iter != files.end();
+       ++iter) {
+    int fd = open(iter->c_str(), O_RDONLY);
+    if (fd != -1) {
+      fsync(fd);
+      close(fd);
+    }
+  }
+}
+
+// Empties the file, keeping the LSNs where they are.
+void LogManager::Reset() {
+  base_lsn_ = next_lsn_;
+  pwrite(fd_, &base_lsn_, LOG_HEADER, 0);
+  ftruncate(fd_, LOG_HEADER);
+  fsync(fd_);
+}
+
+// Writes the buffered records in batches, one sync each.
+void LogManager::Run() {
+  unique_lock<mutex> lock(mutex_);
+  while (true) {
+    wake_.wait_for(lock, chrono::milliseconds(WAL_WRITER_DELAY_MS),
+                   [this] { return stop_ || wanted_lsn_ > flushed_lsn_; });
+    if (!buffer_.empty()) {
+      vector<char> batch;
+      batch.swap(buffer_);
+      long long offset = LOG_HEADER + flushed_lsn_ - base_lsn_;
+      long long end = next_lsn_;
+      flushing_ = true;
+      lock.unlock();
+
+      pwrite(fd_, batch.data(), batch.size(), offset);
+      fdatasync(fd_);
+
+      lock.lock();
+      flushing_ = false;
+      flushed_lsn_ = end;
+      flushed_.notify_all();
+    }
+    if (stop_) {
+      return;
+    }
+  }
+}
+
+// Recovery scans the log once to find the statements that committed. It
+// then redoes them, writing back the last image each one left of a block
+// and making their writes in order, and undoes the one that did not
+// commit, writing back the earliest contents it saved of every block it
+// overwrote and no committed statement wrote since. Images are whole
+// blocks, so a block already written before the crash is simply written
+// again. The log only reaches back to the last checkpoint, and so does
+// the work here.
+void LogManager::Recover() {
+  long long length = lseek(fd_, 0, SEEK_END);
+  vector<char> log(max(length, (long long)LOG_HEADER), 0);
+  pread(fd_, log.data(), length, 0);
+  memcpy(&base_lsn_, log.data(), LOG_HEADER);
+
+  vector<long long> records;
+  set<long long> committed;
+  long long pos = LOG_HEADER;
+  while (pos + LOG_RECORD_MIN <= length) {
+    int size = ReadAt<int>(&log[pos]);
+    if (size < LOG_RECORD_MIN || pos + size > length ||
+        ReadAt<unsigned int>(&log[pos + size - 4]) !=
+            Checksum(&log[pos], size - 4)) {
+      break;
+    }
+    if (ReadAt<int>(&log[pos + 4]) == LOG_COMMIT) {
+      committed.insert(ReadAt<long long>(&log[pos + 8]));
+    }
+    records.push_back(pos);
+    pos += size;
+  }
+
+  typedef pair<string, int> Target;
+  map<Target, const char *> redo;
+  map<Target, const char *> undo;
+  set<string> files;
+  int writes = 0;
+  for (unsigned int i = 0; i < records.size(); ++i) {
+    const char *record = &log[records[i]];
+    int type = ReadAt<int>(record + 4);
+    bool done = committed.count(ReadAt<long long>(record + 8)) > 0;
+    const char *body = record + LOG_RECORD_HEADER;
+
+    if (type == LOG_WRITE && done) {
+      long long offset = ReadAt<long long>(body);
+      unsigned short name_length = ReadAt<unsigned short>(body + 8);
+      string path = path_ + string(body + 10, name_length);
+      WriteAt(path, offset, body + 10 + name_length,
+              ReadAt<int>(record) - LOG_RECORD_MIN - 10 - name_length);
+      files.insert(path);
+      ++writes;
+      continue;
+    }
+    if (!(type == LOG_PAGE && done) && !(type == LOG_UNDO && !done)) {
+      continue;
+    }
+    int block_num = ReadAt<int>(body);
+    unsigned short name_length = ReadAt<unsigned short>(body + 4);
+    Target target(string(body + 6, name_length), block_num);
+    if (type == LOG_PAGE) {
+      redo[target] = body + 6 + name_length;
+    } else if (undo.count(target) == 0) {
+      undo[target] = body + 6 + name_length;
+    }
+  }
+
+  int redone = redo.size();
+  int undone = 0;
+  for (map<Target, const char *>::iterator iter = undo.begin();
+       iter != undo.end(); ++iter) {
+    if (redo.count(iter->first) == 0) {
+      redo[iter->first] = iter->second;
+      ++undone;
+    }
+  }
+
+  for (map<Target, const char *>::iterator iter = redo.begin();
+       iter != redo.end(); ++iter) {
+    // the files of dropped tables are not brought back
+    string path = path_ + iter->first.first;
+    if (!boost::filesystem::exists(path)) {
+      continue;
+    }
+    fstream ofs(path, ios::in | ios::out | ios::binary);
+    ofs.seekp((long long)iter->first.second * 4 * 1024);
+    ofs.write(iter->second, 4 * 1024);
+    ofs.close();
+    files.insert(path);
+  }
+
+  SyncFiles(files);
+  if (redone + undone + writes > 0) {
+    cout << "Recovered from the write-ahead log: " << redone
+         << " blocks redone, " << undone << " undone, " << writes
+         << " writes made" << endl;
+  }
+
+  next_lsn_ = base_lsn_ + pos - LOG_HEADER;
+  flushed_lsn_ = next_lsn_;
+  wanted_lsn_ = next_lsn_;
+  Reset();
+}
@@ -0,0 +1,114 @@
+
+
+#ifndef HackyDb_LOG_MANAGER_H_
+#define HackyDb_LOG_MANAGER_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Commits that do not wait for the log are flushed within this delay.
+#define WAL_WRITER_DELAY_MS 200
+// A commit checkpoints once the log has grown past this many bytes.
+#define WAL_CHECKPOINT_BYTES (8 * 1024 * 1024)
+
+// Log Record Type
+#define LOG_PAGE 1   // the image of a block changed by a statement
+#define LOG_COMMIT 2 // the end of a statement
+#define LOG_UNDO 3   // what a statement overwrote before it committed
+#define LOG_WRITE 4  // bytes a statement wrote at an offset of a file
+
+// A write to a file, made when the log is next emptied.
+class LogWrite {
+public:
+  std::string file_name;
+  long long offset;
+  std::string data;
+
+  LogWrite(std::string f, long long o, std::string d)
+      : file_name(f), offset(o), data(d) {}
+};
+
+// The write-ahead log. The blocks a statement changes are appended to it
+// as whole images, then a commit record, and the blocks themselves are
+// only written back at checkpoints or when the buffer recycles them.
+// A block recycled before its statement commits first has its contents on
+// disk saved in the log, so that recovery can undo a statement cut short
+// by a crash. Other files, such as the catalog, are changed by writes,
+// which are only made at checkpoints.
+// A log sequence number (LSN) is the position of a record in the log
+// counted from its creation, so LSNs keep growing when it is emptied.
+//
+// A flusher thread writes the log. A commit that waits for it is flushed
+// at once, together with every commit made while the last flush was
+// syncing; the others are flushed within WAL_WRITER_DELAY_MS.
+class LogManager {
+private:
+  std::string path_;
+  int fd_;
+  long long base_lsn_;    // LSN of the first record in the file
+  long long next_lsn_;    // LSN of the next record appended
+  long long flushed_lsn_; // the records before it are on disk
+  long long wanted_lsn_;  // the records before it are waited for
+  long long txn_;         // the running statement
+  bool synchronous_commit_;
+  bool flushing_;
+  bool stop_;
+  std::vector<char> buffer_; // the records from flushed_lsn_ on
+  // the blocks the running statement saved for undo
+  std::set<std::pair<std::string, int> > saved_;
+  std::vector<LogWrite> writes_; // the writes since the last checkpoint
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable flushed_;
+  std::thread flusher_;
+
+  long long Append(int type, const std::string &body);
+  long long AppendImage(int type, const std::string &file_name,
+                        int block_num, const char *data, int length);
+  void WriteAt(std::string path, long long offset, const char *data,
+               int length);
+  void SyncFiles(const std::set<std::string> &files);
+  void Run();
+  void Recover();
+  void Reset();
+
+public:
+  LogManager(std::string p);
+  ~LogManager();
+
+  bool synchronous_commit() { return synchronous_commit_; }
+  void set_synchronous_commit(bool sync) { synchronous_commit_ = sync; }
+
+  // The name in the log of a table or index file.
+  static std::string FileName(std::string db_name, std::string tb_name,
+                              int file_type);
+
+  // Appends the image of a block and returns its LSN.
+  long long AppendPage(std::string file_name, int block_num,
+                       const char *data, int length);
+  // Saves the contents on disk of a block before the running statement
+  // overwrites them, and returns the LSN, or -1 if the statement has saved
+  // them already.
+  long long AppendUndo(std::string file_name, int block_num);
+  // Appends bytes to be written at the offset of a file, which then ends
+  // after them, and returns the LSN. The file is written at the next
+  // checkpoint, or by recovery.
+  long long AppendWrite(std::string file_name, long long offset,
+                        const char *data, int length);
+  // Ends the running statement. With synchronous_commit the commit is on
+  // disk when this returns.
+  void Commit();
+  // Waits until the record at the LSN, and all before it, are on disk.
+  void Flush(long long lsn);
+  void Flush();
+  // Flushes the log, makes its writes and empties it, once the blocks it
+  // holds are written.
+  void Truncate();
+  long long size();
+};
+
+#endif /* HackyDb_LOG_MANAGER_H_ */
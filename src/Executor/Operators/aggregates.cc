@@ -0,0 +1,298 @@
+#include "aggregates.h"
+
+#include <climits>
+#include <cstring>
+
+#include "../../managers/Index_manager/index_manager.h"
+
+using namespace std;
+
+HashAggregate::HashAggregate(Operator *child, std::vector<int> groups,
+                             std::vector<AggregateSpec> aggs,
+                             std::vector<std::string> agg_names)
+    : child_(child), groups_(groups), aggs_(aggs), built_(false),
+      table_bytes_(0), spilled_(false), can_spill_(true), partition_(-1) {
+  for (int i = 0; i < groups_.size(); ++i) {
+    names_.push_back(child_->names()[groups_[i]]);
+  }
+  names_.insert(names_.end(), agg_names.begin(), agg_names.end());
+  for (int i = 0; i < HASH_AGG_PARTITIONS; ++i) {
+    files_[i] = NULL;
+  }
+}
+
+HashAggregate::~HashAggregate() {
+  for (int i = 0; i < HASH_AGG_PARTITIONS; ++i) {
+    delete files_[i];
+  }
+  delete child_;
+}
+
+// The group columns, each prefixed with its length so different splits of
+// the same bytes stay different groups.
+std::string HashAggregate::GroupKey(std::vector<TKey> &row) {
+  string key;
+  for (int i = 0; i < groups_.size(); ++i) {
+    string bytes = KeyBytes(row[groups_[i]]);
+    int length = bytes.size();
+    key.append((char *)&length, sizeof(length));
+    key.append(bytes);
+  }
+  return key;
+}
+
+// Folds a row into its group. With spill set, a row whose group is not in
+// the table yet goes to a partition file instead; false if it did.
+bool HashAggregate::Add(std::vector<TKey> &row, bool spill) {
+  string key = GroupKey(row);
+  GroupTable::iterator it = table_.find(key);
+
+  if (it == table_.end()) {
+    if (spill) {
+      files_[Partition(key, HASH_AGG_PARTITIONS)]->Write(row);
+      return false;
+    }
+    Group group;
+    for (int i = 0; i < groups_.size(); ++i) {
+      group.keys.push_back(row[groups_[i]]);
+    }
+    Accumulator zero = {0, 0, 0};
+    for (int i = 0; i < aggs_.size(); ++i) {
+      if (aggs_[i].col == -1) {
+        group.extremes.push_back(TKey(T_INT, 4));
+      } else {
+        group.extremes.push_back(row[aggs_[i].col]);
+      }
+      group.accs.push_back(zero);
+    }
+    table_bytes_ += RowBytes(group.keys) + RowBytes(group.extremes) +
+                    key.size() + aggs_.size() * sizeof(Accumulator);
+    it = table_.insert(make_pair(key, group)).first;
+  }
+
+  Group &group = it->second;
+  for (int i = 0; i < aggs_.size(); ++i) {
+    Accumulator &acc = group.accs[i];
+    acc.count++;
+    if (aggs_[i].col == -1) {
+      continue;
+    }
+
+    TKey &value = row[aggs_[i].col];
+    switch (aggs_[i].func) {
+    case AGG_SUM:
+    case AGG_AVG:
+      if (aggs_[i].type == T_INT) {
+        int v;
+        memcpy(&v, value.key(), sizeof(v));
+        acc.total += v;
+        acc.sum += v;
+      } else {
+        float v;
+        memcpy(&v, value.key(), sizeof(v));
+        acc.sum += v;
+      }
+      break;
+    case AGG_MIN:
+      if (CompareKeys(value, group.extremes[i]) < 0) {
+        group.extremes[i] = value;
+      }
+      break;
+    case AGG_MAX:
+      if (CompareKeys(value, group.extremes[i]) > 0) {
+        group.extremes[i] = value;
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+void HashAggregate::Build() {
+  vector<TKey> row;
+  while (child_->Next(row)) {
+    Add(row, spilled_);
+    if (!spilled_ && table_bytes_ > HASH_AGG_MEMORY && can_spill_ &&
+        !groups_.empty()) {
+      // tried once; without temporary files the table keeps growing
+      can_spill_ = false;
+      spilled_ = true;
+      for (int i = 0; i < HASH_AGG_PARTITIONS; ++i) {
+        files_[i] = new SpillFile();
+        spilled_ = spilled_ && files_[i]->ok();
+      }
+    }
+  }
+  Finish();
+}
+
+bool HashAggregate::Partial(long long memory) {
+  vector<TKey> row;
+  while (child_->Next(row)) {
+    Add(row, false);
+    if (table_bytes_ > memory) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void HashAggregate::Merge(HashAggregate *other) {
+  for (GroupTable::iterator it = other->table_.begin();
+       it != other->table_.end(); ++it) {
+    GroupTable::iterator mine = table_.find(it->first);
+    if (mine == table_.end()) {
+      table_.insert(*it);
+      continue;
+    }
+
+    Group &group = mine->second;
+    Group &from = it->second;
+    for (int i = 0; i < aggs_.size(); ++i) {
+      group.accs[i].count += from.accs[i].count;
+      group.accs[i].total += from.accs[i].total;
+      group.accs[i].sum += from.accs[i].sum;
+      if (aggs_[i].func == AGG_MIN &&
+          CompareKeys(from.extremes[i], group.extremes[i]) < 0) {
+        group.extremes[i] = from.extremes[i];
+      } else if (aggs_[i].func == AGG_MAX &&
+                 CompareKeys(from.extremes[i], group.extremes[i]) > 0) {
+        group.extremes[i] = from.extremes[i];
+      }
+    }
+  }
+}
+
+void HashAggregate::Finish() {
+  if (table_.empty() && groups_.empty()) {
+    Group group;
+    Accumulator zero = {0, 0, 0};
+    for (int i = 0; i < aggs_.size(); ++i) {
+      TKey value(aggs_[i].type, aggs_[i].length);
+      memset(value.key(), 0, value.length());
+      group.extremes.push_back(value);
+      group.accs.push_back(zero);
+    }
+    table_.insert(make_pair(string(), group));
+  }
+  it_ = table_.begin();
+  built_ = true;
+}
+
+void HashAggregate::Emit(Group &group, std::vector<TKey> &row) {
+  row = group.keys;
+  for (int i = 0; i < aggs_.size(); ++i) {
+    Accumulator &acc = group.accs[i];
+    switch (aggs_[i].func) {
+    case AGG_COUNT: {
+      TKey value(T_INT, 4);
+      int count = acc.count;
+      memcpy(value.key(), &count, sizeof(count));
+      row.push_back(value);
+    } break;
+    case AGG_SUM:
+    case AGG_AVG: {
+      TKey value(aggs_[i].func == AGG_SUM ? aggs_[i].type : T_FLOAT, 4);
+      if (value.key_type() == T_INT) {
+        // there is no wider INT to hold the sum in
+        if (acc.total < INT_MIN || acc.total > INT_MAX) {
+          throw IntegerOverflowException();
+        }
+        int total = acc.total;
+        memcpy(value.key(), &total, sizeof(total));
+      } else {
+        float sum = acc.sum;
+        if (aggs_[i].func == AGG_AVG && acc.count != 0) {
+          sum = acc.sum / acc.count;
+        }
+        memcpy(value.key(), &sum, sizeof(sum));
+      }
+      row.push_back(value);
+    } break;
+    default:
+      row.push_back(group.extremes[i]);
+      break;
+    }
+  }
+}
+
+bool HashAggregate::Next(std::vector<TKey> &row) {
+  if (!built_) {
+    Build();
+  }
+  while (it_ == table_.end()) {
+    if (!spilled_ || ++partition_ == HASH_AGG_PARTITIONS) {
+      return false;
+    }
+    // a partition is aggregated whole even if it outgrows the memory limit
+    table_.clear();
+    vector<TKey> input;
+    files_[partition_]->Rewind();
+    while (files_[partition_]->Read(input)) {
+      Add(input, false);
+    }
+    it_ = table_.begin();
+  }
+  Emit(it_->second, row);
+  ++it_;
+  return true;
+}
+
+RecordCount::RecordCount(RecordManager rm, Table *tbl, std::string name)
+    : rm_(rm), tbl_(tbl), done_(false) {
+  names_.push_back(name);
+}
+
+bool RecordCount::Next(std::vector<TKey> &row) {
+  if (done_) {
+    return false;
+  }
+  done_ = true;
+
+  int count = tbl_->CountRecords();
+
+  TKey value(T_INT, 4);
+  memcpy(value.key(), &count, sizeof(count));
+  row.clear();
+  row.push_back(value);
+  return true;
+}
+
+IndexMinMax::IndexMinMax(RecordManager rm, Index *idx, std::string min_name,
+                         std::string max_name)
+    : rm_(rm), idx_(idx), done_(false) {
+  names_.push_back(min_name);
+  names_.push_back(max_name);
+}
+
+bool IndexMinMax::Next(std::vector<TKey> &row) {
+  if (done_) {
+    return false;
+  }
+  done_ = true;
+
+  TKey min(idx_->key_type(), idx_->key_len());
+  memset(min.key(), 0, min.length());
+  TKey max(min);
+
+  BPlusTree tree(idx_, rm_.hdl(), rm_.cm(), rm_.db_name());
+  int first = tree.FirstLeaf();
+  if (first != -1) {
+    BPlusTreeNode *leaf = tree.GetNode(first);
+    if (leaf->GetCount() != 0) {
+      min = leaf->GetKeys(0);
+    }
+    delete leaf;
+
+    leaf = tree.GetNode(tree.LastLeaf());
+    if (leaf->GetCount() != 0) {
+      max = leaf->GetKeys(leaf->GetCount() - 1);
+    }
+    delete leaf;
+  }
+
+  row.clear();
+  row.push_back(min);
+  row.push_back(max);
+  return true;
+}
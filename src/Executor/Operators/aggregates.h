@@ -0,0 +1,109 @@
+#ifndef HackyDb_AGGREGATES_H_
+#define HackyDb_AGGREGATES_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "operators.h"
+
+// An aggregate over column col of the input rows, or over the rows
+// themselves for COUNT(*) (col -1). type and length describe the column.
+typedef struct {
+  int func;
+  int col;
+  int type;
+  int length;
+} AggregateSpec;
+
+#define HASH_AGG_MEMORY (16 << 20)
+#define HASH_AGG_PARTITIONS 32
+
+// Groups its input on the group columns in a hash table and emits one row
+// per group: the group columns followed by the aggregates. Without group
+// columns there is exactly one row, with zeroes if the input is empty.
+// A SUM of INT is added up in 64 bits, and a total that does not fit in an
+// INT raises IntegerOverflowException rather than wrapping.
+// Once the table outgrows HASH_AGG_MEMORY, rows of groups that are not in
+// it yet are hash partitioned into temporary files and each partition is
+// aggregated after the table is emitted.
+class HashAggregate : public Operator {
+private:
+  typedef struct {
+    long long count;
+    long long total; // SUM of INT
+    double sum;      // SUM of FLOAT and AVG
+  } Accumulator;
+
+  typedef struct {
+    std::vector<TKey> keys;
+    std::vector<TKey> extremes; // MIN and MAX so far
+    std::vector<Accumulator> accs;
+  } Group;
+
+  typedef std::unordered_map<std::string, Group> GroupTable;
+
+  Operator *child_;
+  std::vector<int> groups_;
+  std::vector<AggregateSpec> aggs_;
+
+  bool built_;
+  GroupTable table_;
+  GroupTable::iterator it_;
+  long long table_bytes_;
+
+  bool spilled_;
+  bool can_spill_;
+  SpillFile *files_[HASH_AGG_PARTITIONS];
+  int partition_; // being emitted, -1 for the rows aggregated first
+
+  std::string GroupKey(std::vector<TKey> &row);
+  bool Add(std::vector<TKey> &row, bool spill);
+  void Build();
+  void Emit(Group &group, std::vector<TKey> &row);
+
+public:
+  HashAggregate(Operator *child, std::vector<int> groups,
+                std::vector<AggregateSpec> aggs,
+                std::vector<std::string> agg_names);
+  ~HashAggregate();
+  bool Next(std::vector<TKey> &row);
+
+  // For aggregating on several threads: Partial folds the rows of the
+  // child into the table without spilling, false as soon as the table
+  // outgrows memory. Merge adds the groups of another partial aggregate
+  // of the same shape, and Finish makes Next emit the merged groups.
+  bool Partial(long long memory);
+  void Merge(HashAggregate *other);
+  void Finish();
+};
+
+// COUNT(*) of a whole table, summed from the record counts in the page
+// directory instead of reading the records.
+class RecordCount : public Operator {
+private:
+  RecordManager rm_;
+  Table *tbl_;
+  bool done_;
+
+public:
+  RecordCount(RecordManager rm, Table *tbl, std::string name);
+  bool Next(std::vector<TKey> &row);
+};
+
+// MIN and MAX of the key of a B+ tree index, read from the first entry of
+// its leftmost leaf and the last entry of its rightmost leaf. Zero for an
+// empty index.
+class IndexMinMax : public Operator {
+private:
+  RecordManager rm_;
+  Index *idx_;
+  bool done_;
+
+public:
+  IndexMinMax(RecordManager rm, Index *idx, std::string min_name,
+              std::string max_name);
+  bool Next(std::vector<TKey> &row);
+};
+
+#endif /* HackyDb_AGGREGATES_H_ */
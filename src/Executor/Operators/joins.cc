@@ -0,0 +1,236 @@
+#include "joins.h"
+
+#include <cstring>
+
+#include "../../managers/Index_manager/index_manager.h"
+
+using namespace std;
+
+static void Concat(std::vector<TKey> &row, std::vector<TKey> &left,
+                   std::vector<TKey> &right) {
+  row = left;
+  row.insert(row.end(), right.begin(), right.end());
+}
+
+IndexNestedLoopJoin::IndexNestedLoopJoin(Operator *left, RecordManager rm,
+                                         Table *tbl, Index *idx,
+                                         int left_key, std::vector<int> cols,
+                                         std::vector<Condition> conds,
+                                         bool concurrent)
+    : left_(left), rm_(rm), tbl_(tbl), idx_(idx), left_key_(left_key),
+      cols_(cols), conds_(conds), index_only_(true) {
+  names_ = left_->names();
+  for (int i = 0; i < cols_.size(); ++i) {
+    string name = tbl_->ats()[cols_[i]].attr_name();
+    names_.push_back(tbl_->tb_name() + "." + name);
+    if (!idx_->Covers(name)) {
+      index_only_ = false;
+    }
+  }
+  for (int i = 0; i < conds_.size(); ++i) {
+    if (!idx_->Covers(tbl_->ats()[conds_[i].col].attr_name())) {
+      index_only_ = false;
+    }
+  }
+
+  index_ = IndexMethod::Open(idx_, rm_.hdl(), rm_.cm(), rm_.db_name(),
+                            concurrent);
+  record_.assign(tbl_->record_length(), 0);
+  payload_.assign(idx_->include_len(), 0);
+}
+
+IndexNestedLoopJoin::~IndexNestedLoopJoin() {
+  delete index_;
+  delete left_;
+}
+
+bool IndexNestedLoopJoin::Next(std::vector<TKey> &row) {
+  while (left_->Next(input_)) {
+    TKey key(idx_->key_type(), idx_->key_len());
+    string value = KeyBytes(input_[left_key_]);
+    if (value.size() > key.length()) {
+      continue; // longer than any value of the column
+    }
+    memset(key.key(), 0, key.length());
+    memcpy(key.key(), value.data(), value.size());
+
+    long long rid = index_->GetVal(key, &payload_[0]);
+    if (rid == -1) {
+      continue;
+    }
+    if (index_only_) {
+      rm_.GetIndexedRecord(tbl_, idx_, key, payload_.data(), &record_[0]);
+    } else {
+      // pinned, or a probe on another thread could recycle the block
+      BlockInfo *bp = rm_.hdl()->PinFileBlock(rm_.db_name(), tbl_->tb_name(),
+                                              0, RidBlockNum(rid));
+      rm_.DecodeRecord(tbl_, bp->GetRecord(RidOffset(rid)), &record_[0]);
+      rm_.hdl()->UnpinBlock(bp);
+    }
+    if (!rm_.SatisfyConditions(tbl_, record_.data(), conds_)) {
+      continue;
+    }
+
+    row = input_;
+    for (int i = 0; i < cols_.size(); ++i) {
+      row.push_back(rm_.GetColumn(tbl_, record_.data(), cols_[i]));
+    }
+    return true;
+  }
+  return false;
+}
+
+MergeJoin::MergeJoin(Operator *left, Operator *right, int left_key,
+                     int right_key)
+    : left_(left), right_(right), left_key_(left_key), right_key_(right_key),
+      has_input_(false), group_idx_(0) {
+  names_ = left_->names();
+  names_.insert(names_.end(), right_->names().begin(), right_->names().end());
+  has_lookahead_ = right_->Next(lookahead_);
+}
+
+bool MergeJoin::Next(std::vector<TKey> &row) {
+  while (true) {
+    if (has_input_ && group_idx_ < group_.size()) {
+      Concat(row, input_, group_[group_idx_++]);
+      return true;
+    }
+
+    has_input_ = left_->Next(input_);
+    if (!has_input_) {
+      return false;
+    }
+    group_idx_ = 0;
+    if (!group_.empty() &&
+        CompareKeys(input_[left_key_], group_[0][right_key_]) == 0) {
+      continue; // same key as the last left row
+    }
+
+    group_.clear();
+    while (has_lookahead_ &&
+           CompareKeys(lookahead_[right_key_], input_[left_key_]) < 0) {
+      has_lookahead_ = right_->Next(lookahead_);
+    }
+    while (has_lookahead_ &&
+           CompareKeys(lookahead_[right_key_], input_[left_key_]) == 0) {
+      group_.push_back(lookahead_);
+      has_lookahead_ = right_->Next(lookahead_);
+    }
+  }
+}
+
+HashJoin::HashJoin(Operator *left, Operator *right, int left_key,
+                   int right_key)
+    : left_(left), right_(right), left_key_(left_key), right_key_(right_key),
+      built_(false), table_bytes_(0), spilled_(false), can_spill_(true),
+      partition_(0) {
+  names_ = left_->names();
+  names_.insert(names_.end(), right_->names().begin(), right_->names().end());
+  for (int i = 0; i < HASH_JOIN_PARTITIONS; ++i) {
+    build_files_[i] = NULL;
+    probe_files_[i] = NULL;
+  }
+  matches_ = make_pair(table_.end(), table_.end());
+}
+
+HashJoin::~HashJoin() {
+  for (int i = 0; i < HASH_JOIN_PARTITIONS; ++i) {
+    delete build_files_[i];
+    delete probe_files_[i];
+  }
+  delete left_;
+  delete right_;
+}
+
+void HashJoin::Build() {
+  vector<TKey> row;
+  while (right_->Next(row)) {
+    string key = KeyBytes(row[right_key_]);
+    if (spilled_) {
+      build_files_[Partition(key, HASH_JOIN_PARTITIONS)]->Write(row);
+      continue;
+    }
+    table_bytes_ += RowBytes(row);
+    table_.insert(make_pair(key, row));
+    if (table_bytes_ > HASH_JOIN_MEMORY && can_spill_) {
+      Spill();
+    }
+  }
+  built_ = true;
+
+  if (!spilled_) {
+    return;
+  }
+  while (left_->Next(row)) {
+    string key = KeyBytes(row[left_key_]);
+    probe_files_[Partition(key, HASH_JOIN_PARTITIONS)]->Write(row);
+  }
+  LoadPartition(0);
+}
+
+// Moves the hash table into the build partitions. It is tried once; without
+// temporary files the join keeps going in memory.
+void HashJoin::Spill() {
+  can_spill_ = false;
+  for (int i = 0; i < HASH_JOIN_PARTITIONS; ++i) {
+    build_files_[i] = new SpillFile();
+    probe_files_[i] = new SpillFile();
+    if (!build_files_[i]->ok() || !probe_files_[i]->ok()) {
+      return;
+    }
+  }
+  spilled_ = true;
+
+  for (HashTable::iterator it = table_.begin(); it != table_.end(); ++it) {
+    build_files_[Partition(it->first, HASH_JOIN_PARTITIONS)]->Write(
+        it->second);
+  }
+  table_.clear();
+  table_bytes_ = 0;
+}
+
+// A partition is loaded whole even if skewed keys make it larger than
+// HASH_JOIN_MEMORY.
+void HashJoin::LoadPartition(int partition) {
+  table_.clear();
+  matches_ = make_pair(table_.end(), table_.end());
+
+  vector<TKey> row;
+  build_files_[partition]->Rewind();
+  while (build_files_[partition]->Read(row)) {
+    table_.insert(make_pair(KeyBytes(row[right_key_]), row));
+  }
+  probe_files_[partition]->Rewind();
+}
+
+bool HashJoin::NextInput() {
+  if (!spilled_) {
+    return !table_.empty() && left_->Next(input_);
+  }
+  while (partition_ < HASH_JOIN_PARTITIONS) {
+    if (probe_files_[partition_]->Read(input_)) {
+      return true;
+    }
+    if (++partition_ < HASH_JOIN_PARTITIONS) {
+      LoadPartition(partition_);
+    }
+  }
+  return false;
+}
+
+bool HashJoin::Next(std::vector<TKey> &row) {
+  if (!built_) {
+    Build();
+  }
+  while (true) {
+    if (matches_.first != matches_.second) {
+      Concat(row, input_, matches_.first->second);
+      ++matches_.first;
+      return true;
+    }
+    if (!NextInput()) {
+      return false;
+    }
+    matches_ = table_.equal_range(KeyBytes(input_[left_key_]));
+  }
+}
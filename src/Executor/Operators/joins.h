@@ -0,0 +1,110 @@
+#ifndef HackyDb_JOINS_H_
+#define HackyDb_JOINS_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "operators.h"
+
+class IndexMethod;
+
+// Equi-joins. Every join emits the left row followed by the right row, and
+// matches column left_key of the left input with column right_key of the
+// right one.
+
+// Probes an index of the right table with the key of each left row, so
+// the right table is never scanned. Keeps the order of the left input.
+// A concurrent join opens the index in concurrent mode, so joins on other
+// threads may probe it at the same time.
+class IndexNestedLoopJoin : public Operator {
+private:
+  Operator *left_;
+  RecordManager rm_;
+  Table *tbl_;
+  Index *idx_;
+  IndexMethod *index_;
+  int left_key_;
+  std::vector<int> cols_;
+  std::vector<Condition> conds_;
+  bool index_only_;
+
+  std::string record_;
+  std::string payload_;
+  std::vector<TKey> input_;
+
+public:
+  IndexNestedLoopJoin(Operator *left, RecordManager rm, Table *tbl,
+                      Index *idx, int left_key, std::vector<int> cols,
+                      std::vector<Condition> conds, bool concurrent = false);
+  ~IndexNestedLoopJoin();
+  bool Next(std::vector<TKey> &row);
+};
+
+// Joins two inputs that are both sorted on their keys in one pass over
+// each. Right rows with equal keys are buffered so that duplicate keys on
+// both sides produce every pair. Keeps the order of the left input.
+class MergeJoin : public Operator {
+private:
+  Operator *left_;
+  Operator *right_;
+  int left_key_;
+  int right_key_;
+
+  std::vector<TKey> input_;
+  bool has_input_;
+  std::vector<TKey> lookahead_;
+  bool has_lookahead_;
+  std::vector<std::vector<TKey> > group_; // right rows matching input_
+  int group_idx_;
+
+public:
+  MergeJoin(Operator *left, Operator *right, int left_key, int right_key);
+  ~MergeJoin() {
+    delete left_;
+    delete right_;
+  }
+  bool Next(std::vector<TKey> &row);
+};
+
+#define HASH_JOIN_MEMORY (16 << 20)
+#define HASH_JOIN_PARTITIONS 32
+
+// Builds a hash table on the right input and streams the left input past
+// it. When the table outgrows HASH_JOIN_MEMORY both inputs are hash
+// partitioned into temporary files, and the partitions are joined one pair
+// at a time (Grace hash join). Partitioned output is not in left order.
+class HashJoin : public Operator {
+private:
+  typedef std::unordered_multimap<std::string, std::vector<TKey> > HashTable;
+
+  Operator *left_;
+  Operator *right_;
+  int left_key_;
+  int right_key_;
+
+  bool built_;
+  HashTable table_;
+  long long table_bytes_;
+
+  bool spilled_;
+  bool can_spill_;
+  SpillFile *build_files_[HASH_JOIN_PARTITIONS];
+  SpillFile *probe_files_[HASH_JOIN_PARTITIONS];
+  int partition_;
+
+  std::vector<TKey> input_;
+  std::pair<HashTable::iterator, HashTable::iterator> matches_;
+
+  void Build();
+  void Spill();
+  void LoadPartition(int partition);
+  bool NextInput();
+
+public:
+  HashJoin(Operator *left, Operator *right, int left_key, int right_key);
+  ~HashJoin();
+  bool Next(std::vector<TKey> &row);
+};
+
+#endif /* HackyDb_JOINS_H_ */
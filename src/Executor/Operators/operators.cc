@@ -0,0 +1,341 @@
+#include "operators.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "../../managers/Index_manager/index_manager.h"
+
+using namespace std;
+
+std::string KeyBytes(TKey &key) {
+  if (key.key_type() == T_CHAR) {
+    return string(key.key(), strnlen(key.key(), key.length()));
+  }
+  if (key.key_type() == T_FLOAT) {
+    float value;
+    memcpy(&value, key.key(), sizeof(value));
+    if (value == 0) {
+      value = 0;
+    }
+    return string((char *)&value, sizeof(value));
+  }
+  return string(key.key(), key.length());
+}
+
+int CompareKeys(TKey &a, TKey &b) {
+  switch (a.key_type()) {
+  case T_INT: {
+    int x, y;
+    memcpy(&x, a.key(), sizeof(x));
+    memcpy(&y, b.key(), sizeof(y));
+    return x < y ? -1 : x > y;
+  }
+  case T_FLOAT: {
+    float x, y;
+    memcpy(&x, a.key(), sizeof(x));
+    memcpy(&y, b.key(), sizeof(y));
+    return x < y ? -1 : x > y;
+  }
+  default: {
+    // as KeyBytes(a).compare(KeyBytes(b)), without building the strings
+    int x = strnlen(a.key(), a.length());
+    int y = strnlen(b.key(), b.length());
+    int order = memcmp(a.key(), b.key(), min(x, y));
+    if (order != 0) {
+      return order < 0 ? -1 : 1;
+    }
+    return x < y ? -1 : x > y;
+  }
+  }
+}
+
+// FNV-1a
+int Partition(const std::string &key, int partitions) {
+  unsigned int hash = 2166136261u;
+  for (int i = 0; i < key.size(); ++i) {
+    hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+  }
+  return hash % partitions;
+}
+
+long long RowBytes(std::vector<TKey> &row) {
+  long long bytes = 64;
+  for (int i = 0; i < row.size(); ++i) {
+    bytes += sizeof(TKey) + row[i].length() + 16;
+  }
+  return bytes;
+}
+
+bool UniqueMatch(Table *tbl, std::vector<Condition> &conds) {
+  for (int i = 0; i < conds.size(); ++i) {
+    if (conds[i].sign_type == SIGN_EQ &&
+        tbl->ats()[conds[i].col].attr_type() == 1) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SpillFile::Write(std::vector<TKey> &row) {
+  if (types_.empty()) {
+    for (int i = 0; i < row.size(); ++i) {
+      types_.push_back(row[i].key_type());
+      lengths_.push_back(row[i].length());
+    }
+  }
+  for (int i = 0; i < row.size(); ++i) {
+    fwrite(row[i].key(), 1, row[i].length(), file_);
+  }
+}
+
+bool SpillFile::Read(std::vector<TKey> &row) {
+  row.clear();
+  for (int i = 0; i < types_.size(); ++i) {
+    TKey key(types_[i], lengths_[i]);
+    if (fread(key.key(), 1, key.length(), file_) != key.length()) {
+      return false;
+    }
+    row.push_back(key);
+  }
+  return !types_.empty();
+}
+
+SeqScan::SeqScan(RecordManager rm, Table *tbl, std::vector<int> cols,
+                 std::vector<Condition> conds)
+    : rm_(rm), tbl_(tbl), cols_(cols), conds_(conds),
+      unique_(UniqueMatch(tbl, conds)), block_(NULL), block_num_(-1),
+      read_ahead_(0), record_idx_(0), rid_(-1) {
+  for (int i = 0; i < cols_.size(); ++i) {
+    names_.push_back(tbl_->ats()[cols_[i]].attr_name());
+  }
+  record_.assign(tbl_->record_length(), 0);
+}
+
+SeqScan::~SeqScan() { Release(); }
+
+void SeqScan::Release() {
+  if (block_ != NULL) {
+    rm_.hdl()->UnpinBlock(block_);
+    block_ = NULL;
+  }
+}
+
+bool SeqScan::Next(std::vector<TKey> &row) {
+  while (true) {
+    if (block_ == NULL || record_idx_ == block_->GetRecordCount()) {
+      Release();
+      int count = tbl_->block_count();
+      do {
+        ++block_num_;
+      } while (block_num_ < count &&
+               rm_.CanSkipBlock(tbl_, block_num_, conds_));
+      if (block_num_ >= count) {
+        return false;
+      }
+      if (block_num_ >= read_ahead_) {
+        // the run read ahead ends before the next block to skip
+        int last = min(block_num_ + READ_AHEAD_BLOCKS, count);
+        read_ahead_ = block_num_ + 1;
+        while (read_ahead_ < last &&
+               !rm_.CanSkipBlock(tbl_, read_ahead_, conds_)) {
+          ++read_ahead_;
+        }
+        rm_.hdl()->ReadAhead(rm_.db_name(), tbl_->tb_name(), 0, block_num_,
+                             read_ahead_ - block_num_);
+      }
+      block_ = rm_.hdl()->PinFileBlock(rm_.db_name(), tbl_->tb_name(), 0,
+                                       block_num_);
+      record_idx_ = 0;
+      continue;
+    }
+
+    if (block_->IsFreeSlot(record_idx_)) {
+      ++record_idx_;
+      continue;
+    }
+    const char *record = rm_.RecordAt(tbl_, block_, record_idx_, &record_[0]);
+    int offset = record_idx_++;
+    if (!rm_.SatisfyConditions(tbl_, record, conds_)) {
+      continue;
+    }
+
+    row.clear();
+    for (int i = 0; i < cols_.size(); ++i) {
+      row.push_back(rm_.GetColumn(tbl_, record, cols_[i]));
+    }
+    rid_ = MakeRid(block_->block_num(), offset);
+    if (unique_) {
+      Release();
+      block_num_ = tbl_->block_count();
+    }
+    return true;
+  }
+}
+
+IndexScan::IndexScan(RecordManager rm, Table *tbl, Index *idx, TKey &key,
+                     std::vector<int> cols, std::vector<Condition> conds)
+    : rm_(rm), tbl_(tbl), cols_(cols), conds_(conds), done_(false),
+      rid_(-1) {
+  for (int i = 0; i < cols_.size(); ++i) {
+    names_.push_back(tbl_->ats()[cols_[i]].attr_name());
+  }
+
+  bool index_only = true;
+  for (int i = 0; i < cols_.size(); ++i) {
+    if (!idx->Covers(tbl_->ats()[cols_[i]].attr_name())) {
+      index_only = false;
+    }
+  }
+  for (int i = 0; i < conds_.size(); ++i) {
+    if (!idx->Covers(tbl_->ats()[conds_[i].col].attr_name())) {
+      index_only = false;
+    }
+  }
+
+  IndexMethod *tree = IndexMethod::Open(idx, rm_.hdl(), rm_.cm(),
+                                        rm_.db_name());
+  string payload(idx->include_len(), 0);
+  rid_ = tree->GetVal(key, &payload[0]);
+  delete tree;
+
+  // the row is copied out so no block stays pinned
+  if (rid_ == -1) {
+    done_ = true;
+  } else if (index_only) {
+    record_.assign(tbl_->record_length(), 0);
+    rm_.GetIndexedRecord(tbl_, idx, key, payload.data(), &record_[0]);
+  } else {
+    BlockInfo *bp = rm_.GetBlockInfo(tbl_, RidBlockNum(rid_));
+    record_.assign(tbl_->record_length(), 0);
+    rm_.DecodeRecord(tbl_, bp->GetRecord(RidOffset(rid_)), &record_[0]);
+  }
+}
+
+bool IndexScan::Next(std::vector<TKey> &row) {
+  if (done_) {
+    return false;
+  }
+  done_ = true;
+  if (!rm_.SatisfyConditions(tbl_, record_.data(), conds_)) {
+    return false;
+  }
+
+  row.clear();
+  for (int i = 0; i < cols_.size(); ++i) {
+    row.push_back(rm_.GetColumn(tbl_, record_.data(), cols_[i]));
+  }
+  return true;
+}
+
+IndexOrderScan::IndexOrderScan(RecordManager rm, Table *tbl, Index *idx,
+                               std::vector<int> cols,
+                               std::vector<Condition> conds)
+    : rm_(rm), tbl_(tbl), idx_(idx), cols_(cols), conds_(conds),
+      index_only_(true), leaf_(NULL), entry_(0), rid_(-1) {
+  for (int i = 0; i < cols_.size(); ++i) {
+    names_.push_back(tbl_->ats()[cols_[i]].attr_name());
+    if (!idx_->Covers(names_[i])) {
+      index_only_ = false;
+    }
+  }
+  for (int i = 0; i < conds_.size(); ++i) {
+    if (!idx_->Covers(tbl_->ats()[conds_[i].col].attr_name())) {
+      index_only_ = false;
+    }
+  }
+  record_.assign(tbl_->record_length(), 0);
+
+  // the greatest lower bound on the key, if any, is where the walk starts
+  int key_col = tbl_->GetAttributeIndex(idx_->attr_name());
+  int lower = -1;
+  for (int i = 0; i < conds_.size(); ++i) {
+    int sign = conds_[i].sign_type;
+    if (conds_[i].col != key_col) {
+      continue;
+    }
+    if (sign == SIGN_EQ || sign == SIGN_LT || sign == SIGN_LE) {
+      upper_.push_back(conds_[i]);
+    }
+    if ((sign == SIGN_EQ || sign == SIGN_GT || sign == SIGN_GE) &&
+        (lower == -1 ||
+         CompareKeys(conds_[i].operand, conds_[lower].operand) > 0)) {
+      lower = i;
+    }
+  }
+
+  tree_ = new BPlusTree(idx_, rm_.hdl(), rm_.cm(), rm_.db_name());
+  if (lower != -1 && idx_->root() != -1) {
+    FindNodeParam fnp = tree_->Search(idx_->root(), conds_[lower].operand);
+    leaf_ = fnp.pnode;
+    entry_ = fnp.index;
+  } else {
+    int first = tree_->FirstLeaf();
+    if (first != -1) {
+      leaf_ = tree_->GetNode(first);
+    }
+  }
+}
+
+IndexOrderScan::~IndexOrderScan() {
+  delete leaf_;
+  delete tree_;
+}
+
+bool IndexOrderScan::Next(std::vector<TKey> &row) {
+  while (leaf_ != NULL) {
+    if (entry_ == leaf_->GetCount()) {
+      int next = leaf_->GetNextLeaf();
+      delete leaf_;
+      leaf_ = next == -1 ? NULL : tree_->GetNode(next);
+      entry_ = 0;
+      continue;
+    }
+
+    TKey key = leaf_->GetKeys(entry_);
+    for (int i = 0; i < upper_.size(); ++i) {
+      if (!rm_.Compare(key, upper_[i].sign_type, upper_[i].operand)) {
+        delete leaf_;
+        leaf_ = NULL;
+        return false;
+      }
+    }
+
+    rid_ = leaf_->GetValues(entry_);
+    if (index_only_) {
+      rm_.GetIndexedRecord(tbl_, idx_, key, leaf_->GetPayload(entry_),
+                           &record_[0]);
+    } else {
+      BlockInfo *bp = rm_.GetBlockInfo(tbl_, RidBlockNum(rid_));
+      rm_.DecodeRecord(tbl_, bp->GetRecord(RidOffset(rid_)), &record_[0]);
+    }
+    ++entry_;
+    if (!rm_.SatisfyConditions(tbl_, record_.data(), conds_)) {
+      continue;
+    }
+
+    row.clear();
+    for (int i = 0; i < cols_.size(); ++i) {
+      row.push_back(rm_.GetColumn(tbl_, record_.data(), cols_[i]));
+    }
+    return true;
+  }
+  return false;
+}
+
+Project::Project(Operator *child, std::vector<int> map)
+    : child_(child), map_(map) {
+  for (int i = 0; i < map_.size(); ++i) {
+    names_.push_back(child_->names()[map_[i]]);
+  }
+}
+
+bool Project::Next(std::vector<TKey> &row) {
+  if (!child_->Next(input_)) {
+    return false;
+  }
+  row.clear();
+  for (int i = 0; i < map_.size(); ++i) {
+    row.push_back(input_[map_[i]]);
+  }
+  return true;
+}
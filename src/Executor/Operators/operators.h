@@ -0,0 +1,163 @@
+#ifndef HackyDb_OPERATORS_H_
+#define HackyDb_OPERATORS_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../../managers/Record_manager/record_manager.h"
+
+// Bytes that identify a key for hashing and equality. CHAR values end at
+// their terminator so columns of different lengths still match, and -0.0
+// is folded into 0.0.
+std::string KeyBytes(TKey &key);
+// Orders two keys of the same type: negative, zero or positive.
+int CompareKeys(TKey &a, TKey &b);
+// Spreads keys over partitions with a different hash than std::hash, so
+// the keys of one partition still spread over an in-memory hash table.
+int Partition(const std::string &key, int partitions);
+// Rough memory held by a decoded row.
+long long RowBytes(std::vector<TKey> &row);
+// Whether at most one record of tbl can pass conds: an equality on the
+// primary key.
+bool UniqueMatch(Table *tbl, std::vector<Condition> &conds);
+
+// Rows written to a temporary file and read back in order. The rows of a
+// file all have the column types of the first row written.
+class SpillFile {
+private:
+  std::FILE *file_;
+  std::vector<int> types_;
+  std::vector<int> lengths_;
+
+public:
+  SpillFile() : file_(std::tmpfile()) {}
+  ~SpillFile() {
+    if (file_ != NULL) {
+      std::fclose(file_);
+    }
+  }
+  bool ok() { return file_ != NULL; }
+  void Write(std::vector<TKey> &row);
+  void Rewind() { std::rewind(file_); }
+  bool Read(std::vector<TKey> &row);
+};
+
+// A physical operator. Rows are pulled one at a time with Next(), and an
+// operator owns its children and deletes them with itself.
+// There is no Filter operator: every WHERE predicate compares one column
+// with a constant, so each is tested by the scan of its table, on the raw
+// record and before any column is decoded.
+class Operator {
+protected:
+  std::vector<std::string> names_; // output columns
+
+public:
+  virtual ~Operator() {}
+
+  std::vector<std::string> &names() { return names_; }
+  // Fills row with the next output row; false when exhausted.
+  virtual bool Next(std::vector<TKey> &row) = 0;
+  // The record the last row was read from, or -1 if it is not a record.
+  virtual long long rid() { return -1; }
+};
+
+// Reads every record of a table. Conditions are tested on the raw record
+// and only the requested columns of matching records are decoded. The
+// block under the scan stays pinned until the scan moves past it. Blocks
+// are visited in file order, read READ_AHEAD_BLOCKS at a time, and the
+// empty ones are skipped, as are those whose zone map or Bloom filters
+// show no record in them can match. With an equality on the primary key
+// the scan stops at the first match.
+class SeqScan : public Operator {
+private:
+  RecordManager rm_;
+  Table *tbl_;
+  std::vector<int> cols_;
+  std::vector<Condition> conds_;
+  bool unique_; // at most one record matches
+
+  BlockInfo *block_;
+  int block_num_;
+  int read_ahead_; // blocks before it were requested from the disk
+  int record_idx_;
+  std::string record_; // the decoded record, if it has VARCHAR columns
+  long long rid_;
+
+  void Release();
+
+public:
+  SeqScan(RecordManager rm, Table *tbl, std::vector<int> cols,
+          std::vector<Condition> conds);
+  ~SeqScan();
+  bool Next(std::vector<TKey> &row);
+  long long rid() { return rid_; }
+};
+
+// Looks one key up in an index. The record is not read when the index
+// covers every column the scan decodes or tests.
+class IndexScan : public Operator {
+private:
+  RecordManager rm_;
+  Table *tbl_;
+  std::vector<int> cols_;
+  std::vector<Condition> conds_;
+
+  std::string record_;
+  bool done_;
+  long long rid_;
+
+public:
+  IndexScan(RecordManager rm, Table *tbl, Index *idx, TKey &key,
+            std::vector<int> cols, std::vector<Condition> conds);
+  bool Next(std::vector<TKey> &row);
+  long long rid() { return rid_; }
+};
+
+class BPlusTree;
+class BPlusTreeNode;
+
+// Walks the leaves of a B+ tree index, so rows come out in ascending key
+// order. Like IndexScan it skips the record when the index covers it.
+// Conditions on the key bound the walk: it starts at the first key they
+// let through and stops at the first key past them.
+class IndexOrderScan : public Operator {
+private:
+  RecordManager rm_;
+  Table *tbl_;
+  Index *idx_;
+  std::vector<int> cols_;
+  std::vector<Condition> conds_;
+  bool index_only_;
+  std::vector<Condition> upper_; // the conditions that end the walk
+
+  BPlusTree *tree_;
+  BPlusTreeNode *leaf_;
+  int entry_;
+  std::string record_;
+  long long rid_;
+
+public:
+  IndexOrderScan(RecordManager rm, Table *tbl, Index *idx,
+                 std::vector<int> cols, std::vector<Condition> conds);
+  ~IndexOrderScan();
+  bool Next(std::vector<TKey> &row);
+  long long rid() { return rid_; }
+};
+
+// Picks and reorders columns of its child: column i of the output is
+// column map[i] of the child.
+class Project : public Operator {
+private:
+  Operator *child_;
+  std::vector<int> map_;
+  std::vector<TKey> input_;
+
+public:
+  Project(Operator *child, std::vector<int> map);
+  ~Project() { delete child_; }
+  bool Next(std::vector<TKey> &row);
+  long long rid() { return child_->rid(); }
+};
+
+#endif /* HackyDb_OPERATORS_H_ */
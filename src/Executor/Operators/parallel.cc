@@ -0,0 +1,271 @@
+#include "parallel.h"
+
+#include <algorithm>
+
+#include "../../managers/Index_manager/index_manager.h"
+
+using namespace std;
+
+int ScanThreads(int blocks) {
+  if (blocks < PARALLEL_MIN_BLOCKS) {
+    return 1;
+  }
+  int threads = thread::hardware_concurrency();
+  threads = min(threads, PARALLEL_MAX_THREADS);
+  threads = min(threads, (blocks + MORSEL_BLOCKS - 1) / MORSEL_BLOCKS);
+  return max(threads, 1);
+}
+
+bool MorselSource::Take(int &first, int &last) {
+  first = next_.fetch_add(MORSEL_BLOCKS);
+  if (first >= blocks_) {
+    return false;
+  }
+  last = min(first + MORSEL_BLOCKS, blocks_);
+  return true;
+}
+
+MorselScan::MorselScan(RecordManager rm, Table *tbl, std::vector<int> cols,
+                       std::vector<Condition> conds, MorselSource *source)
+    : rm_(rm), tbl_(tbl), cols_(cols), conds_(conds),
+      unique_(UniqueMatch(tbl, conds)), source_(source), block_(NULL),
+      block_num_(0), last_(0), record_idx_(0), rid_(-1) {
+  for (int i = 0; i < cols_.size(); ++i) {
+    names_.push_back(tbl_->ats()[cols_[i]].attr_name());
+  }
+  record_.assign(tbl_->record_length(), 0);
+}
+
+void MorselScan::Release() {
+  if (block_ != NULL) {
+    rm_.hdl()->UnpinBlock(block_);
+    block_ = NULL;
+  }
+}
+
+bool MorselScan::Next(std::vector<TKey> &row) {
+  while (true) {
+    if (block_ == NULL || record_idx_ == block_->GetRecordCount()) {
+      Release();
+      if (block_num_ == last_) {
+        if (!source_->Take(block_num_, last_)) {
+          return false;
+        }
+        // the morsel is read from its first to its last block not skipped
+        int first = block_num_, last = last_;
+        while (first < last && rm_.CanSkipBlock(tbl_, first, conds_)) {
+          ++first;
+        }
+        while (last > first && rm_.CanSkipBlock(tbl_, last - 1, conds_)) {
+          --last;
+        }
+        if (first < last) {
+          rm_.hdl()->ReadAhead(rm_.db_name(), tbl_->tb_name(), 0, first,
+                               last - first);
+        }
+        block_num_ = first;
+        if (block_num_ == last_) {
+          continue;
+        }
+      }
+      if (rm_.CanSkipBlock(tbl_, block_num_, conds_)) {
+        ++block_num_;
+        continue;
+      }
+      block_ = rm_.hdl()->PinFileBlock(rm_.db_name(), tbl_->tb_name(), 0,
+                                       block_num_++);
+      record_idx_ = 0;
+      continue;
+    }
+
+    if (block_->IsFreeSlot(record_idx_)) {
+      ++record_idx_;
+      continue;
+    }
+    const char *record = rm_.RecordAt(tbl_, block_, record_idx_, &record_[0]);
+    int offset = record_idx_++;
+    if (!rm_.SatisfyConditions(tbl_, record, conds_)) {
+      continue;
+    }
+
+    row.clear();
+    for (int i = 0; i < cols_.size(); ++i) {
+      row.push_back(rm_.GetColumn(tbl_, record, cols_[i]));
+    }
+    rid_ = MakeRid(block_->block_num(), offset);
+    if (unique_) {
+      // no other thread can find a match either
+      source_->Stop();
+      block_num_ = last_;
+      Release();
+    }
+    return true;
+  }
+}
+
+ParallelScan::ParallelScan(RecordManager rm, Table *tbl,
+                           std::vector<int> cols,
+                           std::vector<Condition> conds, int threads)
+    : rm_(rm), source_(tbl->block_count()), running_(0), stop_(false),
+      next_row_(0), rid_(-1) {
+  for (int i = 0; i < threads; ++i) {
+    scans_.push_back(new MorselScan(rm, tbl, cols, conds, &source_));
+  }
+  names_ = scans_[0]->names();
+}
+
+ParallelScan::~ParallelScan() {
+  {
+    lock_guard<mutex> guard(mutex_);
+    stop_ = true;
+  }
+  source_.Stop();
+  room_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+  for (int i = 0; i < scans_.size(); ++i) {
+    delete scans_[i];
+  }
+}
+
+void ParallelScan::Probe(Table *tbl, Index *idx, int left_key,
+                         std::vector<int> cols,
+                         std::vector<Condition> conds) {
+  for (int i = 0; i < scans_.size(); ++i) {
+    scans_[i] = new IndexNestedLoopJoin(scans_[i], rm_, tbl, idx, left_key,
+                                        cols, conds, true);
+  }
+  vector<string> &names = scans_[0]->names();
+  names_.insert(names_.end(), names.end() - cols.size(), names.end());
+}
+
+void ParallelScan::Run(Operator *scan) {
+  Batch batch;
+  vector<TKey> row;
+  bool more = true;
+  while (more) {
+    more = scan->Next(row);
+    if (more) {
+      batch.rows.push_back(row);
+      batch.rids.push_back(scan->rid());
+      if (batch.rows.size() < PARALLEL_BATCH_ROWS) {
+        continue;
+      }
+    }
+    if (batch.rows.empty()) {
+      continue;
+    }
+
+    unique_lock<mutex> lock(mutex_);
+    room_.wait(lock, [this] {
+      return stop_ || queue_.size() < PARALLEL_QUEUE_BATCHES;
+    });
+    if (stop_) {
+      break;
+    }
+    queue_.push_back(Batch());
+    queue_.back().rows.swap(batch.rows);
+    queue_.back().rids.swap(batch.rids);
+    ready_.notify_one();
+  }
+
+  lock_guard<mutex> guard(mutex_);
+  --running_;
+  ready_.notify_all();
+}
+
+bool ParallelScan::Next(std::vector<TKey> &row) {
+  if (threads_.empty()) {
+    running_ = scans_.size();
+    for (int i = 0; i < scans_.size(); ++i) {
+      threads_.push_back(thread(&ParallelScan::Run, this, scans_[i]));
+    }
+  }
+
+  while (next_row_ == batch_.rows.size()) {
+    unique_lock<mutex> lock(mutex_);
+    ready_.wait(lock, [this] { return !queue_.empty() || running_ == 0; });
+    if (queue_.empty()) {
+      return false;
+    }
+    batch_.rows.swap(queue_.front().rows);
+    batch_.rids.swap(queue_.front().rids);
+    queue_.pop_front();
+    next_row_ = 0;
+    room_.notify_one();
+  }
+
+  row.swap(batch_.rows[next_row_]);
+  rid_ = batch_.rids[next_row_];
+  ++next_row_;
+  return true;
+}
+
+ParallelAggregate::ParallelAggregate(RecordManager rm, Table *tbl,
+                                     std::vector<int> cols,
+                                     std::vector<Condition> conds,
+                                     std::vector<int> groups,
+                                     std::vector<AggregateSpec> aggs,
+                                     std::vector<std::string> agg_names,
+                                     int threads)
+    : rm_(rm), tbl_(tbl), cols_(cols), conds_(conds), groups_(groups),
+      aggs_(aggs), agg_names_(agg_names), threads_(threads),
+      source_(tbl->block_count()), result_(NULL) {
+  for (int i = 0; i < threads_; ++i) {
+    MorselScan *scan = new MorselScan(rm_, tbl_, cols_, conds_, &source_);
+    partials_.push_back(new HashAggregate(scan, groups_, aggs_, agg_names_));
+  }
+  names_ = partials_[0]->names();
+}
+
+ParallelAggregate::~ParallelAggregate() {
+  for (int i = 0; i < partials_.size(); ++i) {
+    delete partials_[i];
+  }
+  if (partials_.empty()) {
+    delete result_;
+  }
+}
+
+void ParallelAggregate::Build() {
+  long long memory = HASH_AGG_MEMORY / threads_;
+  atomic<bool> overflow(false);
+  vector<thread> threads;
+  for (int i = 0; i < partials_.size(); ++i) {
+    HashAggregate *partial = partials_[i];
+    threads.push_back(thread([this, partial, memory, &overflow] {
+      if (!partial->Partial(memory)) {
+        overflow = true;
+        source_.Stop();
+      }
+    }));
+  }
+  for (int i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+
+  if (!overflow) {
+    for (int i = 1; i < partials_.size(); ++i) {
+      partials_[0]->Merge(partials_[i]);
+    }
+    partials_[0]->Finish();
+    result_ = partials_[0];
+    return;
+  }
+
+  for (int i = 0; i < partials_.size(); ++i) {
+    delete partials_[i];
+  }
+  partials_.clear();
+  result_ = new HashAggregate(
+      new ParallelScan(rm_, tbl_, cols_, conds_, threads_), groups_, aggs_,
+      agg_names_);
+}
+
+bool ParallelAggregate::Next(std::vector<TKey> &row) {
+  if (result_ == NULL) {
+    Build();
+  }
+  return result_->Next(row);
+}
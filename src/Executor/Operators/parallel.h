@@ -0,0 +1,145 @@
+#ifndef HackyDb_PARALLEL_H_
+#define HackyDb_PARALLEL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "aggregates.h"
+#include "joins.h"
+
+#define MORSEL_BLOCKS 16
+#define PARALLEL_MIN_BLOCKS 64
+#define PARALLEL_MAX_THREADS 32
+#define PARALLEL_BATCH_ROWS 1024
+#define PARALLEL_QUEUE_BATCHES 64
+
+// Threads to scan a table of that many blocks with, 1 if it is too small
+// to be worth starting threads for.
+int ScanThreads(int blocks);
+
+// Hands out morsels, runs of MORSEL_BLOCKS consecutive blocks, to the
+// threads of a parallel scan. A thread takes the next morsel whenever it
+// is done with one, so the threads that finish early take on more.
+class MorselSource {
+private:
+  std::atomic<int> next_;
+  int blocks_;
+
+public:
+  MorselSource(int blocks) : next_(0), blocks_(blocks) {}
+  // The blocks [first, last) of the next morsel; false when none is left.
+  bool Take(int &first, int &last);
+  // Hands out no more morsels.
+  void Stop() { next_.store(blocks_); }
+};
+
+// The part of a parallel scan one thread runs: a SeqScan over the blocks
+// of the morsels it takes. Each morsel is read from the disk in one go and
+// its empty blocks are skipped, as are those its zone map rules out.
+class MorselScan : public Operator {
+private:
+  RecordManager rm_;
+  Table *tbl_;
+  std::vector<int> cols_;
+  std::vector<Condition> conds_;
+  bool unique_;
+  MorselSource *source_;
+
+  BlockInfo *block_;
+  int block_num_;
+  int last_;
+  int record_idx_;
+  std::string record_;
+  long long rid_;
+
+  void Release();
+
+public:
+  MorselScan(RecordManager rm, Table *tbl, std::vector<int> cols,
+             std::vector<Condition> conds, MorselSource *source);
+  ~MorselScan() { Release(); }
+  bool Next(std::vector<TKey> &row);
+  long long rid() { return rid_; }
+};
+
+// Scans a table on several threads, each a MorselScan of the same source.
+// The threads pass their rows in batches through a bounded queue, so rows
+// come out in no particular order. They start on the first Next() and are
+// stopped and joined when the scan is deleted.
+// Probe() joins the rows of each thread with another table before they are
+// queued: every thread runs an IndexNestedLoopJoin of its own, and they
+// all look their keys up in the same B+ tree in concurrent mode.
+class ParallelScan : public Operator {
+private:
+  typedef struct {
+    std::vector<std::vector<TKey> > rows;
+    std::vector<long long> rids;
+  } Batch;
+
+  RecordManager rm_;
+  MorselSource source_;
+  std::vector<Operator *> scans_; // the work of each thread
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable ready_; // a batch was queued or a thread ended
+  std::condition_variable room_;  // a batch was taken off the queue
+  std::deque<Batch> queue_;
+  int running_;
+  bool stop_;
+
+  Batch batch_;
+  int next_row_;
+  long long rid_;
+
+  void Run(Operator *scan);
+
+public:
+  ParallelScan(RecordManager rm, Table *tbl, std::vector<int> cols,
+               std::vector<Condition> conds, int threads);
+  ~ParallelScan();
+  // Call before the first Next(). The arguments are those of an
+  // IndexNestedLoopJoin on the rows scanned and probed so far.
+  void Probe(Table *tbl, Index *idx, int left_key, std::vector<int> cols,
+             std::vector<Condition> conds);
+  bool Next(std::vector<TKey> &row);
+  long long rid() { return rid_; }
+};
+
+// Scans and aggregates a table on several threads. Each thread folds the
+// rows of its morsels into a HashAggregate of its own, and the groups are
+// merged into the first one once all threads are done. If the groups of a
+// thread outgrow its share of HASH_AGG_MEMORY, the partial groups are
+// dropped and a single HashAggregate, which can spill, aggregates the
+// rows of a ParallelScan instead.
+class ParallelAggregate : public Operator {
+private:
+  RecordManager rm_;
+  Table *tbl_;
+  std::vector<int> cols_;
+  std::vector<Condition> conds_;
+  std::vector<int> groups_;
+  std::vector<AggregateSpec> aggs_;
+  std::vector<std::string> agg_names_;
+  int threads_;
+
+  MorselSource source_;
+  std::vector<HashAggregate *> partials_;
+  HashAggregate *result_;
+
+  void Build();
+
+public:
+  ParallelAggregate(RecordManager rm, Table *tbl, std::vector<int> cols,
+                    std::vector<Condition> conds, std::vector<int> groups,
+                    std::vector<AggregateSpec> aggs,
+                    std::vector<std::string> agg_names, int threads);
+  ~ParallelAggregate();
+  bool Next(std::vector<TKey> &row);
+};
+
+#endif /* HackyDb_PARALLEL_H_ */
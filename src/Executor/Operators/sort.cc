@@ -0,0 +1,192 @@
+#include "sort.h"
+
+#include <algorithm>
+
+using namespace std;
+
+int RowOrder::Compare(std::vector<TKey> &a, std::vector<TKey> &b) {
+  for (int i = 0; i < keys_.size(); ++i) {
+    int cmp = CompareKeys(a[keys_[i].col], b[keys_[i].col]);
+    if (cmp != 0) {
+      return keys_[i].desc ? -cmp : cmp;
+    }
+  }
+  return 0;
+}
+
+Sort::Sort(Operator *child, std::vector<SortKey> keys)
+    : child_(child), order_(keys), sorted_(false), can_spill_(true),
+      next_row_(0) {
+  names_ = child_->names();
+}
+
+Sort::~Sort() {
+  for (int i = 0; i < runs_.size(); ++i) {
+    delete runs_[i];
+  }
+  delete child_;
+}
+
+// Sorts the rows in memory into a new run. Once SORT_FAN_IN runs are open
+// they are merged into one, so the number of open files stays bounded.
+// The rows stay in memory if no temporary file can be created.
+void Sort::WriteRun() {
+  SpillFile *run = new SpillFile();
+  if (!run->ok()) {
+    delete run;
+    can_spill_ = false;
+    return;
+  }
+  sort(rows_.begin(), rows_.end(), order_);
+  for (int i = 0; i < rows_.size(); ++i) {
+    run->Write(rows_[i]);
+  }
+  run->Rewind();
+  rows_.clear();
+  runs_.push_back(run);
+
+  if (runs_.size() < SORT_FAN_IN) {
+    return;
+  }
+  SpillFile *merged = new SpillFile();
+  if (!merged->ok()) {
+    delete merged;
+    return;
+  }
+  vector<SpillFile *> runs = runs_;
+  vector<TKey> row;
+  StartMerge(runs);
+  while (Merge(row)) {
+    merged->Write(row);
+  }
+  merged->Rewind();
+  for (int i = 0; i < runs.size(); ++i) {
+    delete runs[i];
+  }
+  runs_.assign(1, merged);
+}
+
+// Reads the first row of every run, and of the rows still in memory,
+// which come after the runs.
+void Sort::StartMerge(std::vector<SpillFile *> &runs) {
+  runs_ = runs;
+  heads_.assign(runs_.size() + 1, vector<TKey>());
+  heap_.clear();
+  next_row_ = 0;
+  for (int i = 0; i < heads_.size(); ++i) {
+    bool read;
+    if (i < runs_.size()) {
+      read = runs_[i]->Read(heads_[i]);
+    } else if ((read = next_row_ < rows_.size())) {
+      heads_[i].swap(rows_[next_row_++]);
+    }
+    if (read) {
+      heap_.push_back(i);
+    }
+  }
+  make_heap(heap_.begin(), heap_.end(), [this](int a, int b) {
+    return order_.Compare(heads_[a], heads_[b]) > 0;
+  });
+}
+
+bool Sort::Merge(std::vector<TKey> &row) {
+  if (heap_.empty()) {
+    return false;
+  }
+  auto greater = [this](int a, int b) {
+    return order_.Compare(heads_[a], heads_[b]) > 0;
+  };
+  pop_heap(heap_.begin(), heap_.end(), greater);
+  int source = heap_.back();
+  row.swap(heads_[source]);
+
+  bool read;
+  if (source < runs_.size()) {
+    read = runs_[source]->Read(heads_[source]);
+  } else if ((read = next_row_ < rows_.size())) {
+    heads_[source].swap(rows_[next_row_++]);
+  }
+  if (read) {
+    push_heap(heap_.begin(), heap_.end(), greater);
+  } else {
+    heap_.pop_back();
+  }
+  return true;
+}
+
+void Sort::Build() {
+  sorted_ = true;
+  long long bytes = 0;
+  vector<TKey> row;
+  while (child_->Next(row)) {
+    bytes += RowBytes(row);
+    rows_.push_back(row);
+    if (bytes > SORT_MEMORY && can_spill_) {
+      WriteRun();
+      bytes = 0;
+    }
+  }
+
+  sort(rows_.begin(), rows_.end(), order_);
+  if (!runs_.empty()) {
+    vector<SpillFile *> runs = runs_;
+    StartMerge(runs);
+  }
+}
+
+bool Sort::Next(std::vector<TKey> &row) {
+  if (!sorted_) {
+    Build();
+  }
+  if (!runs_.empty()) {
+    return Merge(row);
+  }
+  if (next_row_ == rows_.size()) {
+    return false;
+  }
+  row.swap(rows_[next_row_++]);
+  return true;
+}
+
+TopN::TopN(Operator *child, std::vector<SortKey> keys, int limit)
+    : child_(child), order_(keys), limit_(limit), built_(false),
+      next_row_(0) {
+  names_ = child_->names();
+}
+
+bool TopN::Next(std::vector<TKey> &row) {
+  if (!built_) {
+    built_ = true;
+    // a max-heap, so the row to drop is on top
+    vector<TKey> input;
+    while (limit_ > 0 && child_->Next(input)) {
+      if (rows_.size() < limit_) {
+        rows_.push_back(input);
+        push_heap(rows_.begin(), rows_.end(), order_);
+      } else if (order_.Compare(input, rows_.front()) < 0) {
+        pop_heap(rows_.begin(), rows_.end(), order_);
+        rows_.back().swap(input);
+        push_heap(rows_.begin(), rows_.end(), order_);
+      }
+    }
+    sort_heap(rows_.begin(), rows_.end(), order_);
+  }
+  if (next_row_ == rows_.size()) {
+    return false;
+  }
+  row.swap(rows_[next_row_++]);
+  return true;
+}
+
+Limit::Limit(Operator *child, int limit)
+    : child_(child), limit_(limit), count_(0) {
+  names_ = child_->names();
+}
+
+bool Limit::Next(std::vector<TKey> &row) {
+  if (count_ == limit_ || !child_->Next(row)) {
+    return false;
+  }
+  ++count_;
+  return true;
+}
@@ -0,0 +1,93 @@
+#ifndef HackyDb_SORT_H_
+#define HackyDb_SORT_H_
+
+#include <vector>
+
+#include "operators.h"
+
+// One ORDER BY key: column col of the rows, descending or ascending.
+typedef struct {
+  int col;
+  bool desc;
+} SortKey;
+
+#define SORT_MEMORY (16 << 20)
+#define SORT_FAN_IN 64
+#define TOP_N_MAX_ROWS 65536
+
+// Orders rows on a list of sort keys.
+class RowOrder {
+private:
+  std::vector<SortKey> keys_;
+
+public:
+  RowOrder(std::vector<SortKey> keys) : keys_(keys) {}
+  int Compare(std::vector<TKey> &a, std::vector<TKey> &b);
+  bool operator()(std::vector<TKey> &a, std::vector<TKey> &b) {
+    return Compare(a, b) < 0;
+  }
+};
+
+// External merge sort. Rows are sorted in memory until they outgrow
+// SORT_MEMORY, then each sorted run is written to a temporary file and the
+// runs are merged, SORT_FAN_IN at a time, while the rows are pulled.
+class Sort : public Operator {
+private:
+  Operator *child_;
+  RowOrder order_;
+
+  bool sorted_;
+  bool can_spill_;
+  std::vector<std::vector<TKey> > rows_;
+  int next_row_;
+
+  // the final merge: the head row of each run, and a heap of run numbers
+  // with the smallest head on top
+  std::vector<SpillFile *> runs_;
+  std::vector<std::vector<TKey> > heads_;
+  std::vector<int> heap_;
+
+  void WriteRun();
+  void StartMerge(std::vector<SpillFile *> &runs);
+  bool Merge(std::vector<TKey> &row);
+  void Build();
+
+public:
+  Sort(Operator *child, std::vector<SortKey> keys);
+  ~Sort();
+  bool Next(std::vector<TKey> &row);
+};
+
+// ORDER BY ... LIMIT n for small n: keeps the first n rows seen so far in
+// a bounded heap instead of sorting the whole input.
+class TopN : public Operator {
+private:
+  Operator *child_;
+  RowOrder order_;
+  int limit_;
+
+  bool built_;
+  std::vector<std::vector<TKey> > rows_;
+  int next_row_;
+
+public:
+  TopN(Operator *child, std::vector<SortKey> keys, int limit);
+  ~TopN() { delete child_; }
+  bool Next(std::vector<TKey> &row);
+};
+
+// Emits the first limit rows of its child and stops pulling it.
+class Limit : public Operator {
+private:
+  Operator *child_;
+  int limit_;
+  int count_;
+
+public:
+  Limit(Operator *child, int limit);
+  ~Limit() { delete child_; }
+  bool Next(std::vector<TKey> &row);
+  long long rid() { return child_->rid(); }
+};
+
+#endif /* HackyDb_SORT_H_ */
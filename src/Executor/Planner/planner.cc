@@ -0,0 +1,694 @@
+#include "planner.h"
+
+#include <algorithm>
+
+#include "../Operators/aggregates.h"
+#include "../Operators/joins.h"
+#include "../Operators/parallel.h"
+#include "../Operators/sort.h"
+#include "statistics.h"
+
+using namespace std;
+
+// Finds the table and column a column name refers to. Names may be
+// qualified with the table name, and must be when several tables have
+// the column.
+void Planner::Resolve(std::vector<Table *> &tbls, std::string name, int &tbl,
+                      int &col) {
+  string tb_name;
+  size_t dot = name.find('.');
+  if (dot != string::npos) {
+    tb_name = name.substr(0, dot);
+    name = name.substr(dot + 1);
+  }
+
+  tbl = -1;
+  for (int i = 0; i < tbls.size(); ++i) {
+    if (!tb_name.empty() && tbls[i]->tb_name() != tb_name) {
+      continue;
+    }
+    int found = tbls[i]->GetAttributeIndex(name);
+    if (found == -1) {
+      continue;
+    }
+    if (tbl != -1) {
+      throw AmbiguousAttributeException();
+    }
+    tbl = i;
+    col = found;
+  }
+  if (tbl == -1) {
+    throw AttributeNotExistException();
+  }
+}
+
+Index *Planner::FindIndex(Table *tbl, int col, bool ordered) {
+  for (int i = 0; i < tbl->GetIndexNum(); ++i) {
+    Index *idx = tbl->GetIndex(i);
+    if (tbl->GetAttributeIndex(idx->attr_name()) == col &&
+        idx->method() != INDEX_BLOOM &&
+        (!ordered || idx->method() == INDEX_BTREE)) {
+      return idx;
+    }
+  }
+  return NULL;
+}
+
+// Whether an equality on an indexed column leaves at most one row, which
+// PlanScan answers with an IndexScan.
+bool Planner::PointLookup(Table *tbl, std::vector<Condition> &conds) {
+  for (int i = 0; i < conds.size(); ++i) {
+    if (conds[i].sign_type == SIGN_EQ &&
+        FindIndex(tbl, conds[i].col, false) != NULL) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// A B+ tree index to read the matches of conds through, if range
+// conditions on its key leave fewer rows than tbl has blocks: each row
+// then costs at most one block read, against reading every block. Only
+// an analyzed table has the estimates for it.
+Index *Planner::RangeIndex(Table *tbl, std::vector<Condition> &conds) {
+  if (!tbl->analyzed()) {
+    return NULL;
+  }
+  for (int i = 0; i < conds.size(); ++i) {
+    int sign = conds[i].sign_type;
+    if (sign == SIGN_EQ || sign == SIGN_NE) {
+      continue;
+    }
+    Index *idx = FindIndex(tbl, conds[i].col, true);
+    if (idx == NULL) {
+      continue;
+    }
+    vector<Condition> key_conds;
+    for (int j = 0; j < conds.size(); ++j) {
+      if (conds[j].col == conds[i].col) {
+        key_conds.push_back(conds[j]);
+      }
+    }
+    if (EstimateRows(tbl, key_conds) < tbl->block_count()) {
+      return idx;
+    }
+  }
+  return NULL;
+}
+
+// The rows expected from joining left_rows rows of left with right_rows
+// rows of right on the two columns: each key on the side with fewer
+// distinct keys matches the rows of one key on the other.
+double Planner::JoinRows(double left_rows, Table *left, int left_col,
+                         double right_rows, Table *right, int right_col) {
+  double left_keys = EstimateDistinct(left, left_col);
+  double right_keys = EstimateDistinct(right, right_col);
+  left_keys = left_keys < 0 ? left_rows : min(left_keys, left_rows);
+  right_keys = right_keys < 0 ? right_rows : min(right_keys, right_rows);
+  return left_rows * right_rows / max(max(left_keys, right_keys), 1.0);
+}
+
+// The order to join tbls in, by their positions. Unless every table is
+// analyzed they stay in the order they are written. Otherwise the plan
+// starts from the table with the fewest matching rows and then each time
+// adds the table, joined to one already in, that gives the fewest rows.
+std::vector<int> Planner::JoinOrder(std::vector<Table *> &tbls,
+                                    std::vector<std::vector<SQLWhere> > &wheres,
+                                    std::vector<int> &left_tbls,
+                                    std::vector<int> &left_cols,
+                                    std::vector<int> &right_cols) {
+  vector<int> order;
+  bool analyzed = true;
+  for (int i = 0; i < tbls.size(); ++i) {
+    analyzed = analyzed && tbls[i]->analyzed();
+  }
+  if (!analyzed) {
+    for (int i = 0; i < tbls.size(); ++i) {
+      order.push_back(i);
+    }
+    return order;
+  }
+
+  vector<double> rows;
+  for (int i = 0; i < tbls.size(); ++i) {
+    vector<Condition> conds = rm_.GetConditions(tbls[i], wheres[i]);
+    rows.push_back(EstimateRows(tbls[i], conds));
+  }
+  order.push_back(min_element(rows.begin(), rows.end()) - rows.begin());
+  vector<bool> joined(tbls.size(), false);
+  joined[order[0]] = true;
+  double plan_rows = rows[order[0]];
+
+  while (order.size() < tbls.size()) {
+    int best = -1;
+    double best_rows = 0;
+    // join i links table left_tbls[i] with table i + 1
+    for (int i = 0; i < left_tbls.size(); ++i) {
+      int in = left_tbls[i], out = i + 1, in_col = left_cols[i],
+          out_col = right_cols[i];
+      if (joined[in] == joined[out]) {
+        continue;
+      }
+      if (joined[out]) {
+        swap(in, out);
+        swap(in_col, out_col);
+      }
+      double join_rows = JoinRows(plan_rows, tbls[in], in_col, rows[out],
+                                  tbls[out], out_col);
+      if (best == -1 || join_rows < best_rows) {
+        best = out;
+        best_rows = join_rows;
+      }
+    }
+    order.push_back(best);
+    joined[best] = true;
+    plan_rows = best_rows;
+  }
+  return order;
+}
+
+// Where column col of table tbl is in the rows the scans and joins emit.
+int Planner::Position(std::vector<std::vector<int> > &needed,
+                      std::vector<int> &offsets, int tbl, int col) {
+  vector<int> &cols = needed[tbl];
+  return offsets[tbl] + (find(cols.begin(), cols.end(), col) - cols.begin());
+}
+
+std::string Planner::AggregateName(int func, std::string col) {
+  const char *names[] = {"", "count", "sum", "avg", "min", "max"};
+  return string(names[func]) + "(" + col + ")";
+}
+
+void Planner::Qualify(Operator *plan, Table *tbl) {
+  for (int i = 0; i < plan->names().size(); ++i) {
+    plan->names()[i] = tbl->tb_name() + "." + plan->names()[i];
+  }
+}
+
+Operator *Planner::PlanSelect(SQLSelect &st) {
+  Database *db = rm_.cm()->GetDB(rm_.db_name());
+
+  vector<Table *> tbls;
+  tbls.push_back(db->GetTable(st.tb_name()));
+  for (int i = 0; i < st.joins().size(); ++i) {
+    Table *tbl = db->GetTable(st.joins()[i].tb_name);
+    if (tbl == NULL) {
+      throw TableNotExistException();
+    }
+    if (find(tbls.begin(), tbls.end(), tbl) != tbls.end()) {
+      throw SyntaxErrorException(); // no aliases to tell them apart
+    }
+    tbls.push_back(tbl);
+  }
+
+  // the columns each table has to decode, and the predicates on it
+  vector<vector<int> > needed(tbls.size());
+  vector<vector<SQLWhere> > wheres(tbls.size());
+
+  // the select list; COUNT(*) has no table or column (-1)
+  vector<int> out_tbls;
+  vector<int> out_cols;
+  vector<int> out_funcs;
+  if (st.cols().empty()) {
+    for (int i = 0; i < tbls.size(); ++i) {
+      for (int j = 0; j < tbls[i]->GetAttributeNum(); ++j) {
+        out_tbls.push_back(i);
+        out_cols.push_back(j);
+        out_funcs.push_back(AGG_NONE);
+      }
+    }
+  }
+  for (int i = 0; i < st.cols().size(); ++i) {
+    int tbl = -1, col = -1;
+    if (st.cols()[i] != "*") {
+      Resolve(tbls, st.cols()[i], tbl, col);
+    }
+    out_tbls.push_back(tbl);
+    out_cols.push_back(col);
+    out_funcs.push_back(st.funcs()[i]);
+  }
+  for (int i = 0; i < out_tbls.size(); ++i) {
+    if (out_tbls[i] != -1) {
+      needed[out_tbls[i]].push_back(out_cols[i]);
+    }
+  }
+
+  bool aggregate = !st.group_by().empty();
+  for (int i = 0; i < out_funcs.size(); ++i) {
+    if (out_funcs[i] != AGG_NONE) {
+      aggregate = true;
+    }
+  }
+
+  vector<int> group_tbls;
+  vector<int> group_cols;
+  for (int i = 0; i < st.group_by().size(); ++i) {
+    int tbl, col;
+    Resolve(tbls, st.group_by()[i], tbl, col);
+    group_tbls.push_back(tbl);
+    group_cols.push_back(col);
+    needed[tbl].push_back(col);
+  }
+
+  // plain columns next to aggregates must be grouped on, and only numbers
+  // add up
+  for (int i = 0; aggregate && i < out_funcs.size(); ++i) {
+    if (out_funcs[i] == AGG_NONE) {
+      bool grouped = false;
+      for (int j = 0; j < group_tbls.size(); ++j) {
+        if (group_tbls[j] == out_tbls[i] && group_cols[j] == out_cols[i]) {
+          grouped = true;
+        }
+      }
+      if (!grouped) {
+        throw SyntaxErrorException();
+      }
+    } else if ((out_funcs[i] == AGG_SUM || out_funcs[i] == AGG_AVG) &&
+               tbls[out_tbls[i]]->ats()[out_cols[i]].data_type() == T_CHAR) {
+      throw SyntaxErrorException();
+    }
+  }
+
+  // ORDER BY items name an aggregate of the select list (order_outs) or a
+  // column, which must be grouped on when there are aggregates
+  vector<int> order_outs;
+  vector<int> order_tbls;
+  vector<int> order_cols;
+  for (int i = 0; i < st.order_by().size(); ++i) {
+    SQLOrder &order = st.order_by()[i];
+    int out = -1, tbl = -1, col = -1;
+    if (order.func != AGG_NONE) {
+      for (int j = 0; out == -1 && j < st.cols().size(); ++j) {
+        if (st.funcs()[j] == order.func && st.cols()[j] == order.key) {
+          out = j;
+        }
+      }
+      if (out == -1) {
+        throw SyntaxErrorException();
+      }
+    } else {
+      Resolve(tbls, order.key, tbl, col);
+      bool grouped = !aggregate;
+      for (int j = 0; j < group_tbls.size(); ++j) {
+        if (group_tbls[j] == tbl && group_cols[j] == col) {
+          grouped = true;
+        }
+      }
+      if (!grouped) {
+        throw SyntaxErrorException();
+      }
+      needed[tbl].push_back(col);
+    }
+    order_outs.push_back(out);
+    order_tbls.push_back(tbl);
+    order_cols.push_back(col);
+  }
+
+  if (aggregate && st.joins().empty() && st.wheres().empty() &&
+      st.group_by().empty()) {
+    Operator *plan = PlanShortcut(tbls[0], st);
+    if (plan != NULL) {
+      if (st.limit() != -1) {
+        plan = new Limit(plan, st.limit());
+      }
+      return plan;
+    }
+  }
+
+  for (int i = 0; i < st.wheres().size(); ++i) {
+    SQLWhere where = st.wheres()[i];
+    int tbl, col;
+    Resolve(tbls, where.key, tbl, col);
+    where.key = tbls[tbl]->ats()[col].attr_name();
+    wheres[tbl].push_back(where);
+  }
+
+  // join i adds table i + 1, matching its column right_cols[i] with column
+  // left_cols[i] of the earlier table left_tbls[i]
+  vector<int> left_tbls;
+  vector<int> left_cols;
+  vector<int> right_cols;
+  for (int i = 0; i < st.joins().size(); ++i) {
+    int lt, lc, rt, rc;
+    Resolve(tbls, st.joins()[i].left, lt, lc);
+    Resolve(tbls, st.joins()[i].right, rt, rc);
+    if (lt == i + 1) {
+      swap(lt, rt);
+      swap(lc, rc);
+    }
+    if (rt != i + 1 || lt > i) {
+      throw SyntaxErrorException();
+    }
+    if (tbls[lt]->ats()[lc].data_type() != tbls[rt]->ats()[rc].data_type()) {
+      throw JoinTypeMismatchException();
+    }
+    needed[lt].push_back(lc);
+    needed[rt].push_back(rc);
+    left_tbls.push_back(lt);
+    left_cols.push_back(lc);
+    right_cols.push_back(rc);
+  }
+
+  // the tables are put in the order they are joined in, and everything
+  // that refers to one by its position follows it
+  vector<int> order = JoinOrder(tbls, wheres, left_tbls, left_cols,
+                                right_cols);
+  vector<int> pos(tbls.size());
+  for (int i = 0; i < order.size(); ++i) {
+    pos[order[i]] = i;
+  }
+  bool reordered = false;
+  for (int i = 0; i < order.size(); ++i) {
+    reordered = reordered || order[i] != i;
+  }
+  if (reordered) {
+    vector<Table *> old_tbls = tbls;
+    vector<vector<int> > old_needed = needed;
+    vector<vector<SQLWhere> > old_wheres = wheres;
+    for (int i = 0; i < order.size(); ++i) {
+      tbls[i] = old_tbls[order[i]];
+      needed[i] = old_needed[order[i]];
+      wheres[i] = old_wheres[order[i]];
+    }
+    vector<int> *refs[] = {&out_tbls, &group_tbls, &order_tbls};
+    for (int r = 0; r < 3; ++r) {
+      for (int i = 0; i < refs[r]->size(); ++i) {
+        int &tbl = (*refs[r])[i];
+        if (tbl != -1) {
+          tbl = pos[tbl];
+        }
+      }
+    }
+
+    // each table after the first joins the one earlier table it is linked
+    // with
+    vector<int> old_left_tbls = left_tbls;
+    vector<int> old_left_cols = left_cols;
+    vector<int> old_right_cols = right_cols;
+    for (int k = 1; k < order.size(); ++k) {
+      for (int i = 0; i < old_left_tbls.size(); ++i) {
+        int in = old_left_tbls[i], out = i + 1, in_col = old_left_cols[i],
+            out_col = old_right_cols[i];
+        if (in == order[k]) {
+          swap(in, out);
+          swap(in_col, out_col);
+        }
+        if (out == order[k] && pos[in] < k) {
+          left_tbls[k - 1] = pos[in];
+          left_cols[k - 1] = in_col;
+          right_cols[k - 1] = out_col;
+        }
+      }
+    }
+  }
+
+  // an index nested loop join probes the index once for each left row,
+  // and a hash join reads the right table once; with statistics the
+  // cheaper is taken, without them the index is probed whenever there is
+  // one
+  vector<bool> probe;
+  double plan_rows = -1;
+  if (order.size() > 1 && tbls[0]->analyzed()) {
+    vector<Condition> conds = rm_.GetConditions(tbls[0], wheres[0]);
+    plan_rows = EstimateRows(tbls[0], conds);
+  }
+  for (int i = 0; i < st.joins().size(); ++i) {
+    Table *right = tbls[i + 1];
+    bool indexed = FindIndex(right, right_cols[i], false) != NULL;
+    if (plan_rows < 0 || !right->analyzed()) {
+      probe.push_back(indexed);
+      plan_rows = -1;
+      continue;
+    }
+    probe.push_back(indexed && plan_rows <= right->block_count());
+    vector<Condition> conds = rm_.GetConditions(right, wheres[i + 1]);
+    plan_rows = JoinRows(plan_rows, tbls[left_tbls[i]], left_cols[i],
+                         EstimateRows(right, conds), right, right_cols[i]);
+  }
+
+  // each scan decodes its columns once, in table order, and the joins
+  // concatenate them
+  vector<int> offsets;
+  int width = 0;
+  for (int i = 0; i < tbls.size(); ++i) {
+    sort(needed[i].begin(), needed[i].end());
+    needed[i].erase(unique(needed[i].begin(), needed[i].end()),
+                    needed[i].end());
+    offsets.push_back(width);
+    width += needed[i].size();
+  }
+
+  Operator *plan = NULL;
+  int order_tbl = -1; // the plan is sorted on this column, if any
+  int order_col = -1;
+
+  // a single ascending ORDER BY column may come in order from an index
+  int sort_tbl = -1;
+  int sort_col = -1;
+  if (!aggregate && st.order_by().size() == 1 && !st.order_by()[0].desc) {
+    sort_tbl = order_tbls[0];
+    sort_col = order_cols[0];
+  }
+
+  // the joins keep the order of their left input unless one hashes
+  for (int i = 0; i < st.joins().size(); ++i) {
+    if (!probe[i]) {
+      sort_tbl = -1;
+    }
+  }
+
+  // start from an index-order scan when the first join can merge, or the
+  // rows have to be sorted on a column of the first table
+  vector<Condition> conds = rm_.GetConditions(tbls[0], wheres[0]);
+  bool point = PointLookup(tbls[0], conds);
+  if (!st.joins().empty() && !point &&
+      FindIndex(tbls[0], left_cols[0], true) != NULL &&
+      FindIndex(tbls[1], right_cols[0], true) != NULL) {
+    order_tbl = 0;
+    order_col = left_cols[0];
+  } else if (sort_tbl == 0 && !point &&
+             FindIndex(tbls[0], sort_col, true) != NULL) {
+    order_tbl = 0;
+    order_col = sort_col;
+  }
+  // a table alone is scanned, and aggregated, on several threads if it
+  // is large enough; the plan is then left NULL for the aggregate
+  int threads = 1;
+  if (st.joins().empty() && !point && RangeIndex(tbls[0], conds) == NULL) {
+    threads = ScanThreads(tbls[0]->block_count());
+  }
+  // so is a table every other one is joined to by probing a B+ tree, when
+  // it would be scanned in full: each thread probes the trees itself
+  bool probing = !st.joins().empty() && order_tbl == -1 && !point &&
+                 RangeIndex(tbls[0], conds) == NULL;
+  for (int i = 0; i < conds.size(); ++i) {
+    if (conds[i].sign_type == SIGN_EQ &&
+        FindIndex(tbls[0], conds[i].col, false) != NULL) {
+      probing = false; // PlanScan would look the key up
+    }
+  }
+  for (int i = 0; i < st.joins().size(); ++i) {
+    Index *idx = probe[i] ? FindIndex(tbls[i + 1], right_cols[i], false)
+                          : NULL;
+    if (idx == NULL || idx->method() != INDEX_BTREE) {
+      probing = false;
+    }
+  }
+  if (probing) {
+    threads = ScanThreads(tbls[0]->block_count());
+  }
+  ParallelScan *parallel = NULL;
+  if (order_tbl != -1) {
+    plan = new IndexOrderScan(rm_, tbls[0], FindIndex(tbls[0], order_col, true),
+                              needed[0], conds);
+  } else if (probing && threads > 1) {
+    parallel = new ParallelScan(rm_, tbls[0], needed[0], conds, threads);
+    plan = parallel;
+  } else if (!aggregate || threads == 1) {
+    plan = PlanScan(tbls[0], wheres[0], needed[0], st.joins().empty());
+  }
+  // a single row is in any order
+  bool sorted = point && st.joins().empty();
+  if (!st.joins().empty()) {
+    Qualify(plan, tbls[0]);
+  }
+
+  for (int i = 0; i < st.joins().size(); ++i) {
+    Table *right = tbls[i + 1];
+    vector<int> &cols = needed[i + 1];
+    int left_key = Position(needed, offsets, left_tbls[i], left_cols[i]);
+    int right_key = find(cols.begin(), cols.end(), right_cols[i]) -
+                    cols.begin();
+    vector<Condition> conds = rm_.GetConditions(right, wheres[i + 1]);
+
+    Index *ordered = FindIndex(right, right_cols[i], true);
+    Index *idx = probe[i] ? FindIndex(right, right_cols[i], false) : NULL;
+    if (ordered != NULL && order_tbl == left_tbls[i] &&
+        order_col == left_cols[i]) {
+      Operator *scan = new IndexOrderScan(rm_, right, ordered, cols, conds);
+      Qualify(scan, right);
+      plan = new MergeJoin(plan, scan, left_key, right_key);
+    } else if (idx != NULL && parallel != NULL) {
+      parallel->Probe(right, idx, left_key, cols, conds);
+    } else if (idx != NULL) {
+      plan = new IndexNestedLoopJoin(plan, rm_, right, idx, left_key, cols,
+                                     conds);
+    } else {
+      Operator *scan = PlanScan(right, wheres[i + 1], cols, false);
+      Qualify(scan, right);
+      plan = new HashJoin(plan, scan, left_key, right_key);
+      order_tbl = -1;
+    }
+  }
+
+  vector<int> map;
+  if (aggregate) {
+    // the aggregate emits the group columns, then the aggregates
+    vector<int> groups;
+    for (int i = 0; i < group_tbls.size(); ++i) {
+      groups.push_back(Position(needed, offsets, group_tbls[i], group_cols[i]));
+    }
+    vector<AggregateSpec> aggs;
+    vector<string> agg_names;
+    for (int i = 0; i < out_funcs.size(); ++i) {
+      if (out_funcs[i] == AGG_NONE) {
+        for (int j = 0; j < group_tbls.size(); ++j) {
+          if (group_tbls[j] == out_tbls[i] && group_cols[j] == out_cols[i]) {
+            map.push_back(j);
+          }
+        }
+        continue;
+      }
+      AggregateSpec spec = {out_funcs[i], -1, T_INT, 4};
+      if (out_tbls[i] != -1) {
+        Attribute &attr = tbls[out_tbls[i]]->ats()[out_cols[i]];
+        spec.col = Position(needed, offsets, out_tbls[i], out_cols[i]);
+        spec.type = attr.data_type();
+        spec.length = attr.length();
+      }
+      map.push_back(groups.size() + aggs.size());
+      aggs.push_back(spec);
+      agg_names.push_back(AggregateName(out_funcs[i], st.cols()[i]));
+    }
+    if (plan == NULL) {
+      plan = new ParallelAggregate(rm_, tbls[0], needed[0], conds, groups,
+                                   aggs, agg_names, threads);
+    } else {
+      plan = new HashAggregate(plan, groups, aggs, agg_names);
+    }
+    width = groups.size() + aggs.size();
+  } else {
+    for (int i = 0; i < out_tbls.size(); ++i) {
+      map.push_back(Position(needed, offsets, out_tbls[i], out_cols[i]));
+    }
+  }
+
+  if (order_tbl != -1 && order_tbl == sort_tbl && order_col == sort_col) {
+    sorted = true;
+  }
+  bool limited = false;
+  if (!st.order_by().empty() && !sorted) {
+    vector<SortKey> keys;
+    for (int i = 0; i < st.order_by().size(); ++i) {
+      SortKey key = {0, st.order_by()[i].desc};
+      if (order_outs[i] != -1) {
+        key.col = map[order_outs[i]];
+      } else if (!aggregate) {
+        key.col = Position(needed, offsets, order_tbls[i], order_cols[i]);
+      } else {
+        for (int j = 0; j < group_tbls.size(); ++j) {
+          if (group_tbls[j] == order_tbls[i] &&
+              group_cols[j] == order_cols[i]) {
+            key.col = j;
+          }
+        }
+      }
+      keys.push_back(key);
+    }
+    if (st.limit() != -1 && st.limit() <= TOP_N_MAX_ROWS) {
+      plan = new TopN(plan, keys, st.limit());
+      limited = true;
+    } else {
+      plan = new Sort(plan, keys);
+    }
+  }
+  if (st.limit() != -1 && !limited) {
+    plan = new Limit(plan, st.limit());
+  }
+
+  bool identity = map.size() == width;
+  for (int i = 0; i < map.size(); ++i) {
+    if (map[i] != i) {
+      identity = false;
+    }
+  }
+  if (!identity) {
+    plan = new Project(plan, map);
+  }
+  return plan;
+}
+
+// Aggregates over a whole table that need not read its records: COUNT(*)
+// from the block headers, and MIN and MAX of a B+ tree key from the ends
+// of the tree. NULL if the select list has anything else.
+Operator *Planner::PlanShortcut(Table *tbl, SQLSelect &st) {
+  bool counts = true;
+  bool extremes = true;
+  for (int i = 0; i < st.cols().size(); ++i) {
+    if (st.funcs()[i] != AGG_COUNT || st.cols()[i] != "*") {
+      counts = false;
+    }
+    if ((st.funcs()[i] != AGG_MIN && st.funcs()[i] != AGG_MAX) ||
+        st.cols()[i] != st.cols()[0]) {
+      extremes = false;
+    }
+  }
+
+  Operator *plan;
+  vector<int> map;
+  if (counts) {
+    plan = new RecordCount(rm_, tbl, AggregateName(AGG_COUNT, "*"));
+    map.assign(st.cols().size(), 0);
+  } else if (extremes && st.cols()[0] != "*") {
+    vector<Table *> tbls(1, tbl);
+    int t, col;
+    Resolve(tbls, st.cols()[0], t, col);
+    Index *idx = FindIndex(tbl, col, true);
+    if (idx == NULL) {
+      return NULL;
+    }
+    plan = new IndexMinMax(rm_, idx, AggregateName(AGG_MIN, st.cols()[0]),
+                           AggregateName(AGG_MAX, st.cols()[0]));
+    for (int i = 0; i < st.cols().size(); ++i) {
+      map.push_back(st.funcs()[i] == AGG_MIN ? 0 : 1);
+    }
+  } else {
+    return NULL;
+  }
+
+  if (map.size() != plan->names().size() || map[0] != 0) {
+    plan = new Project(plan, map);
+  }
+  return plan;
+}
+
+Operator *Planner::PlanScan(Table *tbl, std::vector<SQLWhere> &wheres,
+                            std::vector<int> &cols, bool parallel) {
+  vector<Condition> conds = rm_.GetConditions(tbl, wheres);
+
+  for (int i = 0; i < conds.size(); ++i) {
+    Index *idx = FindIndex(tbl, conds[i].col, false);
+    if (conds[i].sign_type == SIGN_EQ && idx != NULL) {
+      return new IndexScan(rm_, tbl, idx, conds[i].operand, cols, conds);
+    }
+  }
+  Index *range = RangeIndex(tbl, conds);
+  if (range != NULL) {
+    return new IndexOrderScan(rm_, tbl, range, cols, conds);
+  }
+  int threads = parallel ? ScanThreads(tbl->block_count()) : 1;
+  if (threads > 1) {
+    return new ParallelScan(rm_, tbl, cols, conds, threads);
+  }
+  return new SeqScan(rm_, tbl, cols, conds);
+}
@@ -0,0 +1,69 @@
+#ifndef HackyDb_PLANNER_H_
+#define HackyDb_PLANNER_H_
+
+#include <string>
+#include <vector>
+
+#include "../Operators/operators.h"
+
+// Rule-based planner, which turns to the statistics ANALYZE keeps where a
+// table has them. An equality on an indexed column is answered by an
+// IndexScan, a range on a B+ tree key that the statistics show to be
+// selective by an IndexOrderScan, anything else by a SeqScan. WHERE
+// predicates are pushed into the scan, which decodes only the columns the
+// plan above it reads.
+//
+// Joins are planned left-deep, in the order the tables are written unless
+// all of them are analyzed, when the order keeps the estimated rows
+// between the joins few. A join whose inputs both come in key order from
+// B+ tree indexes is a MergeJoin, one whose right table has an index on
+// the key an IndexNestedLoopJoin, unless the statistics show that reading
+// the right table once is cheaper, and any other a HashJoin.
+//
+// Aggregates and GROUP BY go through a HashAggregate on top of the joins,
+// except COUNT(*) and MIN/MAX of a B+ tree key over a whole table, which
+// are answered without reading the records.
+//
+// ORDER BY sorts the rows last, before the select list is picked out of
+// them, and LIMIT with ORDER BY keeps only the first rows in a TopN. The
+// sort is skipped when the rows already come in order from a B+ tree.
+//
+// A large table read alone is scanned on several threads, and so are its
+// aggregates, each thread aggregating its own rows. So is a large first
+// table joined to every other one through a B+ tree, each thread probing
+// the trees for its own rows.
+class Planner {
+private:
+  RecordManager rm_;
+
+  void Resolve(std::vector<Table *> &tbls, std::string name, int &tbl,
+               int &col);
+  Index *FindIndex(Table *tbl, int col, bool ordered);
+  bool PointLookup(Table *tbl, std::vector<Condition> &conds);
+  Index *RangeIndex(Table *tbl, std::vector<Condition> &conds);
+  double JoinRows(double left_rows, Table *left, int left_col,
+                  double right_rows, Table *right, int right_col);
+  std::vector<int> JoinOrder(std::vector<Table *> &tbls,
+                             std::vector<std::vector<SQLWhere> > &wheres,
+                             std::vector<int> &left_tbls,
+                             std::vector<int> &left_cols,
+                             std::vector<int> &right_cols);
+  void Qualify(Operator *plan, Table *tbl);
+  int Position(std::vector<std::vector<int> > &needed,
+               std::vector<int> &offsets, int tbl, int col);
+  std::string AggregateName(int func, std::string col);
+  Operator *PlanShortcut(Table *tbl, SQLSelect &st);
+
+public:
+  Planner(CatalogManager *cm, BufferManager *hdl, std::string db)
+      : rm_(cm, hdl, db) {}
+
+  Operator *PlanSelect(SQLSelect &st);
+  // Access path for the rows of tbl matching wheres; the rows hold cols.
+  // With parallel set, a large table is scanned on several threads. Only
+  // a plan that reads no other blocks while the scan runs may ask for it.
+  Operator *PlanScan(Table *tbl, std::vector<SQLWhere> &wheres,
+                     std::vector<int> &cols, bool parallel);
+};
+
+#endif /* HackyDb_PLANNER_H_ */
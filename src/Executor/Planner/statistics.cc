@@ -0,0 +1,276 @@
+#include "statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace std;
+
+// FNV-1a, then the MurmurHash3 finalizer so every bit of the hash depends
+// on every byte of the key
+static uint64_t Hash64(const std::string &bytes) {
+  uint64_t hash = 14695981039346656037ull;
+  for (int i = 0; i < bytes.size(); ++i) {
+    hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ull;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+void HyperLogLog::Add(const std::string &bytes) {
+  uint64_t hash = Hash64(bytes);
+  int reg = hash >> (64 - HLL_PRECISION);
+  uint64_t rest = hash << HLL_PRECISION;
+  int rank = rest == 0 ? 64 - HLL_PRECISION + 1 : __builtin_clzll(rest) + 1;
+  if (rank > registers_[reg]) {
+    registers_[reg] = rank;
+  }
+}
+
+double HyperLogLog::Estimate() {
+  double m = registers_.size();
+  double sum = 0;
+  int zeros = 0;
+  for (int i = 0; i < registers_.size(); ++i) {
+    sum += ldexp(1.0, -registers_[i]);
+    if (registers_[i] == 0) {
+      ++zeros;
+    }
+  }
+  double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+  // few keys leave registers empty, and counting those is more accurate
+  if (estimate <= 2.5 * m && zeros > 0) {
+    estimate = m * log(m / zeros);
+  }
+  return estimate;
+}
+
+// A key of the column's type from the KeyBytes it was stored as.
+static TKey StoredKey(Attribute &attr, const std::string &bytes) {
+  TKey key(attr.data_type(), attr.length());
+  memset(key.key(), 0, key.length());
+  memcpy(key.key(), bytes.data(), min((int)bytes.size(), key.length()));
+  return key;
+}
+
+void CollectStatistics(RecordManager rm, Table *tbl) {
+  int cols = tbl->GetAttributeNum();
+  vector<int> all;
+  for (int i = 0; i < cols; ++i) {
+    all.push_back(i);
+  }
+
+  vector<HyperLogLog> distinct(cols);
+  vector<TKey> mins;
+  vector<TKey> maxs;
+  vector<vector<TKey> > sample;
+  mt19937 random(42);
+
+  long long rows = 0;
+  vector<TKey> row;
+  SeqScan scan(rm, tbl, all, vector<Condition>());
+  while (scan.Next(row)) {
+    for (int i = 0; i < cols; ++i) {
+      distinct[i].Add(KeyBytes(row[i]));
+    }
+    if (rows == 0) {
+      mins = row;
+      maxs = row;
+    }
+    for (int i = 0; i < cols; ++i) {
+      if (CompareKeys(row[i], mins[i]) < 0) {
+        mins[i] = row[i];
+      }
+      if (CompareKeys(row[i], maxs[i]) > 0) {
+        maxs[i] = row[i];
+      }
+    }
+
+    // reservoir sampling: every row ends up in the sample with the same
+    // chance
+    if (sample.size() < STATISTICS_SAMPLE_ROWS) {
+      sample.push_back(row);
+    } else {
+      long long pick = random() % (rows + 1);
+      if (pick < STATISTICS_SAMPLE_ROWS) {
+        sample[pick] = row;
+      }
+    }
+    ++rows;
+  }
+
+  for (int i = 0; i < cols; ++i) {
+    Attribute &attr = tbl->ats()[i];
+    if (rows == 0) {
+      attr.set_statistics(0, "", "", vector<string>());
+      continue;
+    }
+
+    vector<TKey> keys;
+    for (int j = 0; j < sample.size(); ++j) {
+      keys.push_back(sample[j][i]);
+    }
+    sort(keys.begin(), keys.end(),
+         [](TKey &a, TKey &b) { return CompareKeys(a, b) < 0; });
+    vector<string> bounds;
+    for (int b = 0; b <= HISTOGRAM_BUCKETS; ++b) {
+      bounds.push_back(
+          KeyBytes(keys[(long long)b * (keys.size() - 1) / HISTOGRAM_BUCKETS]));
+    }
+    bounds.front() = KeyBytes(mins[i]);
+    bounds.back() = KeyBytes(maxs[i]);
+
+    double count = min(distinct[i].Estimate(), (double)rows);
+    if (attr.attr_type() == 1) {
+      count = rows; // the primary key
+    }
+    attr.set_statistics(max(count, 1.0), KeyBytes(mins[i]), KeyBytes(maxs[i]),
+                        bounds);
+  }
+  tbl->set_analyzed_rows(rows);
+}
+
+double EstimateDistinct(Table *tbl, int col) {
+  Attribute &attr = tbl->ats()[col];
+  if (!tbl->analyzed() || attr.distinct() < 0) {
+    return -1;
+  }
+  double rows = tbl->CountRecords();
+  if (attr.attr_type() == 1) {
+    return rows;
+  }
+  return min(attr.distinct(), max(rows, 1.0));
+}
+
+// How far value lies from lo towards hi, for numbers. CHAR keys are taken
+// to lie halfway.
+static double Interpolate(TKey &lo, TKey &hi, TKey &value) {
+  double l, h, v;
+  if (value.key_type() == T_INT) {
+    int x;
+    memcpy(&x, lo.key(), sizeof(x));
+    l = x;
+    memcpy(&x, hi.key(), sizeof(x));
+    h = x;
+    memcpy(&x, value.key(), sizeof(x));
+    v = x;
+  } else if (value.key_type() == T_FLOAT) {
+    float x;
+    memcpy(&x, lo.key(), sizeof(x));
+    l = x;
+    memcpy(&x, hi.key(), sizeof(x));
+    h = x;
+    memcpy(&x, value.key(), sizeof(x));
+    v = x;
+  } else {
+    return 0.5;
+  }
+  if (h <= l) {
+    return 0.5;
+  }
+  return min(max((v - l) / (h - l), 0.0), 1.0);
+}
+
+// The share of the rows with keys below value, from the histogram.
+static double Below(Attribute &attr, TKey &value) {
+  vector<string> &bounds = attr.bounds();
+  int buckets = bounds.size() - 1;
+  TKey lo = StoredKey(attr, bounds[0]);
+  if (CompareKeys(value, lo) <= 0) {
+    return 0;
+  }
+  for (int i = 0; i < buckets; ++i) {
+    TKey hi = StoredKey(attr, bounds[i + 1]);
+    if (CompareKeys(value, hi) <= 0) {
+      return (i + Interpolate(lo, hi, value)) / buckets;
+    }
+    lo = hi;
+  }
+  return 1;
+}
+
+double EstimateSelectivity(Table *tbl, Condition &cond) {
+  Attribute &attr = tbl->ats()[cond.col];
+  double distinct = EstimateDistinct(tbl, cond.col);
+  if (distinct < 0) {
+    switch (cond.sign_type) {
+    case SIGN_EQ:
+      return DEFAULT_EQ_SELECTIVITY;
+    case SIGN_NE:
+      return 1 - DEFAULT_EQ_SELECTIVITY;
+    default:
+      return DEFAULT_RANGE_SELECTIVITY;
+    }
+  }
+  if (attr.bounds().empty()) {
+    return 0; // the table was empty
+  }
+
+  TKey min_key = StoredKey(attr, attr.min_value());
+  TKey max_key = StoredKey(attr, attr.max_value());
+  bool inside = CompareKeys(cond.operand, min_key) >= 0 &&
+                CompareKeys(cond.operand, max_key) <= 0;
+  double eq = inside && distinct > 0 ? 1 / distinct : 0;
+  double below = Below(attr, cond.operand);
+
+  double selectivity;
+  switch (cond.sign_type) {
+  case SIGN_EQ:
+    selectivity = eq;
+    break;
+  case SIGN_NE:
+    selectivity = 1 - eq;
+    break;
+  case SIGN_LT:
+    selectivity = below;
+    break;
+  case SIGN_LE:
+    selectivity = below + eq;
+    break;
+  case SIGN_GT:
+    selectivity = 1 - below - eq;
+    break;
+  default: // SIGN_GE
+    selectivity = 1 - below;
+    break;
+  }
+  return min(max(selectivity, 0.0), 1.0);
+}
+
+double EstimateRows(Table *tbl, std::vector<Condition> &conds) {
+  double rows = tbl->CountRecords();
+  // a lower and an upper bound on one column are a range, which holds the
+  // rows both let through: not their product, but their overlap
+  vector<double> lower(tbl->GetAttributeNum(), -1);
+  vector<double> upper(tbl->GetAttributeNum(), -1);
+  for (int i = 0; i < conds.size(); ++i) {
+    double selectivity = EstimateSelectivity(tbl, conds[i]);
+    int sign = conds[i].sign_type;
+    double *bound = NULL;
+    if (sign == SIGN_GT || sign == SIGN_GE) {
+      bound = &lower[conds[i].col];
+    } else if (sign == SIGN_LT || sign == SIGN_LE) {
+      bound = &upper[conds[i].col];
+    }
+    if (bound == NULL) {
+      rows *= selectivity;
+    } else if (*bound < 0 || selectivity < *bound) {
+      *bound = selectivity;
+    }
+  }
+  for (int i = 0; i < lower.size(); ++i) {
+    if (lower[i] >= 0 && upper[i] >= 0) {
+      rows *= max(lower[i] + upper[i] - 1, 0.0);
+    } else if (lower[i] >= 0) {
+      rows *= lower[i];
+    } else if (upper[i] >= 0) {
+      rows *= upper[i];
+    }
+  }
+  return rows;
+}
@@ -0,0 +1,45 @@
+#ifndef HackyDb_STATISTICS_H_
+#define HackyDb_STATISTICS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../Operators/operators.h"
+
+#define HLL_PRECISION 12 // 2^12 registers, about 1.6% error
+#define HISTOGRAM_BUCKETS 32
+#define STATISTICS_SAMPLE_ROWS 30000
+
+// Selectivities guessed for columns that were never analyzed.
+#define DEFAULT_EQ_SELECTIVITY 0.005
+#define DEFAULT_RANGE_SELECTIVITY (1.0 / 3)
+
+// Counts the distinct keys it is shown in a fixed 4KB: each key is hashed
+// to a register, which keeps the longest run of leading zero bits seen.
+class HyperLogLog {
+private:
+  std::vector<unsigned char> registers_;
+
+public:
+  HyperLogLog() : registers_(1 << HLL_PRECISION, 0) {}
+  void Add(const std::string &bytes);
+  double Estimate();
+};
+
+// ANALYZE: reads the whole table once and stores with each column its
+// distinct keys, its minimum and maximum, and the bounds of an equi-depth
+// histogram built from a sample of STATISTICS_SAMPLE_ROWS rows. The table
+// keeps the row count the statistics were taken at.
+void CollectStatistics(RecordManager rm, Table *tbl);
+
+// The share of the rows of tbl that pass cond, from the statistics of its
+// column if it has any.
+double EstimateSelectivity(Table *tbl, Condition &cond);
+// The rows of tbl expected to pass all of conds, taken as independent
+// except for the bounds of a range.
+double EstimateRows(Table *tbl, std::vector<Condition> &conds);
+// The distinct keys column col of tbl holds now, or -1 if not analyzed.
+double EstimateDistinct(Table *tbl, int col);
+
+#endif /* HackyDb_STATISTICS_H_ */
@@ -7,6 +7,22 @@
 #define FORMAT_RECORD 0
 #define FORMAT_INDEX 1
 
+// Index Format
+#define INDEX_FORMAT_LEGACY 0 // 4-byte values, (block << 16) | offset
+#define INDEX_FORMAT_RID64 1  // 8-byte values, see MakeRid
+#define INDEX_FORMAT_PREFIX 2 // compressed, variable-length inner nodes
+#define INDEX_FORMAT_CURRENT INDEX_FORMAT_PREFIX
+
+// Table Format
+#define TABLE_FORMAT_FIXED 0   // fixed-length records packed after the header
+#define TABLE_FORMAT_SLOTTED 1 // slotted pages, VARCHAR stored by length
+#define TABLE_FORMAT_CURRENT TABLE_FORMAT_SLOTTED
+
+// Index Method
+#define INDEX_BTREE 0
+#define INDEX_HASH 1
+#define INDEX_BLOOM 2
+
 // Data Type
 #define T_INT 0
 #define T_FLOAT 1
@@ -20,4 +36,12 @@
 #define SIGN_LE 4
 #define SIGN_GE 5
 
+// Aggregate Function
+#define AGG_NONE 0
+#define AGG_COUNT 1
+#define AGG_SUM 2
+#define AGG_AVG 3
+#define AGG_MIN 4
+#define AGG_MAX 5
+
 #endif
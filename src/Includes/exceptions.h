@@ -29,4 +29,13 @@ class IndexMustBeCreatedOnPKException : public std::exception {};
 
 class PrimaryKeyConflictException : public std::exception {};
 
+class AttributeNotExistException : public std::exception {};
+
+class IndexEntryTooLargeException : public std::exception {};
+class AmbiguousAttributeException : public std::exception {};
+class JoinTypeMismatchException : public std::exception {};
+class RecordTooLargeException : public std::exception {};
+class SettingNotExistException : public std::exception {};
+class IntegerOverflowException : public std::exception {};
+
 #endif
\ No newline at end of file
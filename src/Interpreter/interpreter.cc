@@ -136,6 +136,15 @@ void Interpreter::TellSQLType() {
   } else if (sql_vector_[0] == "update") {
     cout << "SQL TYPE: #UPDATE#" << endl;
     sql_type_ = 110;
+  } else if (sql_vector_[0] == "vacuum") {
+    cout << "SQL TYPE: #VACUUM#" << endl;
+    sql_type_ = 120;
+  } else if (sql_vector_[0] == "set") {
+    cout << "SQL TYPE: #SET#" << endl;
+    sql_type_ = 130;
+  } else if (sql_vector_[0] == "analyze") {
+    cout << "SQL TYPE: #ANALYZE#" << endl;
+    sql_type_ = 140;
   } else {
     sql_type_ = -1;
     cout << "SQL TYPE: #UNKNOWN#" << endl;
@@ -229,6 +238,21 @@ void Interpreter::Run() {
       api->Update(*st);
       delete st;
     } break;
+    case 120: {
+      SQLVacuum *st = new SQLVacuum(sql_vector_);
+      api->Vacuum(*st);
+      delete st;
+    } break;
+    case 130: {
+      SQLSet *st = new SQLSet(sql_vector_);
+      api->Set(*st);
+      delete st;
+    } break;
+    case 140: {
+      SQLAnalyze *st = new SQLAnalyze(sql_vector_);
+      api->Analyze(*st);
+      delete st;
+    } break;
     default:
       break;
     }
@@ -256,6 +280,20 @@ void Interpreter::Run() {
     cerr << "Index must be created on primary key!" << endl;
   } catch (PrimaryKeyConflictException &e) {
     cerr << "Primary key conflicts!" << endl;
+  } catch (AttributeNotExistException &e) {
+    cerr << "Attribute doesn't exist!" << endl;
+  } catch (IndexEntryTooLargeException &e) {
+    cerr << "Index entry is too large!" << endl;
+  } catch (AmbiguousAttributeException &e) {
+    cerr << "Attribute is ambiguous!" << endl;
+  } catch (JoinTypeMismatchException &e) {
+    cerr << "Join columns must have the same type!" << endl;
+  } catch (RecordTooLargeException &e) {
+    cerr << "Record is too large for a block!" << endl;
+  } catch (SettingNotExistException &e) {
+    cerr << "Setting doesn't exist!" << endl;
+  } catch (IntegerOverflowException &e) {
+    cerr << "Integer out of range!" << endl;
   }
 }
 
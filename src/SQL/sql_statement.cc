@@ -27,27 +27,71 @@ std::ostream &operator<<(std::ostream &out, const TKey &object) {
     cout << setw(9) << left << a;
   } break;
   case 2: {
-    cout << setw(9) << left << object.key_;
+    // a value as long as its column has no terminating zero
+    cout << setw(9) << left
+         << string(object.key_, strnlen(object.key_, object.length_));
   } break;
   }
 
   return out;
 }
 
+int SQLSelect::AggregateFunction(std::string name) {
+  if (name == "count") {
+    return AGG_COUNT;
+  } else if (name == "sum") {
+    return AGG_SUM;
+  } else if (name == "avg") {
+    return AGG_AVG;
+  } else if (name == "min") {
+    return AGG_MIN;
+  } else if (name == "max") {
+    return AGG_MAX;
+  }
+  return AGG_NONE;
+}
+
 void SQLSelect::Parse(std::vector<std::string> sql_vector) {
   sql_type_ = 90;
+  limit_ = -1;
   unsigned int pos = 1;
 
   if (sql_vector.size() <= pos) {
     throw SyntaxErrorException();
   }
 
-  if (sql_vector[pos] != "*") {
-    throw SyntaxErrorException();
+  if (sql_vector[pos] == "*") {
+    pos++;
+  } else {
+    while (true) {
+      if (sql_vector.size() <= pos + 1) {
+        throw SyntaxErrorException();
+      }
+      int func = AGG_NONE;
+      if (sql_vector[pos + 1] == "(") {
+        func = AggregateFunction(sql_vector[pos]);
+        if (func == AGG_NONE || sql_vector.size() <= pos + 4 ||
+            sql_vector[pos + 3] != ")") {
+          throw SyntaxErrorException();
+        }
+        pos += 2;
+      }
+      if (sql_vector[pos] == "*" && func != AGG_COUNT) {
+        throw SyntaxErrorException();
+      }
+      std::cout << "COLUMN: " << sql_vector[pos] << std::endl;
+      cols_.push_back(sql_vector[pos]);
+      funcs_.push_back(func);
+      pos += func == AGG_NONE ? 1 : 2;
+
+      if (sql_vector[pos] != ",") {
+        break;
+      }
+      pos++;
+    }
   }
-  pos++;
 
-  if (sql_vector[pos] != "from") {
+  if (sql_vector.size() <= pos + 1 || sql_vector[pos] != "from") {
     throw SyntaxErrorException();
   }
   pos++;
@@ -56,55 +100,135 @@ void SQLSelect::Parse(std::vector<std::string> sql_vector) {
   tb_name_ = sql_vector[pos];
   pos++;
 
-  if (sql_vector.size() == pos) {
-    return;
+  while (sql_vector.size() > pos && sql_vector[pos] == "join") {
+    if (sql_vector.size() <= pos + 5 || sql_vector[pos + 2] != "on" ||
+        sql_vector[pos + 4] != "=") {
+      throw SyntaxErrorException();
+    }
+    SQLJoin join;
+    join.tb_name = sql_vector[pos + 1];
+    join.left = sql_vector[pos + 3];
+    join.right = sql_vector[pos + 5];
+    std::cout << "JOIN: " << join.tb_name << " ON " << join.left << " = "
+              << join.right << std::endl;
+    joins_.push_back(join);
+    pos += 6;
   }
 
-  if (sql_vector[pos] != "where") {
-    throw SyntaxErrorException();
-  }
-  pos++;
+  if (sql_vector.size() > pos && sql_vector[pos] == "where") {
+    pos++;
+    while (true) {
+      if (sql_vector.size() < pos + 3) {
+        throw SyntaxErrorException();
+      }
+      SQLWhere where;
 
-  while (true) {
-    SQLWhere where;
+      where.key = sql_vector[pos];
+      pos++;
 
-    where.key = sql_vector[pos];
-    pos++;
+      if (sql_vector[pos] == "=") {
+        where.sign_type = SIGN_EQ;
+      } else if (sql_vector[pos] == "<") {
+        where.sign_type = SIGN_LT;
+      } else if (sql_vector[pos] == ">") {
+        where.sign_type = SIGN_GT;
+      } else if (sql_vector[pos] == "<=") {
+        where.sign_type = SIGN_LE;
+      } else if (sql_vector[pos] == ">=") {
+        where.sign_type = SIGN_GE;
+      } else if (sql_vector[pos] == "<>") {
+        where.sign_type = SIGN_NE;
+      }
+      pos++;
 
-    if (sql_vector[pos] == "=") {
-      where.sign_type = SIGN_EQ;
-    } else if (sql_vector[pos] == "<") {
-      where.sign_type = SIGN_LT;
-    } else if (sql_vector[pos] == ">") {
-      where.sign_type = SIGN_GT;
-    } else if (sql_vector[pos] == "<=") {
-      where.sign_type = SIGN_LE;
-    } else if (sql_vector[pos] == ">=") {
-      where.sign_type = SIGN_GE;
-    } else if (sql_vector[pos] == "<>") {
-      where.sign_type = SIGN_NE;
+      where.value = sql_vector[pos];
+      pos++;
+
+      if (where.value.at(0) == '\'' || where.value.at(0) == '\"') {
+        where.value.assign(where.value, 1, where.value.length() - 2);
+      }
+
+      wheres_.push_back(where);
+      cout << where.key << " " << where.sign_type << " " << where.value
+           << endl;
+
+      if (sql_vector.size() == pos || sql_vector[pos] != "and") {
+        break;
+      }
+      pos++;
     }
-    pos++;
+  }
 
-    where.value = sql_vector[pos];
-    pos++;
+  if (sql_vector.size() > pos + 2 && sql_vector[pos] == "group" &&
+      sql_vector[pos + 1] == "by") {
+    pos += 2;
+    while (true) {
+      std::cout << "GROUP BY: " << sql_vector[pos] << std::endl;
+      group_by_.push_back(sql_vector[pos]);
+      pos++;
 
-    if (where.value.at(0) == '\'' || where.value.at(0) == '\"') {
-      where.value.assign(where.value, 1, where.value.length() - 2);
+      if (sql_vector.size() == pos || sql_vector[pos] != ",") {
+        break;
+      }
+      pos++;
+      if (sql_vector.size() == pos) {
+        throw SyntaxErrorException();
+      }
     }
+  }
 
-    wheres_.push_back(where);
-    cout << where.key << " " << where.sign_type << " " << where.value << endl;
+  if (sql_vector.size() > pos + 2 && sql_vector[pos] == "order" &&
+      sql_vector[pos + 1] == "by") {
+    pos += 2;
+    while (true) {
+      SQLOrder order;
+      order.func = AGG_NONE;
+      order.desc = false;
+      if (sql_vector.size() > pos + 1 && sql_vector[pos + 1] == "(") {
+        order.func = AggregateFunction(sql_vector[pos]);
+        if (order.func == AGG_NONE || sql_vector.size() <= pos + 3 ||
+            sql_vector[pos + 3] != ")") {
+          throw SyntaxErrorException();
+        }
+        pos += 2;
+      }
+      order.key = sql_vector[pos];
+      pos += order.func == AGG_NONE ? 1 : 2;
 
-    if (sql_vector.size() == pos) {
-      break;
+      if (sql_vector.size() > pos &&
+          (sql_vector[pos] == "asc" || sql_vector[pos] == "desc")) {
+        order.desc = sql_vector[pos] == "desc";
+        pos++;
+      }
+      std::cout << "ORDER BY: " << order.key << (order.desc ? " DESC" : "")
+                << std::endl;
+      order_by_.push_back(order);
+
+      if (sql_vector.size() == pos || sql_vector[pos] != ",") {
+        break;
+      }
+      pos++;
+      if (sql_vector.size() == pos) {
+        throw SyntaxErrorException();
+      }
     }
+  }
 
-    if (sql_vector[pos] != "and") {
+  if (sql_vector.size() > pos && sql_vector[pos] == "limit") {
+    pos++;
+    if (sql_vector.size() == pos || sql_vector[pos].empty() ||
+        sql_vector[pos].size() > 9 ||
+        sql_vector[pos].find_first_not_of("0123456789") != std::string::npos) {
       throw SyntaxErrorException();
     }
+    limit_ = std::stoi(sql_vector[pos]);
+    std::cout << "LIMIT: " << limit_ << std::endl;
     pos++;
   }
+
+  if (sql_vector.size() != pos) {
+    throw SyntaxErrorException();
+  }
 }
 
 void SQLExec::Parse(std::vector<std::string> sql_vector) {
@@ -266,6 +390,56 @@ void SQLCreateIndex::Parse(std::vector<std::string> sql_vector) {
     throw SyntaxErrorException();
   }
   pos++;
+
+  if (pos < sql_vector.size() && to_lower_copy(sql_vector[pos]) == "using") {
+    pos++;
+    if (sql_vector.size() == pos) {
+      throw SyntaxErrorException();
+    }
+
+    if (to_lower_copy(sql_vector[pos]) == "hash") {
+      method_ = INDEX_HASH;
+    } else if (to_lower_copy(sql_vector[pos]) == "btree") {
+      method_ = INDEX_BTREE;
+    } else if (to_lower_copy(sql_vector[pos]) == "bloom") {
+      method_ = INDEX_BLOOM;
+    } else {
+      throw SyntaxErrorException();
+    }
+    std::cout << "INDEX TYPE: " << sql_vector[pos] << std::endl;
+    pos++;
+  }
+
+  if (pos < sql_vector.size() &&
+      to_lower_copy(sql_vector[pos]) == "include") {
+    pos++;
+    if (sql_vector.size() <= pos || sql_vector[pos] != "(") {
+      throw SyntaxErrorException();
+    }
+    pos++;
+
+    while (true) {
+      if (sql_vector.size() <= pos + 1) {
+        throw SyntaxErrorException();
+      }
+      std::cout << "INCLUDE: " << sql_vector[pos] << std::endl;
+      includes_.push_back(sql_vector[pos]);
+      pos++;
+
+      if (sql_vector[pos] == ")") {
+        pos++;
+        break;
+      }
+      if (sql_vector[pos] != ",") {
+        throw SyntaxErrorException();
+      }
+      pos++;
+    }
+  }
+
+  if (pos != sql_vector.size()) {
+    throw SyntaxErrorException();
+  }
 }
 
 void SQLInsert::Parse(std::vector<std::string> sql_vector) {
@@ -335,8 +509,9 @@ int SQL::ParseDataType(std::vector<std::string> sql_vector, Attribute &attr,
     if (sql_vector[pos] == ",") {
       pos++;
     }
-  } else if (sql_vector[pos] == "char") {
+  } else if (sql_vector[pos] == "char" || sql_vector[pos] == "varchar") {
     attr.set_data_type(T_CHAR);
+    attr.set_varying(sql_vector[pos] == "varchar");
     pos++;
     if (sql_vector[pos] == "(") {
       pos++;
@@ -520,3 +695,36 @@ void SQLUpdate::Parse(std::vector<std::string> sql_vector) {
     pos++;
   }
 }
+
+void SQLVacuum::Parse(std::vector<std::string> sql_vector) {
+  sql_type_ = 120;
+  if (sql_vector.size() <= 1) {
+    throw SyntaxErrorException();
+  } else {
+    std::cout << "TB NAME: " << sql_vector[1] << std::endl;
+    tb_name_ = sql_vector[1];
+  }
+}
+
+void SQLSet::Parse(std::vector<std::string> sql_vector) {
+  sql_type_ = 130;
+  if (sql_vector.size() != 4 || sql_vector[2] != "=") {
+    throw SyntaxErrorException();
+  }
+  name_ = boost::algorithm::to_lower_copy(sql_vector[1]);
+  value_ = boost::algorithm::to_lower_copy(sql_vector[3]);
+  if (value_.at(0) == '\'' || value_.at(0) == '\"') {
+    value_.assign(value_, 1, value_.length() - 2);
+  }
+  std::cout << "SETTING: " << name_ << " " << value_ << std::endl;
+}
+
+void SQLAnalyze::Parse(std::vector<std::string> sql_vector) {
+  sql_type_ = 140;
+  if (sql_vector.size() <= 1) {
+    throw SyntaxErrorException();
+  } else {
+    std::cout << "TB NAME: " << sql_vector[1] << std::endl;
+    tb_name_ = sql_vector[1];
+  }
+}
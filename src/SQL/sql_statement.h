@@ -3,6 +3,7 @@
 #ifndef HackyDb_SQL_STATEMENT_H_
 #define HackyDb_SQL_STATEMENT_H_
 
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -14,11 +15,27 @@ class Table;
 class Attribute;
 class Index;
 
+// Keys of up to TKEY_INLINE_BYTES are held inside the TKey itself, so the
+// INT, FLOAT and short CHAR values decoded, compared and copied for every
+// row never touch the heap; only longer CHAR keys allocate.
+#define TKEY_INLINE_BYTES 32
+
 class TKey {
 private:
   int key_type_;
-  char *key_;
   int length_;
+  char *key_;
+  alignas(8) char inline_[TKEY_INLINE_BYTES];
+
+  void Allocate() {
+    key_ = length_ <= TKEY_INLINE_BYTES ? inline_ : new char[length_];
+  }
+
+  void Release() {
+    if (key_ != inline_)
+      delete[] key_;
+    key_ = inline_;
+  }
 
 public:
   TKey(int keytype, int length) {
@@ -27,16 +44,59 @@ public:
       length_ = length;
     else
       length_ = 4;
-    key_ = new char[length_];
+    Allocate();
   }
 
   TKey(const TKey &t1) {
     key_type_ = t1.key_type_;
     length_ = t1.length_;
-    key_ = new char[length_];
+    Allocate();
     memcpy(key_, t1.key_, length_);
   }
 
+  TKey(TKey &&t1) noexcept {
+    key_type_ = t1.key_type_;
+    length_ = t1.length_;
+    if (t1.key_ == t1.inline_) {
+      key_ = inline_;
+      memcpy(key_, t1.key_, length_);
+    } else {
+      key_ = t1.key_;
+      t1.key_ = t1.inline_;
+      t1.length_ = 0;
+    }
+  }
+
+  TKey &operator=(const TKey &t1) {
+    if (this != &t1) {
+      // a key of the same length reuses its buffer
+      if (length_ != t1.length_) {
+        Release();
+        length_ = t1.length_;
+        Allocate();
+      }
+      key_type_ = t1.key_type_;
+      memcpy(key_, t1.key_, length_);
+    }
+    return *this;
+  }
+
+  TKey &operator=(TKey &&t1) noexcept {
+    if (this != &t1) {
+      Release();
+      key_type_ = t1.key_type_;
+      length_ = t1.length_;
+      if (t1.key_ == t1.inline_) {
+        memcpy(key_, t1.key_, length_);
+      } else {
+        key_ = t1.key_;
+        t1.key_ = t1.inline_;
+        t1.length_ = 0;
+      }
+    }
+    return *this;
+  }
+
   void ReadValue(const char *content) {
     switch (key_type_) {
     case 0: {
@@ -48,39 +108,23 @@ public:
       memcpy(key_, &a, length_);
     } break;
     case 2: {
-      memcpy(key_, content, length_);
+      strncpy(key_, content, length_);
     } break;
     }
   }
 
-  void ReadValue(std::string str) {
-    switch (key_type_) {
-    case 0: {
-      int a = std::atoi(str.c_str());
-      memcpy(key_, &a, length_);
-    } break;
-    case 1: {
-      float a = std::atof(str.c_str());
-      memcpy(key_, &a, length_);
-    } break;
-    case 2: {
-      memcpy(key_, str.c_str(), length_);
-    } break;
-    }
-  }
+  void ReadValue(std::string str) { ReadValue(str.c_str()); }
 
-  int key_type() { return key_type_; }
+  int key_type() const { return key_type_; }
   char *key() { return key_; };
-  int length() { return length_; }
+  const char *key() const { return key_; };
+  int length() const { return length_; }
 
-  ~TKey() {
-    if (key_ != NULL)
-      delete[] key_;
-  }
+  ~TKey() { Release(); }
 
   friend std::ostream &operator<<(std::ostream &out, const TKey &object);
 
-  bool operator<(const TKey t1) {
+  bool operator<(const TKey &t1) const {
     switch (t1.key_type_) {
     case 0:
       return *(int *)key_ < *(int *)t1.key_;
@@ -93,7 +137,7 @@ public:
     }
   }
 
-  bool operator>(const TKey t1) {
+  bool operator>(const TKey &t1) const {
     switch (t1.key_type_) {
     case 0:
       return *(int *)key_ > *(int *)t1.key_;
@@ -106,11 +150,11 @@ public:
     }
   }
 
-  bool operator<=(const TKey t1) { return !(operator>(t1)); }
+  bool operator<=(const TKey &t1) const { return !(operator>(t1)); }
 
-  bool operator>=(const TKey t1) { return !(operator<(t1)); }
+  bool operator>=(const TKey &t1) const { return !(operator<(t1)); }
 
-  bool operator==(const TKey t1) {
+  bool operator==(const TKey &t1) const {
     switch (t1.key_type_) {
     case 0:
       return *(int *)key_ == *(int *)t1.key_;
@@ -123,18 +167,7 @@ public:
     }
   }
 
-  bool operator!=(const TKey t1) {
-    switch (t1.key_type_) {
-    case 0:
-      return *(int *)key_ != *(int *)t1.key_;
-    case 1:
-      return *(float *)key_ != *(float *)t1.key_;
-    case 2:
-      return (strncmp(key_, t1.key_, length_) != 0);
-    default:
-      return false;
-    }
-  }
+  bool operator!=(const TKey &t1) const { return !(operator==(t1)); }
 };
 
 class SQL {
@@ -254,16 +287,44 @@ typedef struct {
   std::string value;
 } SQLWhere;
 
+// JOIN tb_name ON left = right
+typedef struct {
+  std::string tb_name;
+  std::string left;
+  std::string right;
+} SQLJoin;
+
+// An ORDER BY item: a column, or an aggregate of the select list.
+typedef struct {
+  std::string key;
+  int func;
+  bool desc;
+} SQLOrder;
+
 class SQLSelect : public SQL {
 private:
   std::string tb_name_;
+  std::vector<std::string> cols_; // empty for SELECT *
+  std::vector<int> funcs_;        // aggregate of each column, or AGG_NONE
+  std::vector<SQLJoin> joins_;
   std::vector<SQLWhere> wheres_;
+  std::vector<std::string> group_by_;
+  std::vector<SQLOrder> order_by_;
+  int limit_; // -1 without LIMIT
+
+  int AggregateFunction(std::string name);
 
 public:
   SQLSelect(std::vector<std::string> sql_vector) { Parse(sql_vector); }
   void Parse(std::vector<std::string> sql_vector);
   std::string tb_name() { return tb_name_; }
+  std::vector<std::string> &cols() { return cols_; }
+  std::vector<int> &funcs() { return funcs_; }
+  std::vector<SQLJoin> &joins() { return joins_; }
   std::vector<SQLWhere> &wheres() { return wheres_; }
+  std::vector<std::string> &group_by() { return group_by_; }
+  std::vector<SQLOrder> &order_by() { return order_by_; }
+  int limit() { return limit_; }
 };
 
 class SQLCreateIndex : public SQL {
@@ -271,13 +332,19 @@ private:
   std::string index_name_;
   std::string tb_name_;
   std::string col_name_;
+  int method_;
+  std::vector<std::string> includes_;
 
 public:
-  SQLCreateIndex(std::vector<std::string> sql_vector) { Parse(sql_vector); }
+  SQLCreateIndex(std::vector<std::string> sql_vector) : method_(INDEX_BTREE) {
+    Parse(sql_vector);
+  }
   void Parse(std::vector<std::string> sql_vector);
   std::string index_name() { return index_name_; }
   std::string tb_name() { return tb_name_; }
   std::string col_name() { return col_name_; }
+  int method() { return method_; }
+  std::vector<std::string> &includes() { return includes_; }
 };
 
 class SQLDelete : public SQL {
@@ -311,4 +378,36 @@ public:
   std::vector<SQLKeyValue> &keyvalues() { return keyvalues_; }
 };
 
+class SQLSet : public SQL {
+private:
+  std::string name_;
+  std::string value_;
+
+public:
+  SQLSet(std::vector<std::string> sql_vector) { Parse(sql_vector); }
+  std::string name() { return name_; }
+  std::string value() { return value_; }
+  void Parse(std::vector<std::string> sql_vector);
+};
+
+class SQLVacuum : public SQL {
+private:
+  std::string tb_name_;
+
+public:
+  SQLVacuum(std::vector<std::string> sql_vector) { Parse(sql_vector); }
+  std::string tb_name() { return tb_name_; }
+  void Parse(std::vector<std::string> sql_vector);
+};
+
+class SQLAnalyze : public SQL {
+private:
+  std::string tb_name_;
+
+public:
+  SQLAnalyze(std::vector<std::string> sql_vector) { Parse(sql_vector); }
+  std::string tb_name() { return tb_name_; }
+  void Parse(std::vector<std::string> sql_vector);
+};
+
 #endif
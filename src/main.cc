@@ -16,7 +16,7 @@ using namespace std;
 void PrintHelp() {
     std::cout << "Supported SQL Queries:\n";
     std::cout << "-----------------------\n";
-    std::cout << "1. SELECT * FROM table_name [WHERE column = value [AND ...]]\n";
+    std::cout << "1. SELECT * | column_name, ... FROM table_name [JOIN table_name ON column = column ...] [WHERE column = value [AND ...]] [GROUP BY column_name, ...] [ORDER BY column [ASC|DESC], ...] [LIMIT n]\n";
     std::cout << "2. INSERT INTO table_name VALUES (value1, value2, ...)\n";
     std::cout << "3. DELETE FROM table_name [WHERE column = value [AND ...]]\n";
     std::cout << "4. CREATE DATABASE database_name\n";
@@ -24,13 +24,19 @@ void PrintHelp() {
     std::cout << "6. USE database_name\n";
     std::cout << "7. CREATE TABLE table_name (column_name TYPE, ..., PRIMARY KEY(column_name))\n";
     std::cout << "8. DROP TABLE table_name\n";
-    std::cout << "9. CREATE INDEX index_name ON table_name(column_name)\n";
+    std::cout << "9. CREATE INDEX index_name ON table_name(column_name) [USING HASH | BLOOM] [INCLUDE (column_name, ...)]\n";
     std::cout << "10. DROP INDEX index_name\n";
     std::cout << "11. EXEC file_name\n";
+    std::cout << "12. VACUUM table_name\n";
+    std::cout << "13. SET synchronous_commit = on | off\n";
+    std::cout << "14. ANALYZE table_name\n";
     std::cout << "\nNote:\n";
-    std::cout << "- Types: INT, FLOAT, CHAR(n)\n";
-    std::cout << "- CHAR values must be enclosed in single ('') or double quotes (\"\")\n";
+    std::cout << "- Types: INT, FLOAT, CHAR(n), VARCHAR(n)\n";
+    std::cout << "- CHAR and VARCHAR values must be enclosed in single ('') or double quotes (\"\")\n";
     std::cout << "- WHERE conditions support: =, <, >, <=, >=, <>\n";
+    std::cout << "- Columns of joined tables may be written as table_name.column_name\n";
+    std::cout << "- Aggregates: COUNT(*), COUNT, SUM, AVG, MIN, MAX(column_name)\n";
+    std::cout << "- A BLOOM index may be put on any column, and lets scans for an equal value skip blocks\n";
     std::cout << std::endl;
   }
 
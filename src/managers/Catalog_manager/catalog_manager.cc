@@ -2,17 +2,168 @@
 
 #include "catalog_manager.h"
 
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <sstream>
 
 #include <boost/filesystem.hpp>
 
+#include "../../Includes/exceptions.h"
+
 using namespace std;
 
 //=======================CatalogManager=======================//
 
-CatalogManager::CatalogManager(std::string p) : path_(p) { ReadArchiveFile(); }
+CatalogManager::CatalogManager(std::string p, LogManager *log)
+    : path_(p), log_(log), size_(0), snapshot_size_(0) {
+  ReadArchiveFile();
+}
+
+// Every change is written by the statement that made it.
+CatalogManager::~CatalogManager() {}
+
+// An entry is its length, kind, database and table names, then what the
+// kind needs: a serialized table, or the first block, the count and the
+// record counts and free bytes of a run of the page directory.
+void CatalogManager::AppendEntry(std::string &entries, int kind,
+                                 std::string db_name, std::string tb_name,
+                                 const std::string &payload) {
+  int length = 12 + db_name.size() + tb_name.size() + payload.size();
+  unsigned short db_length = db_name.size();
+  unsigned short tb_length = tb_name.size();
+  entries.append((char *)&length, 4);
+  entries.append((char *)&kind, 4);
+  entries.append((char *)&db_length, 2);
+  entries.append(db_name);
+  entries.append((char *)&tb_length, 2);
+  entries.append(tb_name);
+  entries.append(payload);
+}
+
+void CatalogManager::AppendTable(std::string &entries, std::string db_name,
+                                 Table *tbl, bool all_pages) {
+  std::ostringstream oss;
+  {
+    boost::archive::binary_oarchive oar(oss);
+    oar << (*tbl);
+  }
+  AppendEntry(entries, CATALOG_TABLE, db_name, tbl->tb_name(), oss.str());
+
+  std::set<int> chunks;
+  if (all_pages) {
+    for (int i = 0; i * CATALOG_PAGE_CHUNK < tbl->pages().size(); ++i) {
+      chunks.insert(i);
+    }
+  } else {
+    chunks.swap(tbl->changed_pages());
+  }
+  tbl->changed_pages().clear();
+
+  for (std::set<int>::iterator iter = chunks.begin(); iter != chunks.end();
+       ++iter) {
+    int first = *iter * CATALOG_PAGE_CHUNK;
+    int count = std::min((int)tbl->pages().size() - first, CATALOG_PAGE_CHUNK);
+    if (count <= 0) {
+      continue;
+    }
+    std::string payload;
+    payload.append((char *)&first, 4);
+    payload.append((char *)&count, 4);
+    payload.append((char *)&tbl->pages()[first], count * 4);
+    payload.append((char *)&tbl->free_space()[first], count * 4);
+    // then the zone of each block: its number of ranges, and each range as
+    // the lengths and bytes of its least and greatest key
+    for (int i = first; i < first + count; ++i) {
+      std::vector<ZoneRange> *zone = tbl->GetZone(i);
+      unsigned short ranges = zone == NULL ? 0 : zone->size();
+      payload.append((char *)&ranges, 2);
+      for (int j = 0; j < ranges; ++j) {
+        ZoneRange &range = (*zone)[j];
+        payload.push_back((char)range.min.size());
+        payload.append(range.min);
+        payload.push_back((char)range.max.size());
+        payload.append(range.max);
+      }
+    }
+    AppendEntry(entries, CATALOG_PAGES, db_name, tbl->tb_name(), payload);
+  }
+}
+
+void CatalogManager::ReadEntry(const char *entry, int length) {
+  int kind;
+  unsigned short db_length, tb_length;
+  memcpy(&kind, entry + 4, 4);
+  memcpy(&db_length, entry + 8, 2);
+  std::string db_name(entry + 10, db_length);
+  memcpy(&tb_length, entry + 10 + db_length, 2);
+  std::string tb_name(entry + 12 + db_length, tb_length);
+  const char *payload = entry + 12 + db_length + tb_length;
+  int payload_length = length - 12 - db_length - tb_length;
+
+  Database *db = GetDB(db_name);
+  if (kind == CATALOG_DATABASE) {
+    if (db == NULL) {
+      CreateDatabase(db_name);
+    }
+    return;
+  }
+  if (kind == CATALOG_DROP_DATABASE) {
+    DeleteDatabase(db_name);
+    return;
+  }
+  if (db == NULL) {
+    return;
+  }
+
+  Table *tbl = db->GetTable(tb_name);
+  if (kind == CATALOG_TABLE) {
+    Table read;
+    std::istringstream iss(std::string(payload, payload_length));
+    boost::archive::binary_iarchive iar(iss);
+    iar >> read;
+    if (tbl != NULL) {
+      read.pages().swap(tbl->pages());
+      read.free_space().swap(tbl->free_space());
+      read.zones().swap(tbl->zones());
+    }
+    db->PutTable(read);
+  } else if (kind == CATALOG_DROP_TABLE) {
+    db->RemoveTable(tb_name);
+  } else if (kind == CATALOG_PAGES && tbl != NULL) {
+    int first, count;
+    memcpy(&first, payload, 4);
+    memcpy(&count, payload + 4, 4);
+    if (tbl->pages().size() < first + count) {
+      tbl->pages().resize(first + count);
+      tbl->free_space().resize(first + count);
+    }
+    if (tbl->zones().size() < tbl->pages().size()) {
+      tbl->zones().resize(tbl->pages().size());
+    }
+    memcpy(&tbl->pages()[first], payload + 8, count * 4);
+    memcpy(&tbl->free_space()[first], payload + 8 + count * 4, count * 4);
 
-CatalogManager::~CatalogManager() { WriteArchiveFile(); }
+    // entries written before the zone maps end here
+    const char *p = payload + 8 + count * 8;
+    for (int i = first; i < first + count && p < payload + payload_length;
+         ++i) {
+      unsigned short ranges;
+      memcpy(&ranges, p, 2);
+      p += 2;
+      std::vector<ZoneRange> &zone = tbl->zones()[i];
+      zone.resize(ranges);
+      for (int j = 0; j < ranges; ++j) {
+        unsigned char length = *p++;
+        zone[j].min.assign(p, length);
+        p += length;
+        length = *p++;
+        zone[j].max.assign(p, length);
+        p += length;
+      }
+    }
+  }
+}
 
 void CatalogManager::ReadArchiveFile() {
   std::string file_name = path_ + "catalog";
@@ -20,44 +171,132 @@ void CatalogManager::ReadArchiveFile() {
 
   file_path.imbue(std::locale("en_US.UTF-8"));
 
-  if (boost::filesystem::exists(file_path)) {
-    std::ifstream ifs;
-    ifs.open(file_name.c_str(), std::ios::binary);
-    boost::archive::binary_iarchive iar(ifs);
+  if (!boost::filesystem::exists(file_path)) {
+    return;
+  }
+
+  std::ifstream ifs(file_name.c_str(), std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(ifs)),
+                   std::istreambuf_iterator<char>());
+  ifs.close();
+
+  // a catalog from before the entries is a single archive, rewritten as a
+  // snapshot once read
+  if (data.compare(0, 8, CATALOG_MAGIC) != 0) {
+    std::istringstream iss(data);
+    boost::archive::binary_iarchive iar(iss);
     iar >> (*this);
-    ifs.close();
+    WriteArchiveFile();
+    log_->Commit();
+    return;
   }
+
+  long long pos = 8;
+  while (pos + 4 <= data.size()) {
+    int length;
+    memcpy(&length, &data[pos], 4);
+    if (length < 12 || pos + length > data.size()) {
+      break;
+    }
+    ReadEntry(&data[pos], length);
+    pos += length;
+  }
+
+  // the directory keeps no blocks a table has dropped since
+  for (std::list<Database>::iterator db = dbs_.begin(); db != dbs_.end();
+       ++db) {
+    for (std::list<Table>::iterator tbl = db->tbs().begin();
+         tbl != db->tbs().end(); ++tbl) {
+      if (tbl->pages().size() > tbl->block_count()) {
+        tbl->DropBlocks(tbl->block_count());
+      }
+    }
+  }
+  size_ = data.size();
+  snapshot_size_ = data.size();
 }
 
 void CatalogManager::WriteArchiveFile() {
-  std::string file_name = path_ + "catalog";
+  std::string entries(CATALOG_MAGIC);
+  for (std::list<Database>::iterator db = dbs_.begin(); db != dbs_.end();
+       ++db) {
+    AppendEntry(entries, CATALOG_DATABASE, db->db_name(), "", "");
+    for (std::list<Table>::iterator tbl = db->tbs().begin();
+         tbl != db->tbs().end(); ++tbl) {
+      AppendTable(entries, db->db_name(), &(*tbl), true);
+    }
+  }
+  log_->AppendWrite("catalog", 0, entries.data(), entries.size());
+  size_ = entries.size();
+  snapshot_size_ = entries.size();
+}
 
-  std::ofstream ofs;
-  ofs.open(file_name.c_str(), std::ios::binary);
-  boost::archive::binary_oarchive oar(ofs);
-  oar << (*this);
-  ofs.close();
+// The entries are appended to the catalog through the write-ahead log, so
+// they are on disk once their statement commits, and in the file after the
+// next checkpoint.
+void CatalogManager::WriteEntries(const std::string &entries) {
+  if (size_ == 0 ||
+      size_ + entries.size() > 2 * snapshot_size_ + CATALOG_COMPACT_BYTES) {
+    WriteArchiveFile();
+    return;
+  }
+  log_->AppendWrite("catalog", size_, entries.data(), entries.size());
+  size_ += entries.size();
+}
+
+void CatalogManager::WriteDatabase(std::string db_name) {
+  std::string entries;
+  AppendEntry(entries,
+              GetDB(db_name) == NULL ? CATALOG_DROP_DATABASE
+                                     : CATALOG_DATABASE,
+              db_name, "", "");
+  WriteEntries(entries);
+}
+
+void CatalogManager::WriteTable(std::string db_name, std::string tb_name) {
+  std::string entries;
+  Database *db = GetDB(db_name);
+  Table *tbl = db == NULL ? NULL : db->GetTable(tb_name);
+  if (tbl == NULL) {
+    AppendEntry(entries, CATALOG_DROP_TABLE, db_name, tb_name, "");
+  } else {
+    AppendTable(entries, db_name, tbl, false);
+  }
+  WriteEntries(entries);
+}
+
+void CatalogManager::MapDatabases() {
+  db_names_.clear();
+  for (std::list<Database>::iterator db = dbs_.begin(); db != dbs_.end();
+       ++db) {
+    db_names_[db->db_name()] = &(*db);
+  }
 }
 
 void CatalogManager::CreateDatabase(std::string dbname) {
   dbs_.push_back(Database(dbname));
+  db_names_[dbname] = &dbs_.back();
 }
 
 void CatalogManager::DeleteDatabase(std::string dbname) {
-  for (unsigned int i = 0; i < dbs_.size(); i++) {
-    if (dbs_[i].db_name() == dbname) {
-      dbs_.erase(dbs_.begin() + i);
+  Database *db = GetDB(dbname);
+  if (db == NULL) {
+    return;
+  }
+  db_names_.erase(dbname);
+  for (std::list<Database>::iterator iter = dbs_.begin(); iter != dbs_.end();
+       ++iter) {
+    if (&(*iter) == db) {
+      dbs_.erase(iter);
+      return;
     }
   }
 }
 
 Database *CatalogManager::GetDB(std::string db_name) {
-  for (unsigned int i = 0; i < dbs_.size(); ++i) {
-    if (dbs_[i].db_name() == db_name) {
-      return &dbs_[i];
-    }
-  }
-  return NULL;
+  std::unordered_map<std::string, Database *>::iterator iter =
+      db_names_.find(db_name);
+  return iter == db_names_.end() ? NULL : iter->second;
 }
 
 //=======================Database=============================//
@@ -66,75 +305,132 @@ Database::Database(std::string dbname) : db_name_(dbname) {}
 
 void Database::CreateTable(SQLCreateTable &st) {
   int record_length = 0;
+  int stored_length = 4; // the slot
   Table tb;
   for (int i = 0; i < st.attrs().size(); ++i) {
     tb.AddAttribute(st.attrs()[i]);
     record_length += st.attrs()[i].length();
+    stored_length += st.attrs()[i].length();
+    if (st.attrs()[i].varying()) {
+      stored_length += 2;
+    }
+  }
+  // the longest record must fit in an empty block
+  if (stored_length > 4096 - 12) {
+    throw RecordTooLargeException();
   }
   tb.set_tb_name(st.tb_name());
   tb.set_record_length(record_length);
-  tbs_.push_back(tb);
+  PutTable(tb);
+}
+
+void Database::MapTables() {
+  tb_names_.clear();
+  for (list<Table>::iterator tbl = tbs_.begin(); tbl != tbs_.end(); ++tbl) {
+    tb_names_[tbl->tb_name()] = &(*tbl);
+  }
+}
+
+Table *Database::PutTable(Table &tbl) {
+  Table *old = GetTable(tbl.tb_name());
+  if (old != NULL) {
+    *old = tbl;
+    return old;
+  }
+  tbs_.push_back(tbl);
+  tb_names_[tbl.tb_name()] = &tbs_.back();
+  return &tbs_.back();
 }
 
-void Database::DropTable(SQLDropTable &st) {
-  vector<Table>::iterator i;
-  for (i = tbs_.begin(); i != tbs_.end(); i++) {
-    if (i->tb_name() == st.tb_name()) {
+void Database::RemoveTable(std::string tb_name) {
+  Table *tbl = GetTable(tb_name);
+  if (tbl == NULL) {
+    return;
+  }
+  tb_names_.erase(tb_name);
+  for (list<Table>::iterator i = tbs_.begin(); i != tbs_.end(); i++) {
+    if (&(*i) == tbl) {
       tbs_.erase(i);
       return;
     }
   }
 }
 
+void Database::DropTable(SQLDropTable &st) { RemoveTable(st.tb_name()); }
+
 void Database::DropIndex(SQLDropIndex &st) {
-  for (int i = 0; i < tbs_.size(); i++) {
-    for (vector<Index>::iterator j = tbs_[i].ids().begin();
-         j < tbs_[i].ids().end(); j++) {
-      if (j->name() == st.idx_name()) {
-        tbs_[i].ids().erase(j);
-        return;
-      }
+  Table *tbl = GetIndexTable(st.idx_name());
+  if (tbl == NULL) {
+    return;
+  }
+  for (list<Index>::iterator j = tbl->ids().begin(); j != tbl->ids().end();
+       j++) {
+    if (j->name() == st.idx_name()) {
+      tbl->ids().erase(j);
+      return;
     }
   }
 }
 
 Table *Database::GetTable(std::string tb_name) {
-  for (unsigned int i = 0; i < tbs_.size(); ++i) {
-    if (tbs_[i].tb_name() == tb_name) {
-      return &tbs_[i];
+  unordered_map<string, Table *>::iterator iter = tb_names_.find(tb_name);
+  return iter == tb_names_.end() ? NULL : iter->second;
+}
+
+Table *Database::GetIndexTable(std::string index_name) {
+  for (list<Table>::iterator tbl = tbs_.begin(); tbl != tbs_.end(); ++tbl) {
+    for (list<Index>::iterator idx = tbl->ids().begin();
+         idx != tbl->ids().end(); ++idx) {
+      if (idx->name() == index_name) {
+        return &(*tbl);
+      }
     }
   }
   return NULL;
 }
 
 bool Database::CheckIfIndexExists(std::string index_name) {
-  bool exists = false;
-  for (unsigned int i = 0; i < tbs_.size(); ++i) {
-    for (unsigned int j = 0; j < tbs_[i].ids().size(); ++j) {
-      if (tbs_[i].ids()[j].name() == index_name) {
-        exists = true;
-      }
-    }
-  }
-  return exists;
+  return GetIndexTable(index_name) != NULL;
 }
 
 //=======================Table===============================//
 
-Attribute *Table::GetAttribute(std::string name) {
+void Table::MapAttributes() {
+  attr_names_.clear();
   for (unsigned int i = 0; i < ats_.size(); ++i) {
-    if (ats_[i].attr_name() == name) {
-      return &ats_[i];
+    attr_names_[ats_[i].attr_name()] = i;
+  }
+}
+
+void Table::AddAttribute(Attribute &attr) {
+  attr_names_[attr.attr_name()] = ats_.size();
+  ats_.push_back(attr);
+}
+
+Index *Table::GetLookupIndex() {
+  for (list<Index>::iterator i = ids_.begin(); i != ids_.end(); ++i) {
+    if (i->method() != INDEX_BLOOM) {
+      return &(*i);
     }
   }
   return NULL;
 }
 
+Attribute *Table::GetAttribute(std::string name) {
+  int i = GetAttributeIndex(name);
+  return i == -1 ? NULL : &ats_[i];
+}
+
 int Table::GetAttributeIndex(std::string name) {
+  unordered_map<string, int>::iterator iter = attr_names_.find(name);
+  return iter == attr_names_.end() ? -1 : iter->second;
+}
+
+bool Table::IsFixedLength() {
   for (unsigned int i = 0; i < ats_.size(); ++i) {
-    if (ats_[i].attr_name() == name) {
-      return i;
+    if (ats_[i].varying()) {
+      return false;
     }
   }
-  return -1;
+  return true;
 }
\ No newline at end of file
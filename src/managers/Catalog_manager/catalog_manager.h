@@ -3,16 +3,49 @@
 #ifndef HackyDb_CATALOG_MANAGER_H_
 #define HackyDb_CATALOG_MANAGER_H_
 
+#include <algorithm>
+#include <list>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/list.hpp>
 #include <boost/serialization/utility.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/version.hpp>
+
+#include "../../Core/Log/Log_manager/log_manager.h"
+#include "../../Includes/commons.h"
 
 #include "../../SQL/sql_statement.h"
 
+// The catalog file is a log of entries, each replacing or dropping one
+// database, table or run of the page directory. Only the entries of what
+// a statement changed are appended, and once the file holds more than
+// twice its last snapshot it is rewritten as a new one.
+#define CATALOG_MAGIC "HDBCAT01"
+#define CATALOG_PAGE_CHUNK 256 // page directory entries per catalog entry
+#define CATALOG_COMPACT_BYTES (64 * 1024)
+
+#define ZONE_KEY_BYTES 16 // the longest CHAR prefix a zone map keeps
+
+// Catalog Entry Kind
+#define CATALOG_DATABASE 1
+#define CATALOG_DROP_DATABASE 2
+#define CATALOG_TABLE 3
+#define CATALOG_DROP_TABLE 4
+#define CATALOG_PAGES 5
+
+// The least and greatest key of one column in one block, as the KeyBytes
+// of the keys. CHAR keys are cut to ZONE_KEY_BYTES.
+typedef struct {
+  std::string min;
+  std::string max;
+} ZoneRange;
+
 class Database;
 class Table;
 class Attribute;
@@ -21,6 +54,11 @@ class SQLCreateTable;
 class SQLDropTable;
 class SQLDropIndex;
 
+// Databases, tables and indexes are kept in lists, so a pointer to one
+// stays valid until it is dropped and can be held across statements.
+// Databases, tables and columns are found by name through hash maps beside
+// them. Lists are archived as vectors are, so older catalogs read
+// unchanged.
 class CatalogManager {
 private:
   friend class boost::serialization::access;
@@ -28,18 +66,39 @@ private:
   template <class Archive>
   void serialize(Archive &ar, const unsigned int version) {
     ar &dbs_;
+    if (Archive::is_loading::value) {
+      MapDatabases();
+    }
   }
   std::string path_;
-  std::vector<Database> dbs_;
+  LogManager *log_;
+  std::list<Database> dbs_;
+  std::unordered_map<std::string, Database *> db_names_;
+  long long size_;          // the length of the catalog file
+  long long snapshot_size_; // the length of its last snapshot
+
+  void MapDatabases();
+  void ReadEntry(const char *entry, int length);
+  void AppendEntry(std::string &entries, int kind, std::string db_name,
+                   std::string tb_name, const std::string &payload);
+  void AppendTable(std::string &entries, std::string db_name, Table *tbl,
+                   bool all_pages);
+  void WriteEntries(const std::string &entries);
 
 public:
-  CatalogManager(std::string p);
+  CatalogManager(std::string p, LogManager *log);
   ~CatalogManager();
-  std::vector<Database> &dbs() { return dbs_; }
+  std::list<Database> &dbs() { return dbs_; }
   std::string path() { return path_; }
   Database *GetDB(std::string db_name);
   void ReadArchiveFile();
+  // Writes a snapshot of the whole catalog.
   void WriteArchiveFile();
+  // Writes the entry of a database, or drops it if it is gone.
+  void WriteDatabase(std::string db_name);
+  // Writes the entry of a table and the runs of its page directory that
+  // changed, or drops it if it is gone.
+  void WriteTable(std::string db_name, std::string tb_name);
   void CreateDatabase(std::string dbname);
   void DeleteDatabase(std::string dbname);
 };
@@ -52,21 +111,42 @@ private:
   void serialize(Archive &ar, const unsigned int version) {
     ar &db_name_;
     ar &tbs_;
+    if (Archive::is_loading::value) {
+      MapTables();
+    }
   }
   std::string db_name_;
-  std::vector<Table> tbs_;
+  std::list<Table> tbs_;
+  std::unordered_map<std::string, Table *> tb_names_;
+
+  void MapTables();
 
 public:
   Database() {}
   Database(std::string dbname);
+  // a copy maps its own tables
+  Database(const Database &db) : db_name_(db.db_name_), tbs_(db.tbs_) {
+    MapTables();
+  }
+  Database &operator=(const Database &db) {
+    db_name_ = db.db_name_;
+    tbs_ = db.tbs_;
+    MapTables();
+    return *this;
+  }
   ~Database() {}
   Table *GetTable(std::string tb_name);
   std::string db_name() { return db_name_; }
   void CreateTable(SQLCreateTable &st);
+  // Adds a copy of the table, or replaces the table of the same name in
+  // place, and returns it.
+  Table *PutTable(Table &tbl);
+  void RemoveTable(std::string tb_name);
   void DropTable(SQLDropTable &st);
   void DropIndex(SQLDropIndex &st);
-  std::vector<Table> &tbs() { return tbs_; }
+  std::list<Table> &tbs() { return tbs_; }
   bool CheckIfIndexExists(std::string index_name);
+  Table *GetIndexTable(std::string index_name);
 };
 
 class Table {
@@ -77,52 +157,157 @@ private:
   void serialize(Archive &ar, const unsigned int version) {
     ar &tb_name_;
     ar &record_length_;
-    ar &first_block_num_;
-    ar &first_rubbish_num_;
+    if (version == 0) {
+      // the heads of the used and rubbish block chains
+      int first_block_num, first_rubbish_num;
+      ar &first_block_num;
+      ar &first_rubbish_num;
+    }
     ar &block_count_;
     ar &ats_;
     ar &ids_;
+    if (Archive::is_loading::value) {
+      MapAttributes();
+    }
+    // since version 3 the page directory has catalog entries of its own
+    if (version > 0 && version < 3) {
+      ar &pages_;
+    } else if (version == 0) {
+      pages_.clear(); // rebuilt by RecordManager::MigrateTables
+    }
+    if (Archive::is_loading::value) {
+      zones_.assign(pages_.size(), std::vector<ZoneRange>());
+    }
+    if (version > 1) {
+      ar &format_;
+    } else {
+      format_ = TABLE_FORMAT_FIXED;
+    }
+    if (version == 2) {
+      ar &free_;
+    } else if (version < 2) {
+      free_.clear();
+    }
+    if (version > 3) {
+      ar &analyzed_rows_;
+    } else {
+      analyzed_rows_ = -1;
+    }
   }
 
   std::string tb_name_;
   int record_length_;
-
-  int first_block_num_;
-  int first_rubbish_num_;
   int block_count_;
+  int format_;
+  long long analyzed_rows_; // the rows at the last ANALYZE, -1 if none
 
   std::vector<Attribute> ats_;
-  std::vector<Index> ids_;
+  std::list<Index> ids_;
+  std::unordered_map<std::string, int> attr_names_; // the column numbers
+
+  // The page directory: the number of records in each block of the table
+  // file, by block number. Blocks with none are free for reuse.
+  std::vector<int> pages_;
+  // The bytes free in each block, so inserts find room without reading it.
+  std::vector<int> free_;
+  // The zone map: the range of each column in each block, by block number.
+  // Blocks with no ranges have not been summed up and are never skipped.
+  std::vector<std::vector<ZoneRange> > zones_;
+  // The runs of CATALOG_PAGE_CHUNK blocks whose directory entries changed
+  // since the catalog last wrote them.
+  std::set<int> changed_pages_;
+
+  void MapAttributes();
 
 public:
   Table()
-      : tb_name_(""), record_length_(-1), first_block_num_(-1),
-        first_rubbish_num_(-1), block_count_(0) {}
+      : tb_name_(""), record_length_(-1), block_count_(0),
+        format_(TABLE_FORMAT_CURRENT), analyzed_rows_(-1) {}
   ~Table() {}
 
   std::string tb_name() { return tb_name_; }
   void set_tb_name(std::string tbname) { tb_name_ = tbname; }
 
+  // The length of a decoded record, with every column at a fixed offset.
   int record_length() { return record_length_; }
   void set_record_length(int len) { record_length_ = len; }
 
+  int format() { return format_; }
+  void set_format(int format) { format_ = format; }
+  // True if records are stored as they are decoded, with no VARCHAR.
+  bool IsFixedLength();
+
   std::vector<Attribute> &ats() { return ats_; }
   Attribute *GetAttribute(std::string name);
   int GetAttributeIndex(std::string name);
 
-  int first_block_num() { return first_block_num_; }
-  void set_first_block_num(int num) { first_block_num_ = num; }
-  int first_rubbish_num() { return first_rubbish_num_; }
-  void set_first_rubbish_num(int num) { first_rubbish_num_ = num; }
   int block_count() { return block_count_; }
+  std::vector<int> &pages() { return pages_; }
+  std::vector<int> &free_space() { return free_; }
+  std::set<int> &changed_pages() { return changed_pages_; }
+  // The records in the table now, from the page directory.
+  long long CountRecords() {
+    long long count = 0;
+    for (int i = 0; i < block_count_; ++i) {
+      count += pages_[i];
+    }
+    return count;
+  }
+
+  // True once ANALYZE has stored statistics for the columns.
+  bool analyzed() { return analyzed_rows_ >= 0; }
+  long long analyzed_rows() { return analyzed_rows_; }
+  void set_analyzed_rows(long long rows) { analyzed_rows_ = rows; }
+  void SetPage(int block_num, int records, int free) {
+    pages_[block_num] = records;
+    free_[block_num] = free;
+    changed_pages_.insert(block_num / CATALOG_PAGE_CHUNK);
+  }
+
+  std::vector<std::vector<ZoneRange> > &zones() { return zones_; }
+  // The column ranges of a block, or NULL if it has none.
+  std::vector<ZoneRange> *GetZone(int block_num) {
+    if (block_num >= zones_.size() || zones_[block_num].empty()) {
+      return NULL;
+    }
+    return &zones_[block_num];
+  }
+  void SetZone(int block_num, std::vector<ZoneRange> &zone) {
+    if (zones_.size() <= block_num) {
+      zones_.resize(block_num + 1);
+    }
+    zones_[block_num] = zone;
+    changed_pages_.insert(block_num / CATALOG_PAGE_CHUNK);
+  }
 
   unsigned long GetAttributeNum() { return ats_.size(); }
-  void AddAttribute(Attribute &attr) { ats_.push_back(attr); }
-  void IncreaseBlockCount() { block_count_++; }
+  void AddAttribute(Attribute &attr);
+  // Appends an empty block to the table file and returns its number.
+  int AddBlock() {
+    pages_.push_back(0);
+    free_.push_back(4096 - 12);
+    zones_.resize(pages_.size());
+    changed_pages_.insert(block_count_ / CATALOG_PAGE_CHUNK);
+    return block_count_++;
+  }
+  // Forgets the blocks from first on, once the file is cut down to them.
+  void DropBlocks(int first) {
+    pages_.resize(first);
+    free_.resize(first);
+    zones_.resize(std::min((int)zones_.size(), first));
+    block_count_ = first;
+  }
 
-  std::vector<Index> &ids() { return ids_; }
-  Index *GetIndex(int num) { return &(ids_[num]); }
+  std::list<Index> &ids() { return ids_; }
+  Index *GetIndex(int num) {
+    std::list<Index>::iterator iter = ids_.begin();
+    std::advance(iter, num);
+    return &(*iter);
+  }
   unsigned long GetIndexNum() { return ids_.size(); }
+  // The index records can be looked up by key through, which any but a
+  // Bloom filter is; NULL if there is none.
+  Index *GetLookupIndex();
   void AddIndex(Index &idx) { ids_.push_back(idx); }
 };
 
@@ -136,15 +321,39 @@ private:
     ar &data_type_;
     ar &length_;
     ar &attr_type_;
+    if (version > 0) {
+      ar &varying_;
+    } else {
+      varying_ = false;
+    }
+    if (version > 1) {
+      ar &distinct_;
+      ar &min_;
+      ar &max_;
+      ar &bounds_;
+    } else {
+      distinct_ = -1;
+    }
   }
 
   std::string attr_name_;
   int data_type_;
   int length_;
   int attr_type_;
+  bool varying_; // VARCHAR, a CHAR stored without its padding
+
+  // Statistics from ANALYZE. Keys are kept as their KeyBytes.
+  double distinct_; // -1 if never analyzed
+  std::string min_;
+  std::string max_;
+  // The bounds of the equi-depth histogram: each of the buckets between
+  // two neighbouring bounds holds about as many rows as the others.
+  std::vector<std::string> bounds_;
 
 public:
-  Attribute() : attr_name_(""), data_type_(-1), length_(-1), attr_type_(0) {}
+  Attribute()
+      : attr_name_(""), data_type_(-1), length_(-1), attr_type_(0),
+        varying_(false), distinct_(-1) {}
   ~Attribute() {}
 
   std::string attr_name() { return attr_name_; }
@@ -159,6 +368,21 @@ public:
 
   void set_length(int length) { length_ = length; }
   int length() { return length_; }
+
+  bool varying() { return varying_; }
+  void set_varying(bool varying) { varying_ = varying; }
+
+  double distinct() { return distinct_; }
+  std::string &min_value() { return min_; }
+  std::string &max_value() { return max_; }
+  std::vector<std::string> &bounds() { return bounds_; }
+  void set_statistics(double distinct, std::string min, std::string max,
+                      std::vector<std::string> bounds) {
+    distinct_ = distinct;
+    min_ = min;
+    max_ = max;
+    bounds_ = bounds;
+  }
 };
 
 class Index {
@@ -179,6 +403,23 @@ private:
     ar &key_count_;
     ar &level_;
     ar &node_count_;
+    if (version > 0) {
+      ar &format_;
+    } else {
+      format_ = INDEX_FORMAT_LEGACY;
+    }
+    if (version > 1) {
+      ar &method_;
+    } else {
+      method_ = INDEX_BTREE;
+    }
+    if (version > 2) {
+      ar &includes_;
+      ar &include_len_;
+    } else {
+      includes_.clear();
+      include_len_ = 0;
+    }
   }
   int max_count_;
   int key_len_;
@@ -190,13 +431,18 @@ private:
   int key_count_;
   int level_;
   int node_count_;
+  int format_;
+  int method_;
+  int include_len_;
   std::string attr_name_;
   std::string name_;
+  std::vector<std::string> includes_;
 
 public:
-  Index() {}
+  Index()
+      : format_(INDEX_FORMAT_CURRENT), method_(INDEX_BTREE), include_len_(0) {}
   Index(std::string name, std::string attr_name, int keytype, int keylen,
-        int rank) {
+        int rank, int method = INDEX_BTREE) {
     attr_name_ = attr_name;
     name_ = name;
     key_count_ = 0;
@@ -209,6 +455,9 @@ public:
     rank_ = rank;
     rubbish_ = -1;
     max_count_ = 0;
+    format_ = INDEX_FORMAT_CURRENT;
+    method_ = method;
+    include_len_ = 0;
   }
 
   // accessors and mutators
@@ -237,6 +486,25 @@ public:
 
   std::string name() { return name_; }
 
+  int format() { return format_; }
+
+  int method() { return method_; }
+
+  // Columns copied into every index entry after the key, and their total
+  // length in bytes.
+  std::vector<std::string> &includes() { return includes_; }
+  int include_len() { return include_len_; }
+  void set_includes(std::vector<std::string> includes, int include_len) {
+    includes_ = includes;
+    include_len_ = include_len;
+  }
+
+  // True if the column can be read from the index without the record.
+  bool Covers(std::string col) {
+    return col == attr_name_ ||
+           find(includes_.begin(), includes_.end(), col) != includes_.end();
+  }
+
   int IncreaseMaxCount() { return max_count_++; }
   int IncreaseKeyCount() { return key_count_++; }
   int IncreaseNodeCount() { return node_count_++; }
@@ -246,4 +514,8 @@ public:
   int DecreaseLevel() { return level_--; }
 };
 
+BOOST_CLASS_VERSION(Table, 4)
+BOOST_CLASS_VERSION(Attribute, 2)
+BOOST_CLASS_VERSION(Index, 3)
+
 #endif
@@ -1,18 +1,50 @@
 #include "index_manager.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <thread>
 
 #include "../../Includes/commons.h"
 
 #include "../../Includes/exceptions.h"
 #include "../Record_manager/record_manager.h"
+#include "../../Executor/Operators/parallel.h"
 #include "../../SQL/sql_statement.h"
 
 using namespace std;
 
 //=======================IndexManager=======================//
 
+// Slots hold an 8-byte value (child block or record id) plus the key and
+// the included columns.
+static int IndexRank(int entry_len) {
+  return (4 * 1024 - 12) / (8 + entry_len) / 2 - 1;
+}
+
+// Hash buckets hold as many entries as fit behind the 12-byte header.
+static int HashBucketCapacity(int entry_len) {
+  return (4 * 1024 - 12) / (8 + entry_len);
+}
+
+static int MethodRank(int method, int entry_len) {
+  if (method == INDEX_BLOOM) {
+    return BLOOM_HASHES;
+  }
+  return method == INDEX_HASH ? HashBucketCapacity(entry_len)
+                              : IndexRank(entry_len);
+}
+
+std::string IndexPayload(Table *tbl, Index *idx, std::vector<TKey> &values) {
+  string payload;
+  for (unsigned int i = 0; i < idx->includes().size(); ++i) {
+    int col = tbl->GetAttributeIndex(idx->includes()[i]);
+    payload.append(values[col].key(), tbl->ats()[col].length());
+  }
+  return payload;
+}
+
 void IndexManager::CreateIndex(SQLCreateIndex &st) {
   string tb_name = st.tb_name();
 
@@ -22,185 +54,414 @@ void IndexManager::CreateIndex(SQLCreateIndex &st) {
     throw TableNotExistException();
   }
 
-  if (tbl->GetIndexNum() != 0) {
+  // Bloom filters go on any column, beside the one index on the key
+  bool bloom = st.method() == INDEX_BLOOM;
+  if (!bloom && tbl->GetLookupIndex() != NULL) {
     throw OneIndexEachTableException();
   }
 
   Attribute *attr = tbl->GetAttribute(st.col_name());
-  if (attr->attr_type() != 1) {
+  if (attr == NULL) {
+    throw AttributeNotExistException();
+  }
+  if (!bloom && attr->attr_type() != 1) {
     throw IndexMustBeCreatedOnPKException();
   }
 
-  string file_name = cm_->path() + db_name_ + "/" + st.index_name() + ".index";
-  std::ofstream ofs(file_name.c_str(), std::ios::binary);
-  ofs.close();
+  vector<string> &includes = st.includes();
+  if (bloom && !includes.empty()) {
+    throw SyntaxErrorException();
+  }
+  int include_len = 0;
+  for (unsigned int i = 0; i < includes.size(); ++i) {
+    Attribute *inc = tbl->GetAttribute(includes[i]);
+    if (inc == NULL) {
+      throw AttributeNotExistException();
+    }
+    if (includes[i] == st.col_name() ||
+        find(includes.begin(), includes.begin() + i, includes[i]) !=
+            includes.begin() + i) {
+      throw SyntaxErrorException();
+    }
+    include_len += inc->length();
+  }
 
+  int rank = MethodRank(st.method(), attr->length() + include_len);
+  if (rank < 1) {
+    throw IndexEntryTooLargeException();
+  }
   Index idx(st.index_name(), st.col_name(), attr->data_type(), attr->length(),
-            (4 * 1024 - 12) / (4 + attr->length()) / 2 - 1);
+            rank, st.method());
+  idx.set_includes(includes, include_len);
 
   tbl->AddIndex(idx);
+  Index *added = &tbl->ids().back();
 
-  BPlusTree tree(tbl->GetIndex(0), hdl_, cm_, db_name_);
+  BuildIndex(tbl, added);
 
-  RecordManager *rm = new RecordManager(cm_, hdl_, db_name_);
+  cm_->WriteTable(db_name_, tbl->tb_name());
+  hdl_->Commit();
 
-  int col_idx = tbl->GetAttributeIndex(st.col_name());
+  IndexMethod *im = IndexMethod::Open(added, hdl_, cm_, db_name_);
+  im->Print();
+  delete im;
+}
 
-  int block_num = tbl->first_block_num();
-  for (int i = 0; i < tbl->block_count(); ++i) {
-    BlockInfo *bp = rm->GetBlockInfo(tbl, block_num);
+// A large table fills a B+ tree on several threads, each adding the
+// records of the morsels it takes through a concurrent BPlusTree of its own.
+void IndexManager::BuildIndex(Table *tbl, Index *idx) {
+  string file_name = cm_->path() + db_name_ + "/" + idx->name() + ".index";
+  std::ofstream ofs(file_name.c_str(), std::ios::binary);
+  ofs.close();
 
-    for (int j = 0; j < bp->GetRecordCount(); ++j) {
-      vector<TKey> tkey_value = rm->GetRecord(tbl, block_num, j);
-      tree.Add(tkey_value[col_idx], block_num, j);
+  int threads = 1;
+  if (idx->method() == INDEX_BTREE) {
+    threads = ScanThreads(tbl->block_count());
+  }
+  MorselSource source(tbl->block_count());
+  if (threads == 1) {
+    AddRecords(tbl, idx, &source, false);
+    return;
+  }
+  vector<thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.push_back(
+        thread(&IndexManager::AddRecords, this, tbl, idx, &source, true));
+  }
+  for (int i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+}
+
+// Adds every record in the morsels taken from source to the index.
+void IndexManager::AddRecords(Table *tbl, Index *idx, MorselSource *source,
+                              bool concurrent) {
+  IndexMethod *im = IndexMethod::Open(idx, hdl_, cm_, db_name_, concurrent);
+  RecordManager rm(cm_, hdl_, db_name_);
+  int col_idx = tbl->GetAttributeIndex(idx->attr_name());
+
+  int first, last;
+  while (source->Take(first, last)) {
+    for (int i = first; i < last; ++i) {
+      if (tbl->pages()[i] == 0) {
+        continue;
+      }
+      // pinned, as adding to the index reads index blocks into the buffer
+      BlockInfo *bp = hdl_->PinFileBlock(db_name_, tbl->tb_name(), 0, i);
+      for (int j = 0; j < bp->GetRecordCount(); ++j) {
+        if (bp->IsFreeSlot(j)) {
+          continue;
+        }
+        vector<TKey> tkey_value = rm.GetRecord(tbl, i, j);
+        string payload = IndexPayload(tbl, idx, tkey_value);
+        im->Add(tkey_value[col_idx], i, j, payload.data());
+      }
+      hdl_->UnpinBlock(bp);
     }
+  }
 
-    block_num = bp->GetNextBlockNum();
+  delete im;
+}
+
+// Starts an index over, in the current format, and adds every record of
+// the table to it.
+void IndexManager::RebuildIndex(Table *tbl, Index *idx) {
+  vector<string> includes = idx->includes();
+  int include_len = idx->include_len();
+  int rank = MethodRank(idx->method(), idx->key_len() + include_len);
+  *idx = Index(idx->name(), idx->attr_name(), idx->key_type(), idx->key_len(),
+               rank, idx->method());
+  idx->set_includes(includes, include_len);
+  BuildIndex(tbl, idx);
+}
+
+// Indexes written in an older format are rebuilt from the table records:
+// legacy ones pack (block << 16 | offset) into 4-byte slots, and RID64 ones
+// use fixed-width inner nodes.
+void IndexManager::MigrateIndexes() {
+  Database *db = cm_->GetDB(db_name_);
+  bool migrated = false;
+
+  for (std::list<Table>::iterator iter = db->tbs().begin();
+       iter != db->tbs().end(); ++iter) {
+    Table *tbl = &(*iter);
+    for (unsigned int j = 0; j < tbl->GetIndexNum(); ++j) {
+      Index *idx = tbl->GetIndex(j);
+      if (idx->format() == INDEX_FORMAT_CURRENT) {
+        continue;
+      }
+
+      std::cout << "Migrating index: " << idx->name() << std::endl;
+      RebuildIndex(tbl, idx);
+      migrated = true;
+    }
   }
 
-  delete rm;
+  if (migrated) {
+    cm_->WriteArchiveFile();
+    hdl_->Commit();
+  }
+}
 
-  hdl_->WriteToDisk();
-  cm_->WriteArchiveFile();
+//=======================IndexMethod=======================//
 
-  tree.Print();
+IndexMethod *IndexMethod::Open(Index *idx, BufferManager *hdl,
+                               CatalogManager *cm, std::string db_name,
+                               bool concurrent) {
+  if (idx->method() == INDEX_HASH) {
+    return new HashIndex(idx, hdl, cm, db_name);
+  }
+  if (idx->method() == INDEX_BLOOM) {
+    return new BloomIndex(idx, hdl, cm, db_name);
+  }
+  return new BPlusTree(idx, hdl, cm, db_name, concurrent);
 }
 
 //=======================BPlusTree=======================//
 
+// Inner nodes separate their children with keys where child i holds the keys
+// below separator i and child i + 1 the keys at or above it. That lets a
+// separator be any key in between rather than a copy of a stored one, so
+// CHAR separators are cut to the shortest distinguishing prefix (suffix
+// truncation) and the prefix shared by a node's separators is stored once
+// (prefix compression). Inner nodes are therefore variable length and split
+// by size; leaves keep fixed slots and split by count.
+
 void BPlusTree::InitTree() {
   BPlusTreeNode *root_node =
       new BPlusTreeNode(true, this, GetNewBlockNum(), true);
-  idx_->set_root(0);
+  idx_->set_root(root_node->block_num());
   idx_->set_leaf_head(idx_->root());
   idx_->set_key_count(0);
   idx_->set_node_count(1);
   idx_->set_level(1);
   root_node->SetNextLeaf(-1);
+  delete root_node;
 }
 
-bool BPlusTree::Add(TKey &key, int block_num, int offset) {
-  int value = (block_num << 16) | offset;
+bool BPlusTree::Add(TKey &key, int block_num, int offset,
+                    const char *payload) {
+  long long value = MakeRid(block_num, offset);
+
+  if (concurrent_) {
+    return ConcurrentWrite(key, value, payload, true);
+  }
 
   if (idx_->root() == -1) {
     InitTree();
   }
 
   FindNodeParam fnp = Search(idx_->root(), key);
+  bool ret = AddToLeaf(fnp, key, value, payload);
+  delete fnp.pnode;
+  return ret;
+}
 
-  if (!fnp.flag) {
-    fnp.pnode->Add(key, value);
-    idx_->IncreaseKeyCount();
+bool BPlusTree::AddToLeaf(FindNodeParam &fnp, TKey &key, long long value,
+                          const char *payload) {
+  if (fnp.flag) {
+    return false;
+  }
 
-    if (fnp.pnode->GetCount() == degree_) {
-      return AdjustAfterAdd(fnp.pnode->block_num());
-    }
+  fnp.pnode->Add(key, value, payload);
+  CountKeys(1);
 
-    return true;
+  if (fnp.pnode->GetCount() == degree_) {
+    return AdjustAfterAdd(fnp.pnode->block_num());
   }
-
-  return false;
+  return true;
 }
 
+// Splits a full leaf and pushes the separator up, splitting inner nodes on
+// the way as long as they overflow.
 bool BPlusTree::AdjustAfterAdd(int node) {
   BPlusTreeNode *pnode = GetNode(node);
-  TKey key(idx()->key_type(), idx()->key_len());
+  TKey key(idx_->key_type(), idx_->key_len());
   BPlusTreeNode *newnode = pnode->Split(key);
-  idx_->IncreaseNodeCount();
-  int parent = pnode->GetParent();
+  CountNodes(1);
+
+  bool ret = InsertIntoParent(pnode, key, newnode);
+  delete pnode;
+  delete newnode;
+  return ret;
+}
+
+bool BPlusTree::InsertIntoParent(BPlusTreeNode *left, TKey &key,
+                                 BPlusTreeNode *right) {
+  int parent = left->GetParent();
 
   if (parent == -1) {
     BPlusTreeNode *newroot = new BPlusTreeNode(true, this, GetNewBlockNum());
-    if (newroot == NULL)
-      return false;
-
-    idx_->IncreaseNodeCount();
+    CountNodes(1);
     idx_->set_root(newroot->block_num());
 
-    newroot->Add(key);
-
-    newroot->SetValues(0, pnode->block_num());
-    newroot->SetValues(1, newnode->block_num());
+    vector<TKey> keys(1, key);
+    vector<int> children;
+    children.push_back(left->block_num());
+    children.push_back(right->block_num());
+    newroot->Store(keys, children);
 
-    pnode->SetParent(idx_->root());
-    newnode->SetParent(idx_->root());
-    newnode->SetNextLeaf(-1);
+    left->SetParent(newroot->block_num());
+    right->SetParent(newroot->block_num());
     idx_->IncreaseLevel();
+    delete newroot;
     return true;
-  } else {
-    BPlusTreeNode *parentnode = GetNode(parent);
-    int index = parentnode->Add(key);
+  }
 
-    parentnode->SetValues(index, pnode->block_num());
-    parentnode->SetValues(index + 1, newnode->block_num());
+  BPlusTreeNode *parentnode = GetNode(parent);
+  vector<TKey> keys;
+  vector<int> children;
+  parentnode->Load(keys, children);
 
-    if (parentnode->GetCount() == degree_) {
-      return AdjustAfterAdd(parentnode->block_num());
-    }
-    return true;
+  int pos = find(children.begin(), children.end(), left->block_num()) -
+            children.begin();
+  keys.insert(keys.begin() + pos, key);
+  children.insert(children.begin() + pos + 1, right->block_num());
+  right->SetParent(parent);
+
+  bool ret = true;
+  if (!parentnode->Store(keys, children)) {
+    ret = SplitInner(parentnode, keys, children);
   }
+  delete parentnode;
+  return ret;
 }
 
-FindNodeParam BPlusTree::Search(int node, TKey &key) {
-  FindNodeParam ret;
-  int index = 0;
-  BPlusTreeNode *pnode = GetNode(node);
-  if (pnode->Search(key, index)) {
-    if (pnode->GetIsLeaf()) {
-      ret.flag = true;
-      ret.index = index;
-      ret.pnode = pnode;
-    } else {
-      pnode = GetNode(pnode->GetValues(index));
-      while (!pnode->GetIsLeaf()) {
-        pnode = GetNode(pnode->GetValues(pnode->GetCount()));
-      }
-      ret.flag = true;
-      ret.index = pnode->GetCount() - 1;
-      ret.pnode = pnode;
-    }
-  } else {
-    if (pnode->GetIsLeaf()) {
-      ret.flag = false;
-      ret.index = index;
-      ret.pnode = pnode;
-    } else {
-      return Search(pnode->GetValues(index), key);
-    }
+// Writes an overflowing inner node back as two nodes of about equal size
+// and moves the middle separator up.
+bool BPlusTree::SplitInner(BPlusTreeNode *pnode, vector<TKey> &keys,
+                           vector<int> &children) {
+  int mid = SplitPoint(keys);
+
+  BPlusTreeNode *newnode = new BPlusTreeNode(true, this, GetNewBlockNum());
+  CountNodes(1);
+  newnode->SetParent(pnode->GetParent());
+
+  vector<TKey> lkeys(keys.begin(), keys.begin() + mid);
+  vector<int> lchildren(children.begin(), children.begin() + mid + 1);
+  vector<TKey> rkeys(keys.begin() + mid + 1, keys.end());
+  vector<int> rchildren(children.begin() + mid + 1, children.end());
+
+  if (!pnode->Store(lkeys, lchildren) || !newnode->Store(rkeys, rchildren)) {
+    throw BPlusTreeException();
   }
 
+  for (unsigned int i = 0; i < rchildren.size(); ++i) {
+    BPlusTreeNode *child = GetNode(rchildren[i]);
+    child->SetParent(newnode->block_num());
+    delete child;
+  }
+
+  TKey up = keys[mid];
+  bool ret = InsertIntoParent(pnode, up, newnode);
+  delete newnode;
   return ret;
 }
 
-FindNodeParam BPlusTree::SearchBranch(int node, TKey &key) {
+// Picks the separator to move up when splitting an inner node: the one that
+// halves the encoded size, kept away from both ends.
+int BPlusTree::SplitPoint(vector<TKey> &keys) {
+  int n = keys.size();
+  int total = 0;
+  for (int i = 0; i < n; ++i) {
+    total += KeyLength(keys[i]);
+  }
+
+  int mid = 0;
+  int sum = 0;
+  while (mid < n - 1 && sum + KeyLength(keys[mid]) < total / 2) {
+    sum += KeyLength(keys[mid]);
+    mid++;
+  }
+
+  if (n >= 3) {
+    mid = max(1, min(mid, n - 2));
+  }
+  return mid;
+}
+
+// Significant bytes of a key: CHAR keys end at their terminator.
+int BPlusTree::KeyLength(TKey &key) {
+  if (idx_->key_type() == T_CHAR) {
+    return strnlen(key.key(), idx_->key_len());
+  }
+  return idx_->key_len();
+}
+
+// Returns the shortest key s with left < s <= right.
+TKey BPlusTree::Separator(TKey &left, TKey &right) {
+  if (idx_->key_type() != T_CHAR) {
+    return right;
+  }
+
+  TKey sep(idx_->key_type(), idx_->key_len());
+  memset(sep.key(), 0, idx_->key_len());
+
+  int len = 0;
+  while (len < idx_->key_len() && left.key()[len] == right.key()[len] &&
+         right.key()[len] != 0) {
+    len++;
+  }
+  memcpy(sep.key(), right.key(), min(len + 1, idx_->key_len()));
+  return sep;
+}
+
+FindNodeParam BPlusTree::Search(int node, TKey &key) {
   FindNodeParam ret;
-  int index = 0;
   BPlusTreeNode *pnode = GetNode(node);
 
-  if (pnode->GetIsLeaf()) {
-    throw BPlusTreeException();
-  }
-  if (pnode->Search(key, index)) {
-    ret.flag = true;
-    ret.index = index;
-    ret.pnode = pnode;
-  } else {
-    if (!GetNode(pnode->GetValues(index))->GetIsLeaf()) {
-      ret = SearchBranch(pnode->GetValues(index), key);
-    } else {
-      ret.index = index;
-      ret.flag = false;
-      ret.pnode = pnode;
-    }
+  while (!pnode->GetIsLeaf()) {
+    int child = pnode->GetChild(pnode->FindChild(key));
+    delete pnode;
+    pnode = GetNode(child);
   }
+
+  ret.flag = pnode->Search(key, ret.index);
+  ret.pnode = pnode;
   return ret;
 }
 
 BPlusTreeNode *BPlusTree::GetNode(int num) {
+  if (concurrent_ &&
+      find(held_.begin(), held_.end(), num) == held_.end()) {
+    Lock(num);
+  }
   BPlusTreeNode *pnode = new BPlusTreeNode(false, this, num);
   return pnode;
 }
 
+int BPlusTree::GetNewBlockNum() {
+  if (!concurrent_) {
+    return idx_->IncreaseMaxCount();
+  }
+
+  int num;
+  {
+    lock_guard<mutex> guard(latches_->mutex());
+    num = idx_->IncreaseMaxCount();
+  }
+  Lock(num);
+  return num;
+}
+
+void BPlusTree::CountKeys(int delta) {
+  if (concurrent_) {
+    lock_guard<mutex> guard(latches_->mutex());
+    idx_->set_key_count(idx_->key_count() + delta);
+  } else {
+    idx_->set_key_count(idx_->key_count() + delta);
+  }
+}
+
+void BPlusTree::CountNodes(int delta) {
+  if (concurrent_) {
+    lock_guard<mutex> guard(latches_->mutex());
+    idx_->set_node_count(idx_->node_count() + delta);
+  } else {
+    idx_->set_node_count(idx_->node_count() + delta);
+  }
+}
+
 void BPlusTree::Print() {
   printf("*****************************************************\n");
   printf("KeyCount: %d, NodeCount: %d, Level: %d, Root: %d \n",
@@ -216,247 +477,460 @@ void BPlusTree::PrintNode(int num) {
 
   pnode->Print();
   if (!pnode->GetIsLeaf()) {
-
     for (int i = 0; i <= pnode->GetCount(); i++) {
-      PrintNode(pnode->GetValues(i));
+      PrintNode(pnode->GetChild(i));
     }
   }
+  delete pnode;
 }
 
-int BPlusTree::GetVal(TKey key) {
-  int ret = -1;
+long long BPlusTree::GetVal(TKey key, char *payload) {
+  if (concurrent_) {
+    return ConcurrentGetVal(key, payload);
+  }
+
+  long long ret = -1;
+  if (idx_->root() == -1) {
+    return ret;
+  }
   FindNodeParam fnp = Search(idx_->root(), key);
   if (fnp.flag) {
     ret = fnp.pnode->GetValues(fnp.index);
+    if (payload != NULL) {
+      memcpy(payload, fnp.pnode->GetPayload(fnp.index), idx_->include_len());
+    }
   }
+  delete fnp.pnode;
   return ret;
 }
 
+int BPlusTree::FirstLeaf() {
+  int num = idx_->root();
+  if (num == -1) {
+    return -1;
+  }
+
+  BPlusTreeNode *pnode = GetNode(num);
+  while (!pnode->GetIsLeaf()) {
+    num = pnode->GetChild(0);
+    delete pnode;
+    pnode = GetNode(num);
+  }
+  delete pnode;
+  return num;
+}
+
+int BPlusTree::LastLeaf() {
+  int num = idx_->root();
+  if (num == -1) {
+    return -1;
+  }
+
+  BPlusTreeNode *pnode = GetNode(num);
+  while (!pnode->GetIsLeaf()) {
+    num = pnode->GetChild(pnode->GetCount());
+    delete pnode;
+    pnode = GetNode(num);
+  }
+  delete pnode;
+  return num;
+}
+
 bool BPlusTree::Remove(TKey key) {
+  if (concurrent_) {
+    return ConcurrentWrite(key, -1, NULL, false);
+  }
 
   if (idx_->root() == -1)
     return false;
 
-  BPlusTreeNode *rootnode = GetNode(idx_->root());
   FindNodeParam fnp = Search(idx_->root(), key);
+  bool ret = RemoveFromLeaf(fnp);
+  delete fnp.pnode;
+  return ret;
+}
 
-  if (fnp.flag) {
-    if (idx_->root() == fnp.pnode->block_num()) {
-      rootnode->RemoveAt(fnp.index);
-      idx_->DecreaseKeyCount();
-      AdjustAfterRemove(fnp.pnode->block_num());
-      return true;
-    }
-
-    if (fnp.index == fnp.pnode->GetCount() - 1) {
-      FindNodeParam fnpb = SearchBranch(idx_->root(), key);
-      if (fnpb.flag) {
-        fnpb.pnode->SetKeys(fnpb.index,
-                            fnp.pnode->GetKeys(fnp.pnode->GetCount() - 2));
-      }
-    }
-
-    fnp.pnode->RemoveAt(fnp.index);
-    idx_->DecreaseKeyCount();
-    AdjustAfterRemove(fnp.pnode->block_num());
-    return true;
+bool BPlusTree::RemoveFromLeaf(FindNodeParam &fnp) {
+  if (!fnp.flag) {
+    return false;
   }
-  return false;
+
+  // separators only bound their subtrees, so none need to change here
+  fnp.pnode->RemoveAt(fnp.index);
+  CountKeys(-1);
+  AdjustAfterRemove(fnp.pnode->block_num());
+  return true;
 }
 
+// Refills an underfull node from a sibling: the two are merged when the
+// result fits in one node and evenly redistributed otherwise.
 bool BPlusTree::AdjustAfterRemove(int node) {
   BPlusTreeNode *pnode = GetNode(node);
-  if (pnode->GetCount() >= idx_->rank()) {
-    return true;
-  }
 
   if (pnode->IsRoot()) {
     if (pnode->GetCount() == 0) {
       if (!pnode->GetIsLeaf()) {
-        idx_->set_root(pnode->GetValues(0));
-        GetNode(pnode->GetValues(0))->SetParent(-1);
+        idx_->set_root(pnode->GetChild(0));
+        BPlusTreeNode *child = GetNode(pnode->GetChild(0));
+        child->SetParent(-1);
+        delete child;
       } else {
         idx_->set_root(-1);
         idx_->set_leaf_head(-1);
       }
-      delete pnode;
-      idx_->DecreaseNodeCount();
+      CountNodes(-1);
       idx_->DecreaseLevel();
     }
+    delete pnode;
     return true;
   }
 
-  BPlusTreeNode *pbrother;
-  BPlusTreeNode *pparent;
-  int pos;
-
-  pparent = GetNode(pnode->GetParent());
-  pparent->Search(pnode->GetKeys(0), pos);
-
-  if (pos == pparent->GetCount()) {
-    pbrother = GetNode(pparent->GetValues(pos - 1));
-
-    if (pbrother->GetCount() > idx_->rank()) {
+  if (!pnode->Underflow()) {
+    delete pnode;
+    return true;
+  }
 
-      if (pnode->GetIsLeaf()) {
+  BPlusTreeNode *pparent = GetNode(pnode->GetParent());
+  vector<TKey> pkeys;
+  vector<int> pchildren;
+  pparent->Load(pkeys, pchildren);
 
-        for (int i = pnode->GetCount(); i > 0; i--) {
-          pnode->SetKeys(i, pnode->GetKeys(i - 1));
-          pnode->SetValues(i, pnode->GetValues(i - 1));
-        }
+  int pos = find(pchildren.begin(), pchildren.end(), node) - pchildren.begin();
+  int sep = pos < (int)pkeys.size() ? pos : pos - 1;
 
-        pnode->SetKeys(0, pbrother->GetKeys(pbrother->GetCount() - 1));
-        pnode->SetValues(0, pbrother->GetValues(pbrother->GetCount() - 1));
+  BPlusTreeNode *left = pos == sep ? pnode : GetNode(pchildren[sep]);
+  BPlusTreeNode *right = pos == sep ? GetNode(pchildren[sep + 1]) : pnode;
 
-        pnode->SetCount(pnode->GetCount() + 1);
-
-        pbrother->SetCount(pbrother->GetCount() - 1);
+  bool merged;
+  if (pnode->GetIsLeaf()) {
+    merged = BalanceLeaves(left, right, pkeys[sep]);
+  } else {
+    merged = BalanceInner(left, right, pkeys[sep]);
+  }
 
-        pparent->SetKeys(pos - 1, pbrother->GetKeys(pbrother->GetCount() - 1));
+  if (merged) {
+    pkeys.erase(pkeys.begin() + sep);
+    pchildren.erase(pchildren.begin() + sep + 1);
+    CountNodes(-1);
+  }
 
-        return true;
-      } else {
+  delete left;
+  delete right;
 
-        for (int i = pnode->GetCount(); i > 0; i--) {
-          pnode->SetKeys(i, pnode->GetKeys(i - 1));
-        }
-        for (int i = pnode->GetCount() + 1; i > 0; i--) {
-          pnode->SetValues(i, pnode->GetValues(i - 1));
-        }
+  bool ret = true;
+  if (!pparent->Store(pkeys, pchildren)) {
+    // a longer separator no longer fits
+    ret = SplitInner(pparent, pkeys, pchildren);
+  } else if (merged) {
+    ret = AdjustAfterRemove(pparent->block_num());
+  }
+  delete pparent;
+  return ret;
+}
 
-        pnode->SetKeys(0, pparent->GetKeys(pos - 1));
-        pparent->SetKeys(pos - 1, pbrother->GetKeys(pbrother->GetCount() - 1));
+// Returns true if right was merged into left; otherwise the entries are
+// split evenly and sep is set to the new separator.
+bool BPlusTree::BalanceLeaves(BPlusTreeNode *left, BPlusTreeNode *right,
+                              TKey &sep) {
+  int lcount = left->GetCount();
+  int rcount = right->GetCount();
+
+  if (lcount + rcount < degree_) {
+    left->CopyEntries(lcount, right, 0, rcount);
+    left->SetCount(lcount + rcount);
+    left->SetNextLeaf(right->GetNextLeaf());
+    return true;
+  }
 
-        pnode->SetValues(0, pbrother->GetValues(pbrother->GetCount()));
-        pnode->SetCount(pnode->GetCount() + 1);
+  int target = (lcount + rcount) / 2;
+  if (lcount < target) {
+    int moved = target - lcount;
+    left->CopyEntries(lcount, right, 0, moved);
+    right->CopyEntries(0, right, moved, rcount - moved);
+    left->SetCount(target);
+    right->SetCount(rcount - moved);
+  } else {
+    int moved = lcount - target;
+    right->CopyEntries(moved, right, 0, rcount);
+    right->CopyEntries(0, left, target, moved);
+    left->SetCount(target);
+    right->SetCount(rcount + moved);
+  }
 
-        if (pbrother->GetValues(pbrother->GetCount()) >= 0) {
+  TKey lkey = left->GetKeys(left->GetCount() - 1);
+  TKey rkey = right->GetKeys(0);
+  sep = Separator(lkey, rkey);
+  return false;
+}
 
-          GetNode(pbrother->GetValues(pbrother->GetCount()))
-              ->SetParent(pnode->block_num());
-          pbrother->SetValues(pbrother->GetCount(), -1);
-        }
-        pbrother->SetCount(pbrother->GetCount() - 1);
-        return true;
-      }
-    } else {
+bool BPlusTree::BalanceInner(BPlusTreeNode *left, BPlusTreeNode *right,
+                             TKey &sep) {
+  vector<TKey> lkeys, rkeys;
+  vector<int> lchildren, rchildren;
+  left->Load(lkeys, lchildren);
+  right->Load(rkeys, rchildren);
+
+  vector<TKey> keys(lkeys);
+  keys.push_back(sep);
+  keys.insert(keys.end(), rkeys.begin(), rkeys.end());
+  vector<int> children(lchildren);
+  children.insert(children.end(), rchildren.begin(), rchildren.end());
+
+  if (left->Store(keys, children)) {
+    for (unsigned int i = 0; i < rchildren.size(); ++i) {
+      BPlusTreeNode *child = GetNode(rchildren[i]);
+      child->SetParent(left->block_num());
+      delete child;
+    }
+    return true;
+  }
 
-      if (pnode->GetIsLeaf()) {
-        pparent->RemoveAt(pos - 1);
-        pparent->SetValues(pos - 1, pbrother->block_num());
+  int mid = SplitPoint(keys);
+  vector<TKey> nlkeys(keys.begin(), keys.begin() + mid);
+  vector<int> nlchildren(children.begin(), children.begin() + mid + 1);
+  vector<TKey> nrkeys(keys.begin() + mid + 1, keys.end());
+  vector<int> nrchildren(children.begin() + mid + 1, children.end());
 
-        for (int i = 0; i < pnode->GetCount(); i++) {
-          pbrother->SetKeys(pbrother->GetCount() + i, pnode->GetKeys(i));
-          pbrother->SetValues(pbrother->GetCount() + i, pnode->GetValues(i));
-          pnode->SetValues(i, -1);
-        }
+  if (!left->Store(nlkeys, nlchildren) || !right->Store(nrkeys, nrchildren)) {
+    throw BPlusTreeException();
+  }
 
-        pbrother->SetCount(pbrother->GetCount() + pnode->GetCount());
-        pbrother->SetNextLeaf(pnode->GetNextLeaf());
-        delete pnode;
-        idx_->DecreaseNodeCount();
+  for (int i = 0; i < (int)children.size(); ++i) {
+    bool was_left = i < (int)lchildren.size();
+    bool is_left = i < (int)nlchildren.size();
+    if (was_left != is_left) {
+      BPlusTreeNode *child = GetNode(children[i]);
+      child->SetParent(is_left ? left->block_num() : right->block_num());
+      delete child;
+    }
+  }
 
-        return AdjustAfterRemove(pparent->block_num());
-      } else {
-        pbrother->SetKeys(pbrother->GetCount(), pparent->GetKeys(pos - 1));
-        pbrother->SetCount(pbrother->GetCount() + 1);
-        pparent->RemoveAt(pos - 1);
-        pparent->SetValues(pos - 1, pbrother->block_num());
-        for (int i = 0; i < pnode->GetCount(); i++) {
-          pbrother->SetKeys(pbrother->GetCount() + i, pnode->GetKeys(i));
-        }
+  sep = keys[mid];
+  return false;
+}
 
-        for (int i = 0; i <= pnode->GetCount(); i++) {
-          pbrother->SetValues(pbrother->GetCount() + i, pnode->GetValues(i));
-          GetNode(pnode->GetValues(i))->SetParent(pbrother->block_num());
-        }
+//=======================Concurrent BPlusTree=======================//
 
-        pbrother->SetCount(2 * idx_->rank());
+// Readers and writers first walk down optimistically: each node is copied
+// out of the buffer and its latch version checked afterwards, so a copy
+// taken while a writer held the node is thrown away and the walk restarts.
 
-        delete pnode;
-        idx_->DecreaseNodeCount();
+long long BPlusTree::ConcurrentGetVal(TKey &key, char *payload) {
+  char buffer[4 * 1024];
 
-        return AdjustAfterRemove(pparent->block_num());
-      }
+  while (true) {
+    int num;
+    NodeLatch *parent;
+    uint64_t pv;
+    if (!Descend(key, num, parent, pv, buffer)) {
+      latches_->CountRestart();
+      continue;
+    }
+    if (num == -1) {
+      return -1;
     }
 
-  } else {
-    pbrother = GetNode(pparent->GetValues(pos + 1));
+    BPlusTreeNode leaf(this, num, buffer);
+    int index;
+    if (!leaf.Search(key, index)) {
+      return -1;
+    }
+    if (payload != NULL) {
+      memcpy(payload, leaf.GetPayload(index), idx_->include_len());
+    }
+    return leaf.GetValues(index);
+  }
+}
 
-    if (pbrother->GetCount() > idx_->rank()) {
+bool BPlusTree::ConcurrentWrite(TKey &key, long long value,
+                                const char *payload, bool insert) {
+  bool ret;
+  if (!OptimisticWrite(key, value, payload, insert, ret)) {
+    ret = PessimisticWrite(key, value, payload, insert);
+  }
+  return ret;
+}
 
-      if (pnode->GetIsLeaf()) {
-        pparent->SetKeys(pos, pbrother->GetKeys(0));
-        pnode->SetKeys(pnode->GetCount(), pbrother->GetKeys(0));
-        pnode->SetValues(pnode->GetCount(), pbrother->GetValues(0));
-        pbrother->SetValues(0, -1);
-        pnode->SetCount(pnode->GetCount() + 1);
+// Latches only the leaf. Returns false, changing nothing, if the leaf would
+// have to split or merge.
+bool BPlusTree::OptimisticWrite(TKey &key, long long value,
+                                const char *payload, bool insert,
+                                bool &ret) {
+  char buffer[4 * 1024];
+
+  while (true) {
+    int num;
+    NodeLatch *parent;
+    uint64_t pv;
+    if (!Descend(key, num, parent, pv, buffer)) {
+      latches_->CountRestart();
+      continue;
+    }
+    if (num == -1) {
+      ret = false;
+      return !insert;
+    }
 
-        pbrother->RemoveAt(0);
+    Lock(num);
+    // the leaf still covers key as long as its parent did not change
+    if (!parent->Validate(pv)) {
+      ReleaseAll();
+      latches_->CountRestart();
+      continue;
+    }
 
-        return true;
-      } else {
+    FindNodeParam fnp;
+    fnp.pnode = GetNode(num);
+    fnp.flag = fnp.pnode->Search(key, fnp.index);
+
+    bool done = true;
+    if (insert == fnp.flag) {
+      ret = false;
+    } else if (!fnp.pnode->Safe(insert)) {
+      done = false;
+    } else if (insert) {
+      ret = AddToLeaf(fnp, key, value, payload);
+    } else {
+      ret = RemoveFromLeaf(fnp);
+    }
 
-        pnode->SetKeys(pnode->GetCount(), pparent->GetKeys(pos));
-        pnode->SetValues(pnode->GetCount() + 1, pbrother->GetValues(0));
-        pnode->SetCount(pnode->GetCount() + 1);
-        pparent->SetKeys(pos, pbrother->GetKeys(0));
-        GetNode(pbrother->GetValues(0))->SetParent(pnode->block_num());
+    delete fnp.pnode;
+    ReleaseAll();
+    return done;
+  }
+}
 
-        pbrother->RemoveAt(0);
-        return true;
-      }
-    } else {
+// Latch crabbing: write latches are taken from the root down, and all the
+// ones above a node that can take the change without splitting or merging
+// are released. AdjustAfterAdd and AdjustAfterRemove then only reach latched
+// nodes, plus siblings and children that GetNode latches on the way.
+bool BPlusTree::PessimisticWrite(TKey &key, long long value,
+                                 const char *payload, bool insert) {
+  latches_->tree()->WriteLock();
+  tree_held_ = true;
 
-      if (pnode->GetIsLeaf()) {
+  if (idx_->root() == -1) {
+    if (!insert) {
+      ReleaseAll();
+      return false;
+    }
+    InitTree();
+  }
 
-        for (int i = 0; i < idx_->rank(); i++) {
+  int num = idx_->root();
+  BPlusTreeNode *pnode = GetNode(num);
 
-          pnode->SetKeys(pnode->GetCount() + i, pbrother->GetKeys(i));
-          pnode->SetValues(pnode->GetCount() + i, pbrother->GetValues(i));
-          pbrother->SetValues(i, -1);
-        }
+  while (true) {
+    if (pnode->Safe(insert)) {
+      ReleaseAbove(num);
+    }
+    if (pnode->GetIsLeaf()) {
+      break;
+    }
+    num = pnode->GetChild(pnode->FindChild(key));
+    delete pnode;
+    pnode = GetNode(num);
+  }
 
-        pnode->SetCount(pnode->GetCount() + idx_->rank());
-        delete pbrother;
-        idx_->DecreaseNodeCount();
+  FindNodeParam fnp;
+  fnp.pnode = pnode;
+  fnp.flag = pnode->Search(key, fnp.index);
 
-        pparent->RemoveAt(pos);
-        pparent->SetValues(pos, pnode->block_num());
-        return AdjustAfterRemove(pparent->block_num());
-      } else {
+  bool ret;
+  if (insert) {
+    ret = AddToLeaf(fnp, key, value, payload);
+  } else {
+    ret = RemoveFromLeaf(fnp);
+  }
 
-        pnode->SetKeys(pnode->GetCount(), pparent->GetKeys(pos));
+  delete pnode;
+  ReleaseAll();
+  return ret;
+}
 
-        pparent->RemoveAt(pos);
+// Walks to the leaf that may hold key. On success num is the leaf, or -1 if
+// the tree is empty, buffer holds a validated copy of it and parent is the
+// latch, at version pv, of the node that pointed to it. Returns false if a
+// writer got in the way.
+bool BPlusTree::Descend(TKey &key, int &num, NodeLatch *&parent,
+                        uint64_t &pv, char *buffer) {
+  parent = latches_->tree();
+  pv = parent->ReadLock();
+  num = idx_->root();
+
+  while (num != -1) {
+    NodeLatch *latch = latches_->node(num);
+    uint64_t v = latch->ReadLock();
+    if (!parent->Validate(pv)) {
+      return false;
+    }
 
-        pparent->SetValues(pos, pnode->block_num());
+    ReadNode(num, buffer);
+    if (!latch->Validate(v)) {
+      return false;
+    }
 
-        pnode->SetCount(pnode->GetCount() + 1);
-        for (int i = 0; i < idx_->rank(); i++) {
-          pnode->SetKeys(pnode->GetCount() + i, pbrother->GetKeys(i));
-        }
+    BPlusTreeNode node(this, num, buffer);
+    if (node.GetIsLeaf()) {
+      return true;
+    }
+    num = node.GetChild(node.FindChild(key));
+    parent = latch;
+    pv = v;
+  }
+  return parent->Validate(pv);
+}
 
-        for (int i = 0; i <= idx_->rank(); i++) {
-          pnode->SetValues(pnode->GetCount() + i, pbrother->GetValues(i));
-          GetNode(pbrother->GetValues(i))->SetParent(pnode->block_num());
-        }
+void BPlusTree::ReadNode(int num, char *buffer) {
+  BlockInfo *block =
+      hdl_->PinFileBlock(db_name_, idx_->name(), FORMAT_INDEX, num);
+  memcpy(buffer, block->data(), 4 * 1024);
+  hdl_->UnpinBlock(block);
+}
 
-        pnode->SetCount(pnode->GetCount() + idx_->rank());
-        delete pbrother;
-        idx_->DecreaseNodeCount();
+void BPlusTree::Lock(int num) {
+  latches_->node(num)->WriteLock();
+  held_.push_back(num);
+}
 
-        return AdjustAfterRemove(pparent->block_num());
-      }
+// Releases the root latch and every node latch except the one on num.
+void BPlusTree::ReleaseAbove(int num) {
+  if (tree_held_) {
+    latches_->tree()->WriteUnlock();
+    tree_held_ = false;
+  }
+  for (unsigned int i = 0; i < held_.size(); ++i) {
+    if (held_[i] != num) {
+      latches_->node(held_[i])->WriteUnlock();
     }
   }
+  held_.assign(1, num);
+}
+
+void BPlusTree::ReleaseAll() {
+  if (tree_held_) {
+    latches_->tree()->WriteUnlock();
+    tree_held_ = false;
+  }
+  for (unsigned int i = 0; i < held_.size(); ++i) {
+    latches_->node(held_[i])->WriteUnlock();
+  }
+  held_.clear();
 }
 
 //=======================BPlusTreeNode=======================//
 
+// Leaf:  type | count | parent |
+//        count x (8-byte record id, key, included columns) | next leaf
+// Inner: type | count | parent | prefix length | prefix |
+//        (count + 1) x 4-byte child | count x 2-byte offset | separators,
+//        each a 2-byte length followed by the bytes after the prefix
+
+#define INNER_HEADER 16
+
 BPlusTreeNode::BPlusTreeNode(bool isnew, BPlusTree *tree, int blocknum,
                              bool newleaf)
-    : tree_(tree) {
+    : tree_(tree), block_(NULL) {
   is_leaf_ = newleaf;
   rank_ = (tree_->degree() - 1) / 2;
   block_num_ = blocknum;
@@ -465,6 +939,21 @@ BPlusTreeNode::BPlusTreeNode(bool isnew, BPlusTree *tree, int blocknum,
     SetParent(-1);
     SetNodeType(newleaf ? 1 : 0);
     SetCount(0);
+    if (!newleaf) {
+      *((int *)(&buffer_[12])) = 0;
+    }
+  }
+}
+
+BPlusTreeNode::BPlusTreeNode(BPlusTree *tree, int blocknum, char *buffer)
+    : tree_(tree), block_num_(blocknum), buffer_(buffer), block_(NULL) {
+  rank_ = (tree_->degree() - 1) / 2;
+  is_leaf_ = GetIsLeaf();
+}
+
+BPlusTreeNode::~BPlusTreeNode() {
+  if (block_ != NULL) {
+    tree_->hdl()->UnpinBlock(block_);
   }
 }
 
@@ -472,28 +961,49 @@ bool BPlusTreeNode::GetIsLeaf() { return GetNodeType() == 1; }
 
 TKey BPlusTreeNode::GetKeys(int index) {
   TKey k(tree_->idx()->key_type(), tree_->idx()->key_len());
+
+  if (!GetIsLeaf()) {
+    int prefix = GetPrefixLength();
+    int off = GetSeparatorOffsets()[index];
+    int len = *((unsigned short *)(&buffer_[off]));
+    memset(k.key(), 0, tree_->idx()->key_len());
+    memcpy(k.key(), &buffer_[INNER_HEADER], prefix);
+    memcpy(k.key() + prefix, &buffer_[off + 2], len);
+    return k;
+  }
+
   int base = 12;
-  int lenr = 4 + tree_->idx()->key_len();
-  memcpy(k.key(), &buffer_[base + index * lenr + 4], tree_->idx()->key_len());
+  int lenr = GetEntryLength();
+  memcpy(k.key(), &buffer_[base + index * lenr + 8], tree_->idx()->key_len());
   return k;
 }
 
-int BPlusTreeNode::GetValues(int index) {
-  int val;
+long long BPlusTreeNode::GetValues(int index) {
+  long long val;
   int base = 12;
-  int lenR = 4 + tree_->idx()->key_len();
-  val = *((int *)(&buffer_[base + index * lenR]));
+  int lenR = GetEntryLength();
+  val = *((long long *)(&buffer_[base + index * lenR]));
   return val;
 }
 
+char *BPlusTreeNode::GetPayload(int index) {
+  int base = 12;
+  int lenr = GetEntryLength();
+  return &buffer_[base + index * lenr + 8 + tree_->idx()->key_len()];
+}
+
 int BPlusTreeNode::GetNextLeaf() {
   int val;
   int base = 12;
-  int lenR = 4 + tree_->idx()->key_len();
+  int lenR = GetEntryLength();
   val = *((int *)(&buffer_[base + tree_->degree() * lenR]));
   return val;
 }
 
+int BPlusTreeNode::GetEntryLength() {
+  return 8 + tree_->idx()->key_len() + tree_->idx()->include_len();
+}
+
 int BPlusTreeNode::GetParent() {
   int val;
   val = *((int *)(&buffer_[8]));
@@ -508,40 +1018,212 @@ int BPlusTreeNode::GetNodeType() {
 
 int BPlusTreeNode::GetCount() { return *((int *)(&buffer_[4])); }
 
-void BPlusTreeNode::SetKeys(int index, TKey key) {
+int BPlusTreeNode::GetPrefixLength() { return *((int *)(&buffer_[12])); }
+
+int BPlusTreeNode::GetChild(int index) {
+  return *((int *)(&buffer_[INNER_HEADER + GetPrefixLength() + index * 4]));
+}
+
+unsigned short *BPlusTreeNode::GetSeparatorOffsets() {
+  return (unsigned short *)(&buffer_[INNER_HEADER + GetPrefixLength() +
+                                     (GetCount() + 1) * 4]);
+}
+
+// Bytes in use by an inner node.
+int BPlusTreeNode::GetSize() {
+  int count = GetCount();
+  if (count == 0) {
+    return INNER_HEADER + GetPrefixLength() + 4;
+  }
+  int off = GetSeparatorOffsets()[count - 1];
+  return off + 2 + *((unsigned short *)(&buffer_[off]));
+}
+
+// Decodes an inner node.
+void BPlusTreeNode::Load(vector<TKey> &keys, vector<int> &children) {
+  keys.clear();
+  children.clear();
+  for (int i = 0; i < GetCount(); ++i) {
+    keys.push_back(GetKeys(i));
+  }
+  for (int i = 0; i <= GetCount(); ++i) {
+    children.push_back(GetChild(i));
+  }
+}
+
+// Encodes an inner node. Returns false, leaving the node untouched, if the
+// entries do not fit in a block.
+bool BPlusTreeNode::Store(vector<TKey> &keys, vector<int> &children) {
+  int count = keys.size();
+  vector<int> lens;
+  for (int i = 0; i < count; ++i) {
+    lens.push_back(tree_->KeyLength(keys[i]));
+  }
+
+  int prefix = 0;
+  if (tree_->idx()->key_type() == T_CHAR && count > 0) {
+    prefix = lens[0];
+    for (int i = 1; i < count; ++i) {
+      int p = 0;
+      while (p < prefix && p < lens[i] && keys[0].key()[p] == keys[i].key()[p]) {
+        p++;
+      }
+      prefix = p;
+    }
+  }
+
+  int size = INNER_HEADER + prefix + (count + 1) * 4 + count * 2;
+  for (int i = 0; i < count; ++i) {
+    size += 2 + lens[i] - prefix;
+  }
+  if (size > 4 * 1024) {
+    return false;
+  }
+
+  SetCount(count);
+  *((int *)(&buffer_[12])) = prefix;
+  if (count > 0) {
+    memcpy(&buffer_[INNER_HEADER], keys[0].key(), prefix);
+  }
+  for (int i = 0; i <= count; ++i) {
+    SetChild(i, children[i]);
+  }
+
+  unsigned short *offsets = GetSeparatorOffsets();
+  int off = INNER_HEADER + prefix + (count + 1) * 4 + count * 2;
+  for (int i = 0; i < count; ++i) {
+    int len = lens[i] - prefix;
+    offsets[i] = off;
+    *((unsigned short *)(&buffer_[off])) = len;
+    memcpy(&buffer_[off + 2], keys[i].key() + prefix, len);
+    off += 2 + len;
+  }
+  return true;
+}
+
+// Index of the child whose subtree may hold key.
+int BPlusTreeNode::FindChild(TKey &key) {
+  int s = 0;
+  int e = GetCount();
+  while (s < e) {
+    int m = (s + e) / 2;
+    if (key < GetKeys(m)) {
+      e = m;
+    } else {
+      s = m + 1;
+    }
+  }
+  return s;
+}
+
+// True if adding (or removing) an entry below this node cannot make it split
+// (or merge), so writers can let go of the latches above it.
+bool BPlusTreeNode::Safe(bool insert) {
+  int count = GetCount();
+  if (GetIsLeaf()) {
+    if (insert) {
+      return count + 1 < tree_->degree();
+    }
+    return IsRoot() ? count > 1 : count - 1 >= rank_;
+  }
+
+  // a new or replaced separator may also end the shared prefix, which every
+  // other separator then has to store again
+  int key_len = tree_->idx()->key_len();
+  bool is_char = tree_->idx()->key_type() == T_CHAR;
+  int prefix = GetPrefixLength();
+  int grow = 8 + key_len + (is_char ? prefix * (count + 1) : 0);
+  if (GetSize() + grow > 4 * 1024) {
+    return false;
+  }
+  if (insert) {
+    return true;
+  }
+  if (IsRoot()) {
+    return count > 1;
+  }
+
+  // and a removed one may lengthen the prefix
+  int shrink = 8 + key_len + (is_char ? (key_len - prefix) * count : 0);
+  return GetSize() - shrink >= 4 * 1024 / 2;
+}
+
+bool BPlusTreeNode::Underflow() {
+  if (GetIsLeaf()) {
+    return GetCount() < rank_;
+  }
+  return GetSize() < 4 * 1024 / 2;
+}
+
+void BPlusTreeNode::SetKeys(int index, const TKey &key) {
+  Dirty();
   int base = 12;
-  int lenr = 4 + tree_->idx()->key_len();
-  memcpy(&buffer_[base + index * lenr + 4], key.key(), tree_->idx()->key_len());
+  int lenr = GetEntryLength();
+  memcpy(&buffer_[base + index * lenr + 8], key.key(), tree_->idx()->key_len());
 }
 
-void BPlusTreeNode::SetValues(int index, int val) {
+void BPlusTreeNode::SetValues(int index, long long val) {
+  Dirty();
   int base = 12;
-  int lenr = 4 + tree_->idx()->key_len();
-  *((int *)(&buffer_[base + index * lenr])) = val;
+  int lenr = GetEntryLength();
+  *((long long *)(&buffer_[base + index * lenr])) = val;
+}
+
+void BPlusTreeNode::SetPayload(int index, const char *payload) {
+  Dirty();
+  memcpy(GetPayload(index), payload, tree_->idx()->include_len());
+}
+
+// Copies n whole leaf entries starting at from[i] to this node at position
+// to. The ranges may overlap when from is this node.
+void BPlusTreeNode::CopyEntries(int to, BPlusTreeNode *from, int i, int n) {
+  Dirty();
+  int base = 12;
+  int lenr = GetEntryLength();
+  memmove(&buffer_[base + to * lenr], &from->buffer_[base + i * lenr],
+          n * lenr);
 }
 
 void BPlusTreeNode::SetNextLeaf(int val) {
+  Dirty();
   int base = 12;
-  int len = 4 + tree_->idx()->key_len();
+  int len = GetEntryLength();
   *((int *)(&buffer_[base + tree_->degree() * len])) = val;
 }
 
-void BPlusTreeNode::SetParent(int val) { *((int *)(&buffer_[8])) = val; }
+void BPlusTreeNode::SetChild(int index, int val) {
+  Dirty();
+  *((int *)(&buffer_[INNER_HEADER + GetPrefixLength() + index * 4])) = val;
+}
 
-void BPlusTreeNode::SetNodeType(int val) { *((int *)(&buffer_[0])) = val; }
+void BPlusTreeNode::SetParent(int val) {
+  Dirty();
+  *((int *)(&buffer_[8])) = val;
+}
 
-void BPlusTreeNode::SetCount(int val) { *((int *)(&buffer_[4])) = val; }
+void BPlusTreeNode::SetNodeType(int val) {
+  Dirty();
+  *((int *)(&buffer_[0])) = val;
+}
+
+void BPlusTreeNode::SetCount(int val) {
+  Dirty();
+  *((int *)(&buffer_[4])) = val;
+}
 
 void BPlusTreeNode::SetIsLeaf(bool val) { SetNodeType(val ? 1 : 0); }
 
 void BPlusTreeNode::GetBuffer() {
-  BlockInfo *block = tree_->hdl()->GetFileBlock(
-      tree_->db_name(), tree_->idx()->name(), FORMAT_INDEX, block_num_);
-  buffer_ = block->data();
-  block->set_dirty(true);
+  block_ = tree_->hdl()->PinFileBlock(tree_->db_name(), tree_->idx()->name(),
+                                      FORMAT_INDEX, block_num_);
+  buffer_ = block_->data();
 }
 
-bool BPlusTreeNode::Search(TKey key, int &index) {
+// Every setter marks the block changed; a node that is only read stays
+// clean, so it is neither logged nor written back.
+void BPlusTreeNode::Dirty() { tree_->hdl()->WriteBlock(block_); }
+
+bool BPlusTreeNode::Search(const TKey &key, int &index) {
   bool ret = false;
 
   if (GetCount() == 0) {
@@ -619,97 +1301,47 @@ bool BPlusTreeNode::Search(TKey key, int &index) {
   }
 }
 
-int BPlusTreeNode::Add(TKey &key) {
-  int index = 0;
-  if (GetCount() == 0) {
-    SetKeys(0, key);
-    SetCount(1);
-    return 0;
-  }
-
-  if (!Search(key, index)) {
-
-    for (int i = GetCount(); i > index; i--) {
-      SetKeys(i, GetKeys(i - 1));
-    }
-
-    for (int i = GetCount() + 1; i > index; i--) {
-      SetValues(i, GetValues(i - 1));
-    }
-
-    SetKeys(index, key);
-    SetValues(index, -1);
-    SetCount(GetCount() + 1);
-  }
-  return index;
-}
-
-int BPlusTreeNode::Add(TKey &key, int &val) {
+int BPlusTreeNode::Add(TKey &key, long long &val, const char *payload) {
   int index = 0;
   if (GetCount() == 0) {
     SetKeys(0, key);
     SetValues(0, val);
+    SetPayload(0, payload);
     SetCount(GetCount() + 1);
     return 0;
   }
 
   if (!Search(key, index)) {
-
-    for (int i = GetCount(); i > index; i--) {
-      SetKeys(i, GetKeys(i - 1));
-      SetValues(i, GetValues(i - 1));
-    }
+    CopyEntries(index + 1, this, index, GetCount() - index);
 
     SetKeys(index, key);
     SetValues(index, val);
+    SetPayload(index, payload);
     SetCount(GetCount() + 1);
   }
   return index;
 }
 
+// Splits a full leaf; key is set to the separator for the parent.
 BPlusTreeNode *BPlusTreeNode::Split(TKey &key) {
   BPlusTreeNode *newnode =
-      new BPlusTreeNode(true, tree_, tree_->GetNewBlockNum(), GetIsLeaf());
+      new BPlusTreeNode(true, tree_, tree_->GetNewBlockNum(), true);
   if (newnode == NULL) {
     throw BPlusTreeException();
     return NULL;
   }
 
-  key = GetKeys(rank_);
+  newnode->CopyEntries(0, this, rank_ + 1, rank_);
 
-  if (GetIsLeaf()) {
-    for (int i = rank_ + 1; i < tree_->degree(); i++) {
-      newnode->SetKeys(i - rank_ - 1, GetKeys(i));
-      newnode->SetValues(i - rank_ - 1, GetValues(i));
-    }
-
-    newnode->SetCount(rank_);
-    SetCount(rank_ + 1);
-    newnode->SetNextLeaf(GetNextLeaf());
-    SetNextLeaf(newnode->block_num());
-    newnode->SetParent(GetParent());
-
-  } else {
-    for (int i = rank_ + 1; i < tree_->degree(); i++) {
-      newnode->SetKeys(i - rank_ - 1, GetKeys(i));
-    }
-    for (int i = rank_ + 1; i <= tree_->degree(); i++) {
-      newnode->SetValues(i - rank_ - 1, GetValues(i));
-    }
-    newnode->SetParent(GetParent());
-    newnode->SetCount(rank_);
-
-    int childnode_num;
-    for (int i = 0; i <= newnode->GetCount(); i++) {
-      childnode_num = newnode->GetValues(i);
-      BPlusTreeNode *node = tree_->GetNode(childnode_num);
-      if (node) {
-        node->SetParent(newnode->block_num());
-      }
-    }
+  newnode->SetCount(rank_);
+  SetCount(rank_ + 1);
+  newnode->SetNextLeaf(GetNextLeaf());
+  SetNextLeaf(newnode->block_num());
+  newnode->SetParent(GetParent());
 
-    SetCount(rank_);
-  }
+  TKey lkey = GetKeys(rank_);
+  TKey rkey = newnode->GetKeys(0);
+  key = tree_->Separator(lkey, rkey);
 
   return newnode;
 }
@@ -719,21 +1351,7 @@ bool BPlusTreeNode::RemoveAt(int index) {
     return false;
   }
 
-  if (GetIsLeaf()) {
-
-    for (int i = index; i < GetCount() - 1; i++) {
-      SetKeys(i, GetKeys(i + 1));
-      SetValues(i, GetValues(i + 1));
-    }
-  } else {
-    for (int i = index; i < GetCount() - 1; i++) {
-      SetKeys(i, GetKeys(i + 1));
-    }
-
-    for (int i = index; i < GetCount(); i++) {
-      SetValues(i, GetValues(i + 1));
-    }
-  }
+  CopyEntries(index, this, index + 1, GetCount() - index - 1);
   SetCount(GetCount() - 1);
   return true;
 }
@@ -754,7 +1372,7 @@ void BPlusTreeNode::Print() {
       if (GetValues(i) == -1) {
         printf("{NUL}");
       } else {
-        printf("%07d ", GetValues(i));
+        printf("%d:%d ", RidBlockNum(GetValues(i)), RidOffset(GetValues(i)));
       }
     }
     printf(" }\n");
@@ -763,8 +1381,349 @@ void BPlusTreeNode::Print() {
   } else {
     printf("Ptrs: {");
     for (int i = 0; i <= GetCount(); i++) {
-      printf("%07d ", GetValues(i));
+      printf("%07d ", GetChild(i));
     }
     printf("}\n");
+    printf("Prefix: %d, Size: %d\n", GetPrefixLength(), GetSize());
+  }
+}
+
+//=======================HashIndex=======================//
+
+// The directory is a single block of 4-byte bucket numbers, so it can double
+// up to a global depth of 10. Past that, full buckets chain overflow blocks.
+#define HASH_MAX_DEPTH 10
+
+// Bucket blocks reuse the record block header: the prev slot holds the
+// local depth, the next slot the overflow block and the count slot the
+// number of entries. Entries are an 8-byte record id followed by the key
+// and the included columns.
+
+void HashIndex::InitIndex() {
+  int dir_num = idx_->IncreaseMaxCount();
+  idx_->set_root(dir_num);
+  idx_->set_level(0);
+  idx_->set_key_count(0);
+  idx_->set_node_count(0);
+
+  int bucket = NewBucket(0);
+
+  BlockInfo *dir = GetBlock(dir_num);
+  ((int *)dir->data())[0] = bucket;
+  hdl_->WriteBlock(dir);
+}
+
+BlockInfo *HashIndex::GetBlock(int num) {
+  return hdl_->GetFileBlock(db_name_, idx_->name(), FORMAT_INDEX, num);
+}
+
+unsigned int HashIndex::Hash(TKey &key) {
+  const unsigned char *p = (const unsigned char *)key.key();
+  int len = key.length();
+  float zero = 0;
+
+  if (key.key_type() == T_CHAR) {
+    // CHAR keys compare with strncmp, so bytes after the terminator are
+    // not part of the key
+    len = strnlen(key.key(), key.length());
+  } else if (key.key_type() == T_FLOAT && *(float *)key.key() == 0) {
+    // 0.0 and -0.0 compare equal
+    p = (const unsigned char *)&zero;
+  }
+
+  unsigned int h = 2166136261u;
+  for (int i = 0; i < len; ++i) {
+    h ^= p[i];
+    h *= 16777619u;
+  }
+
+  // spread the high bits into the low bits used by the directory
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  return h;
+}
+
+int HashIndex::GetBucket(TKey &key) {
+  BlockInfo *dir = GetBlock(idx_->root());
+  unsigned int slot = Hash(key) & ((1u << idx_->level()) - 1);
+  return ((int *)dir->data())[slot];
+}
+
+bool HashIndex::Find(TKey &key, BlockInfo *&bp, int &pos) {
+  int num = GetBucket(key);
+  while (num != -1) {
+    bp = GetBlock(num);
+    for (int i = 0; i < bp->GetRecordCount(); ++i) {
+      if (GetKey(bp, i) == key) {
+        pos = i;
+        return true;
+      }
+    }
+    num = bp->GetNextBlockNum();
+  }
+  return false;
+}
+
+int HashIndex::NewBucket(int depth) {
+  int num = idx_->IncreaseMaxCount();
+  BlockInfo *bp = GetBlock(num);
+  SetLocalDepth(bp, depth);
+  bp->SetNextBlockNum(-1);
+  bp->SetRecordCount(0);
+  hdl_->WriteBlock(bp);
+  idx_->IncreaseNodeCount();
+  return num;
+}
+
+void HashIndex::DoubleDirectory() {
+  BlockInfo *dir = GetBlock(idx_->root());
+  int *slots = (int *)dir->data();
+  int size = 1 << idx_->level();
+  for (int i = 0; i < size; ++i) {
+    slots[size + i] = slots[i];
+  }
+  idx_->IncreaseLevel();
+  hdl_->WriteBlock(dir);
+}
+
+void HashIndex::SplitBucket(int num) {
+  int depth = GetLocalDepth(GetBlock(num));
+  int new_num = NewBucket(depth + 1);
+
+  BlockInfo *bp = GetBlock(num);
+  BlockInfo *new_bp = GetBlock(new_num);
+  SetLocalDepth(bp, depth + 1);
+
+  int i = 0;
+  while (i < bp->GetRecordCount()) {
+    TKey key = GetKey(bp, i);
+    if ((Hash(key) >> depth) & 1) {
+      char *entry = GetEntry(bp, i);
+      PutEntry(new_bp, key, *(long long *)entry, entry + 8 + idx_->key_len());
+      RemoveEntry(bp, i);
+    } else {
+      i++;
+    }
+  }
+  hdl_->WriteBlock(bp);
+  hdl_->WriteBlock(new_bp);
+
+  BlockInfo *dir = GetBlock(idx_->root());
+  int *slots = (int *)dir->data();
+  for (int s = 0; s < (1 << idx_->level()); ++s) {
+    if (slots[s] == num && ((s >> depth) & 1)) {
+      slots[s] = new_num;
+    }
+  }
+  hdl_->WriteBlock(dir);
+}
+
+int HashIndex::GetLocalDepth(BlockInfo *bp) { return bp->GetPrevBlockNum(); }
+
+void HashIndex::SetLocalDepth(BlockInfo *bp, int depth) {
+  bp->SetPrevBlockNum(depth);
+}
+
+int HashIndex::EntryLength() {
+  return 8 + idx_->key_len() + idx_->include_len();
+}
+
+char *HashIndex::GetEntry(BlockInfo *bp, int pos) {
+  return bp->GetContentAddress() + pos * EntryLength();
+}
+
+TKey HashIndex::GetKey(BlockInfo *bp, int pos) {
+  TKey key(idx_->key_type(), idx_->key_len());
+  memcpy(key.key(), GetEntry(bp, pos) + 8, idx_->key_len());
+  return key;
+}
+
+void HashIndex::PutEntry(BlockInfo *bp, TKey &key, long long rid,
+                         const char *payload) {
+  char *entry = GetEntry(bp, bp->GetRecordCount());
+  *(long long *)entry = rid;
+  memcpy(entry + 8, key.key(), idx_->key_len());
+  memcpy(entry + 8 + idx_->key_len(), payload, idx_->include_len());
+  bp->SetRecordCount(bp->GetRecordCount() + 1);
+}
+
+void HashIndex::RemoveEntry(BlockInfo *bp, int pos) {
+  int last = bp->GetRecordCount() - 1;
+  if (pos != last) {
+    memcpy(GetEntry(bp, pos), GetEntry(bp, last), EntryLength());
   }
+  bp->DecreaseRecordCount();
+}
+
+bool HashIndex::Add(TKey &key, int block_num, int offset,
+                    const char *payload) {
+  if (idx_->root() == -1) {
+    InitIndex();
+  }
+
+  BlockInfo *bp;
+  int pos;
+  if (Find(key, bp, pos)) {
+    return false;
+  }
+
+  while (true) {
+    int num = GetBucket(key);
+    bp = GetBlock(num);
+
+    if (bp->GetRecordCount() < idx_->rank()) {
+      break;
+    }
+
+    if (GetLocalDepth(bp) < idx_->level()) {
+      SplitBucket(num);
+    } else if (idx_->level() < HASH_MAX_DEPTH) {
+      DoubleDirectory();
+      SplitBucket(num);
+    } else {
+      // the directory is at its maximum size; chain an overflow block
+      while (bp->GetRecordCount() == idx_->rank()) {
+        int next = bp->GetNextBlockNum();
+        if (next == -1) {
+          next = NewBucket(GetLocalDepth(bp));
+          bp = GetBlock(num);
+          bp->SetNextBlockNum(next);
+          hdl_->WriteBlock(bp);
+        }
+        num = next;
+        bp = GetBlock(num);
+      }
+      break;
+    }
+  }
+
+  PutEntry(bp, key, MakeRid(block_num, offset), payload);
+  hdl_->WriteBlock(bp);
+  idx_->IncreaseKeyCount();
+  return true;
+}
+
+bool HashIndex::Remove(TKey key) {
+  if (idx_->root() == -1) {
+    return false;
+  }
+
+  BlockInfo *bp;
+  int pos;
+  if (!Find(key, bp, pos)) {
+    return false;
+  }
+
+  RemoveEntry(bp, pos);
+  hdl_->WriteBlock(bp);
+  idx_->DecreaseKeyCount();
+  return true;
+}
+
+long long HashIndex::GetVal(TKey key, char *payload) {
+  if (idx_->root() == -1) {
+    return -1;
+  }
+
+  BlockInfo *bp;
+  int pos;
+  if (!Find(key, bp, pos)) {
+    return -1;
+  }
+  char *entry = GetEntry(bp, pos);
+  if (payload != NULL) {
+    memcpy(payload, entry + 8 + idx_->key_len(), idx_->include_len());
+  }
+  return *(long long *)entry;
+}
+
+void HashIndex::Print() {
+  printf("*****************************************************\n");
+  printf("KeyCount: %d, BucketCount: %d, GlobalDepth: %d, Directory: %d \n",
+         idx_->key_count(), idx_->node_count(), idx_->level(), idx_->root());
+}
+
+//=======================BloomIndex=======================//
+
+// Keys hash the way HashIndex::Hash sees them, with FNV-1a widened to 64
+// bits and finished with the MurmurHash3 mixer.
+uint64_t BloomIndex::Hash(TKey &key) {
+  const unsigned char *p = (const unsigned char *)key.key();
+  int len = key.length();
+  float zero = 0;
+
+  if (key.key_type() == T_CHAR) {
+    len = strnlen(key.key(), key.length());
+  } else if (key.key_type() == T_FLOAT && *(float *)key.key() == 0) {
+    p = (const unsigned char *)&zero;
+  }
+
+  uint64_t hash = 14695981039346656037ull;
+  for (int i = 0; i < len; ++i) {
+    hash = (hash ^ p[i]) * 1099511628211ull;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// The bits of a key are picked by double hashing: the i-th is
+// h1 + i * h2, with the halves of the hash as h1 and h2.
+bool BloomIndex::Add(TKey &key, int block_num, int offset,
+                     const char *payload) {
+  const int filters = 4 * 1024 / BLOOM_FILTER_BYTES;
+  uint64_t hash = Hash(key);
+  unsigned int h1 = hash, h2 = (hash >> 32) | 1;
+
+  BlockInfo *bp = hdl_->PinFileBlock(db_name_, idx_->name(), FORMAT_INDEX,
+                                     block_num / filters);
+  unsigned char *filter = (unsigned char *)bp->data() +
+                          block_num % filters * BLOOM_FILTER_BYTES;
+  for (int i = 0; i < idx_->rank(); ++i) {
+    unsigned int bit = (h1 + i * h2) % (BLOOM_FILTER_BYTES * 8);
+    filter[bit / 8] |= 1 << (bit % 8);
+  }
+  hdl_->WriteBlock(bp);
+  hdl_->UnpinBlock(bp);
+  idx_->IncreaseKeyCount();
+  return true;
+}
+
+bool BloomIndex::MayContain(TKey &key, int block_num) {
+  const int filters = 4 * 1024 / BLOOM_FILTER_BYTES;
+  uint64_t hash = Hash(key);
+  unsigned int h1 = hash, h2 = (hash >> 32) | 1;
+
+  // pinned, as parallel scans test filters on several threads
+  BlockInfo *bp = hdl_->PinFileBlock(db_name_, idx_->name(), FORMAT_INDEX,
+                                     block_num / filters);
+  const unsigned char *filter = (const unsigned char *)bp->data() +
+                                block_num % filters * BLOOM_FILTER_BYTES;
+  bool found = true;
+  for (int i = 0; i < idx_->rank() && found; ++i) {
+    unsigned int bit = (h1 + i * h2) % (BLOOM_FILTER_BYTES * 8);
+    found = (filter[bit / 8] & (1 << (bit % 8))) != 0;
+  }
+  hdl_->UnpinBlock(bp);
+  return found;
+}
+
+void BloomIndex::Clear(int block_num) {
+  const int filters = 4 * 1024 / BLOOM_FILTER_BYTES;
+  BlockInfo *bp = hdl_->PinFileBlock(db_name_, idx_->name(), FORMAT_INDEX,
+                                     block_num / filters);
+  memset(bp->data() + block_num % filters * BLOOM_FILTER_BYTES, 0,
+         BLOOM_FILTER_BYTES);
+  hdl_->WriteBlock(bp);
+  hdl_->UnpinBlock(bp);
+}
+
+void BloomIndex::Print() {
+  printf("*****************************************************\n");
+  printf("KeyCount: %d, FilterBytes: %d, Hashes: %d \n", idx_->key_count(),
+         BLOOM_FILTER_BYTES, idx_->rank());
 }
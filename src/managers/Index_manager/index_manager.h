@@ -1,14 +1,19 @@
 #ifndef HackyDb_INDEX_MANAGER_H_
 #define HackyDb_INDEX_MANAGER_H_
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "../../Core/Buffer/Buffer_manager/buffer_manager.h"
 #include "../Catalog_manager/catalog_manager.h"
 #include "../../SQL/sql_statement.h"
+#include "node_latch.h"
 
 class BPlusTreeNode;
 class BPlusTree;
+class IndexMethod;
+class MorselSource;
 
 class IndexManager {
 private:
@@ -24,6 +29,48 @@ public:
   }
   ~IndexManager() {}
   void CreateIndex(SQLCreateIndex &st);
+  void BuildIndex(Table *tbl, Index *idx);
+  void AddRecords(Table *tbl, Index *idx, MorselSource *source,
+                  bool concurrent);
+  void RebuildIndex(Table *tbl, Index *idx);
+  void MigrateIndexes();
+};
+
+// Index leaves store a 64-bit record identifier: the block number in the
+// high 32 bits and the record offset within the block in the low 32 bits.
+inline long long MakeRid(int block_num, int offset) {
+  return ((long long)block_num << 32) | (unsigned int)offset;
+}
+
+inline int RidBlockNum(long long rid) { return (int)(rid >> 32); }
+
+inline int RidOffset(long long rid) { return (int)(rid & 0xffffffff); }
+
+// Bytes an index stores after the key: the INCLUDE columns of the record,
+// in the order they were listed.
+std::string IndexPayload(Table *tbl, Index *idx, std::vector<TKey> &values);
+
+#define BLOOM_FILTER_BYTES 64 // the filter of one table block, 512 bits
+#define BLOOM_HASHES 4
+
+// Operations every index type supports. Use IndexMethod::Open to get the
+// implementation matching an Index catalog entry.
+class IndexMethod {
+public:
+  virtual ~IndexMethod() {}
+
+  // A concurrent B+ tree may be used from several threads at once, each
+  // through an IndexMethod of its own; the other methods ignore the flag.
+  static IndexMethod *Open(Index *idx, BufferManager *hdl, CatalogManager *cm,
+                           std::string db_name, bool concurrent = false);
+
+  // payload holds idx->include_len() bytes, see IndexPayload. GetVal copies
+  // it back when given a buffer.
+  virtual bool Add(TKey &key, int block_num, int offset,
+                   const char *payload) = 0;
+  virtual bool Remove(TKey key) = 0;
+  virtual long long GetVal(TKey key, char *payload = NULL) = 0;
+  virtual void Print() = 0;
 };
 
 typedef struct {
@@ -32,7 +79,11 @@ typedef struct {
   bool flag;
 } FindNodeParam;
 
-class BPlusTree {
+// In concurrent mode one BPlusTree object per thread may work on the same
+// index: lookups use optimistic lock coupling and writers latch only the
+// leaf, or crab write latches down from the root when a node may split or
+// merge. Print and WriteToDisk still need the writers to be quiesced.
+class BPlusTree : public IndexMethod {
 private:
   Index *idx_;
   int degree_;
@@ -40,14 +91,22 @@ private:
   CatalogManager *cm_;
   std::string db_name_;
 
+  bool concurrent_;
+  IndexLatches *latches_;
+  std::vector<int> held_; // write-latched blocks
+  bool tree_held_;
+
 public:
   BPlusTree(Index *idx, BufferManager *hdl, CatalogManager *cm,
-            std::string db_name) {
+            std::string db_name, bool concurrent = false) {
     hdl_ = hdl;
     cm_ = cm;
     idx_ = idx;
     degree_ = 2 * idx_->rank() + 1;
     db_name_ = db_name;
+    concurrent_ = concurrent;
+    latches_ = concurrent ? IndexLatches::Get(db_name, idx->name()) : NULL;
+    tree_held_ = false;
   }
   ~BPlusTree() {}
 
@@ -57,24 +116,128 @@ public:
   CatalogManager *cm() { return cm_; }
   std::string db_name() { return db_name_; }
 
-  bool Add(TKey &key, int block_num, int offset);
+  bool Add(TKey &key, int block_num, int offset, const char *payload);
   bool AdjustAfterAdd(int node);
 
   bool Remove(TKey key);
   bool AdjustAfterRemove(int node);
 
   FindNodeParam Search(int node, TKey &key);
-  FindNodeParam SearchBranch(int node, TKey &key);
   BPlusTreeNode *GetNode(int num);
-  int GetVal(TKey key);
+  long long GetVal(TKey key, char *payload = NULL);
+  // Leftmost leaf, where an in-order walk along the next-leaf links starts;
+  // -1 for an empty tree.
+  int FirstLeaf();
+  // Rightmost leaf, holding the largest key; -1 for an empty tree.
+  int LastLeaf();
 
-  int GetNewBlockNum() { return idx_->IncreaseMaxCount(); }
+  int KeyLength(TKey &key);
+  TKey Separator(TKey &left, TKey &right);
+
+  int GetNewBlockNum();
 
   void Print();
   void PrintNode(int num);
 
 private:
   void InitTree();
+  bool AddToLeaf(FindNodeParam &fnp, TKey &key, long long value,
+                 const char *payload);
+  bool RemoveFromLeaf(FindNodeParam &fnp);
+  void CountKeys(int delta);
+  void CountNodes(int delta);
+
+  long long ConcurrentGetVal(TKey &key, char *payload);
+  bool ConcurrentWrite(TKey &key, long long value, const char *payload,
+                       bool insert);
+  bool OptimisticWrite(TKey &key, long long value, const char *payload,
+                       bool insert, bool &ret);
+  bool PessimisticWrite(TKey &key, long long value, const char *payload,
+                        bool insert);
+  bool Descend(TKey &key, int &num, NodeLatch *&parent, uint64_t &pv,
+               char *buffer);
+  void ReadNode(int num, char *buffer);
+  void Lock(int num);
+  void ReleaseAbove(int num);
+  void ReleaseAll();
+  bool InsertIntoParent(BPlusTreeNode *left, TKey &key, BPlusTreeNode *right);
+  bool SplitInner(BPlusTreeNode *pnode, std::vector<TKey> &keys,
+                  std::vector<int> &children);
+  int SplitPoint(std::vector<TKey> &keys);
+  bool BalanceLeaves(BPlusTreeNode *left, BPlusTreeNode *right, TKey &sep);
+  bool BalanceInner(BPlusTreeNode *left, BPlusTreeNode *right, TKey &sep);
+};
+
+// Extendible hash index for equality lookups. The Index catalog entry is
+// shared with the B+ tree: root() is the directory block, level() the
+// global depth, node_count() the number of buckets and rank() the number of
+// entries a bucket holds.
+class HashIndex : public IndexMethod {
+private:
+  Index *idx_;
+  BufferManager *hdl_;
+  CatalogManager *cm_;
+  std::string db_name_;
+
+  BlockInfo *GetBlock(int num);
+  unsigned int Hash(TKey &key);
+  int GetBucket(TKey &key);
+  bool Find(TKey &key, BlockInfo *&bp, int &pos);
+  int NewBucket(int depth);
+  void SplitBucket(int num);
+  void DoubleDirectory();
+  void InitIndex();
+
+  int GetLocalDepth(BlockInfo *bp);
+  void SetLocalDepth(BlockInfo *bp, int depth);
+  char *GetEntry(BlockInfo *bp, int pos);
+  TKey GetKey(BlockInfo *bp, int pos);
+  int EntryLength();
+  void PutEntry(BlockInfo *bp, TKey &key, long long rid, const char *payload);
+  void RemoveEntry(BlockInfo *bp, int pos);
+
+public:
+  HashIndex(Index *idx, BufferManager *hdl, CatalogManager *cm,
+            std::string db_name)
+      : idx_(idx), hdl_(hdl), cm_(cm), db_name_(db_name) {}
+  ~HashIndex() {}
+
+  bool Add(TKey &key, int block_num, int offset, const char *payload);
+  bool Remove(TKey key);
+  long long GetVal(TKey key, char *payload = NULL);
+  void Print();
+};
+
+// Bloom filters over the keys of each table block, which tell blocks that
+// cannot hold a key from those that may. Each block of the index file
+// holds the filters of 4096 / BLOOM_FILTER_BYTES consecutive table blocks,
+// and rank() is the number of bits set for a key. Keys are never taken
+// out; a table block starts a new filter when it is reused after being
+// emptied. GetVal finds no records.
+class BloomIndex : public IndexMethod {
+private:
+  Index *idx_;
+  BufferManager *hdl_;
+  CatalogManager *cm_;
+  std::string db_name_;
+
+  uint64_t Hash(TKey &key);
+
+public:
+  BloomIndex(Index *idx, BufferManager *hdl, CatalogManager *cm,
+             std::string db_name)
+      : idx_(idx), hdl_(hdl), cm_(cm), db_name_(db_name) {}
+  ~BloomIndex() {}
+
+  bool Add(TKey &key, int block_num, int offset, const char *payload);
+  bool Remove(TKey key) { return false; }
+  long long GetVal(TKey key, char *payload = NULL) { return -1; }
+  void Print();
+
+  // False if no record of the table block has the key.
+  bool MayContain(TKey &key, int block_num);
+  // Empties the filter of a table block.
+  void Clear(int block_num);
 };
 
 class BPlusTreeNode {
@@ -83,27 +246,37 @@ private:
   int block_num_;
   int rank_;
   char *buffer_;
+  BlockInfo *block_;
   bool is_leaf_;
   bool is_new_node_;
 
 public:
   BPlusTreeNode(bool isnew, BPlusTree *tree, int blocknum,
                 bool newleaf = false);
-  ~BPlusTreeNode() {}
+  // Read-only view of a copy of the node taken by BPlusTree::ReadNode.
+  BPlusTreeNode(BPlusTree *tree, int blocknum, char *buffer);
+  ~BPlusTreeNode();
 
   int block_num() { return block_num_; }
 
   TKey GetKeys(int i);
-  int GetValues(int i);
+  long long GetValues(int i);
+  char *GetPayload(int i);
   int GetNextLeaf();
   int GetParent();
   int GetNodeType();
   int GetCount();
   bool GetIsLeaf();
+  int GetPrefixLength();
+  int GetChild(int i);
+  int GetSize();
 
-  void SetKeys(int i, TKey key);
-  void SetValues(int i, int val);
+  void SetKeys(int i, const TKey &key);
+  void SetValues(int i, long long val);
+  void SetPayload(int i, const char *payload);
+  void CopyEntries(int to, BPlusTreeNode *from, int i, int n);
   void SetNextLeaf(int val);
+  void SetChild(int i, int val);
   void SetParent(int val);
   void SetNodeType(int val);
   void SetCount(int val);
@@ -111,11 +284,16 @@ public:
 
   void GetBuffer();
 
-  bool Search(TKey key, int &index);
-  int Add(TKey &key);
-  int Add(TKey &key, int &val);
+  bool Search(const TKey &key, int &index);
+  int Add(TKey &key, long long &val, const char *payload);
   BPlusTreeNode *Split(TKey &key);
 
+  void Load(std::vector<TKey> &keys, std::vector<int> &children);
+  bool Store(std::vector<TKey> &keys, std::vector<int> &children);
+  int FindChild(TKey &key);
+  bool Underflow();
+  bool Safe(bool insert);
+
   bool IsRoot() {
     if (GetParent() != -1)
       return false;
@@ -125,6 +303,11 @@ public:
   bool RemoveAt(int index);
 
   void Print();
+
+private:
+  int GetEntryLength();
+  unsigned short *GetSeparatorOffsets();
+  void Dirty();
 };
 
 #endif
@@ -0,0 +1,49 @@
+#include "node_latch.h"
+
+#include <map>
+
+#include "../../Includes/exceptions.h"
+
+using namespace std;
+
+IndexLatches::IndexLatches() : restarts_(0) {
+  for (int i = 0; i < LATCH_MAX_CHUNKS; ++i) {
+    chunks_[i].store(NULL, memory_order_relaxed);
+  }
+}
+
+IndexLatches::~IndexLatches() {
+  for (int i = 0; i < LATCH_MAX_CHUNKS; ++i) {
+    delete[] chunks_[i].load(memory_order_relaxed);
+  }
+}
+
+IndexLatches *IndexLatches::Get(string db_name, string index_name) {
+  static std::mutex registry_mutex;
+  static map<string, IndexLatches *> registry;
+
+  lock_guard<std::mutex> guard(registry_mutex);
+  IndexLatches *&latches = registry[db_name + "/" + index_name];
+  if (latches == NULL) {
+    latches = new IndexLatches();
+  }
+  return latches;
+}
+
+NodeLatch *IndexLatches::node(int block_num) {
+  int chunk = block_num / LATCH_CHUNK_SIZE;
+  if (block_num < 0 || chunk >= LATCH_MAX_CHUNKS) {
+    throw BPlusTreeException();
+  }
+
+  NodeLatch *latches = chunks_[chunk].load(memory_order_acquire);
+  if (latches == NULL) {
+    lock_guard<std::mutex> guard(mutex_);
+    latches = chunks_[chunk].load(memory_order_relaxed);
+    if (latches == NULL) {
+      latches = new NodeLatch[LATCH_CHUNK_SIZE];
+      chunks_[chunk].store(latches, memory_order_release);
+    }
+  }
+  return &latches[block_num % LATCH_CHUNK_SIZE];
+}
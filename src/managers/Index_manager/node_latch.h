@@ -0,0 +1,84 @@
+#ifndef HackyDb_NODE_LATCH_H_
+#define HackyDb_NODE_LATCH_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Version latch for optimistic lock coupling. The low bit is set while a
+// writer holds the latch and every release bumps the version, so a reader
+// that saw the same unlocked version before and after reading a node knows
+// no writer touched it in between.
+class NodeLatch {
+private:
+  std::atomic<uint64_t> version_;
+
+public:
+  NodeLatch() : version_(0) {}
+
+  // Waits until no writer holds the latch and returns the version to
+  // validate against.
+  uint64_t ReadLock() {
+    uint64_t v = version_.load(std::memory_order_acquire);
+    while (v & 1) {
+      std::this_thread::yield();
+      v = version_.load(std::memory_order_acquire);
+    }
+    return v;
+  }
+
+  bool Validate(uint64_t v) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == v;
+  }
+
+  void WriteLock() {
+    uint64_t v = version_.load(std::memory_order_relaxed);
+    while (true) {
+      if (!(v & 1) && version_.compare_exchange_weak(
+                          v, v + 1, std::memory_order_acquire)) {
+        return;
+      }
+      if (v & 1) {
+        std::this_thread::yield();
+        v = version_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void WriteUnlock() { version_.fetch_add(1, std::memory_order_release); }
+};
+
+#define LATCH_CHUNK_SIZE 1024
+#define LATCH_MAX_CHUNKS 4096
+
+// Latches of one B+ tree, shared by every BPlusTree opened on it. tree()
+// guards the root pointer and level, node(n) block n. Lookups do not lock;
+// chunks of latches are allocated on first use and never freed.
+class IndexLatches {
+private:
+  NodeLatch tree_;
+  std::atomic<NodeLatch *> chunks_[LATCH_MAX_CHUNKS];
+  std::mutex mutex_;
+  std::atomic<long long> restarts_;
+
+public:
+  IndexLatches();
+  ~IndexLatches();
+
+  static IndexLatches *Get(std::string db_name, std::string index_name);
+
+  NodeLatch *tree() { return &tree_; }
+  NodeLatch *node(int block_num);
+
+  // Guards the counters in the Index catalog entry.
+  std::mutex &mutex() { return mutex_; }
+
+  // Optimistic walks thrown away because a writer got in the way.
+  long long restarts() { return restarts_.load(std::memory_order_relaxed); }
+  void CountRestart() { restarts_.fetch_add(1, std::memory_order_relaxed); }
+};
+
+#endif
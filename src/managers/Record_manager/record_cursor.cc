@@ -0,0 +1,11 @@
+#include "record_cursor.h"
+
+#include "../../Executor/Planner/planner.h"
+
+using namespace std;
+
+RecordCursor::RecordCursor(CatalogManager *cm, BufferManager *hdl,
+                           std::string db, SQLSelect &st) {
+  Planner planner(cm, hdl, db);
+  plan_ = planner.PlanSelect(st);
+}
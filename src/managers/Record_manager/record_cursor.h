@@ -0,0 +1,27 @@
+#ifndef HackyDb_RECORD_CURSOR_H_
+#define HackyDb_RECORD_CURSOR_H_
+
+#include <string>
+#include <vector>
+
+#include "../../Executor/Operators/operators.h"
+#include "record_manager.h"
+
+// Pull-based result of a SELECT. Each Next() call pulls one row through
+// the query plan, so memory stays constant however large the result is.
+class RecordCursor {
+private:
+  Operator *plan_;
+
+public:
+  RecordCursor(CatalogManager *cm, BufferManager *hdl, std::string db,
+               SQLSelect &st);
+  ~RecordCursor() { delete plan_; }
+
+  std::vector<std::string> &col_names() { return plan_->names(); }
+  // Fills row with the projected columns of the next match; false when
+  // the result is exhausted.
+  bool Next(std::vector<TKey> &row) { return plan_->Next(row); }
+};
+
+#endif /* HackyDb_RECORD_CURSOR_H_ */
@@ -2,10 +2,15 @@
 
 #include "record_manager.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 
 #include "../Index_manager/index_manager.h"
+#include "../../Executor/Planner/planner.h"
+#include "../../Executor/Planner/statistics.h"
+#include "record_cursor.h"
 
 using namespace std;
 
@@ -27,8 +32,6 @@ void RecordManager::Insert(SQLInsert &st) {
     throw TableNotExistException();
   }
 
-  int max_count = (4096 - 12) / (tbl->record_length());
-
   vector<TKey> tkey_values;
   int pk_index = -1;
 
@@ -48,335 +51,217 @@ void RecordManager::Insert(SQLInsert &st) {
 
   if (pk_index != -1) {
 
-    if (tbl->GetIndexNum() != 0) {
+    if (tbl->GetLookupIndex() != NULL) {
 
-      BPlusTree tree(tbl->GetIndex(0), hdl_, cm_, db_name_);
+      IndexMethod *tree =
+          IndexMethod::Open(tbl->GetLookupIndex(), hdl_, cm_, db_name_);
 
-      int value = tree.GetVal(tkey_values[pk_index]);
+      long long value = tree->GetVal(tkey_values[pk_index]);
+      delete tree;
       if (value != -1) {
         throw PrimaryKeyConflictException();
       }
     } else {
-      int block_num = tbl->first_block_num();
+      Condition same = {pk_index, SIGN_EQ, tkey_values[pk_index]};
+      vector<Condition> conds(1, same);
       for (int i = 0; i < tbl->block_count(); ++i) {
-        BlockInfo *bp = GetBlockInfo(tbl, block_num);
-
-        for (int j = 0; j < bp->GetRecordCount(); ++j) {
-          vector<TKey> tkey_value = GetRecord(tbl, block_num, j);
-
-          if (tkey_value[pk_index] == tkey_values[pk_index]) {
-            throw PrimaryKeyConflictException();
+        if (CanSkipBlock(tbl, i, conds)) {
+          continue;
+        }
+        BlockInfo *bp = hdl_->PinFileBlock(db_name_, tbl->tb_name(), 0, i);
+        bool conflict = false;
+        for (int j = 0; j < bp->GetRecordCount() && !conflict; ++j) {
+          if (!bp->IsFreeSlot(j)) {
+            vector<TKey> tkey_value = GetRecord(tbl, i, j);
+            conflict = tkey_value[pk_index] == tkey_values[pk_index];
           }
         }
-
-        block_num = bp->GetNextBlockNum();
-      }
-    }
-  }
-
-  char *content;
-  int ub = tbl->first_block_num();    // used block
-  int frb = tbl->first_rubbish_num(); // first rubbish block
-  int lastub;
-  int blocknum, offset;
-
-  // find the block for use from the useful block
-  while (ub != -1) {
-    lastub = ub;
-    BlockInfo *bp = GetBlockInfo(tbl, ub);
-    if (bp->GetRecordCount() == max_count) {
-      ub = bp->GetNextBlockNum();
-      continue;
-    }
-    content =
-        bp->GetContentAddress() + bp->GetRecordCount() * tbl->record_length();
-    for (vector<TKey>::iterator iter = tkey_values.begin();
-         iter != tkey_values.end(); ++iter) {
-      memcpy(content, iter->key(), iter->length());
-      content += iter->length();
-    }
-    bp->SetRecordCount(1 + bp->GetRecordCount());
-
-    blocknum = ub;
-    offset = bp->GetRecordCount() - 1;
-
-    hdl_->WriteBlock(bp);
-
-    // add record to index
-    if (tbl->GetIndexNum() != 0) {
-      BPlusTree tree(tbl->GetIndex(0), hdl_, cm_, db_name_);
-      for (int i = 0; i < tbl->ats().size(); ++i) {
-        if (tbl->GetIndex(0)->attr_name() == tbl->GetIndex(i)->attr_name()) {
-          tree.Add(tkey_values[i], blocknum, offset);
-          break;
+        hdl_->UnpinBlock(bp);
+        if (conflict) {
+          throw PrimaryKeyConflictException();
         }
       }
     }
-
-    hdl_->WriteToDisk();
-    cm_->WriteArchiveFile();
-
-    return;
   }
 
-  if (frb != -1) {
-    BlockInfo *bp = GetBlockInfo(tbl, frb);
-    content = bp->GetContentAddress();
-    for (vector<TKey>::iterator iter = tkey_values.begin();
-         iter != tkey_values.end(); ++iter) {
-      memcpy(content, iter->key(), iter->length());
-      content += iter->length();
-    }
-    bp->SetRecordCount(1);
-
-    BlockInfo *lastubp = GetBlockInfo(tbl, lastub);
-    lastubp->SetNextBlockNum(frb);
-
-    tbl->set_first_rubbish_num(bp->GetNextBlockNum());
+  string record;
+  for (vector<TKey>::iterator iter = tkey_values.begin();
+       iter != tkey_values.end(); ++iter) {
+    record.append(iter->key(), iter->length());
+  }
+  long long rid = AddRecord(tbl, record.data());
+
+  // add record to indexes
+  for (int i = 0; i < tbl->GetIndexNum(); ++i) {
+    Index *idx = tbl->GetIndex(i);
+    IndexMethod *tree = IndexMethod::Open(idx, hdl_, cm_, db_name_);
+    string payload = IndexPayload(tbl, idx, tkey_values);
+    tree->Add(tkey_values[tbl->GetAttributeIndex(idx->attr_name())],
+              RidBlockNum(rid), RidOffset(rid), payload.data());
+    delete tree;
+  }
+  cm_->WriteTable(db_name_, tbl->tb_name());
+  hdl_->Commit();
+}
 
-    bp->SetPrevBlockNum(lastub);
-    bp->SetNextBlockNum(-1);
+void RecordManager::Select(SQLSelect &st) {
 
-    blocknum = frb;
-    offset = 0;
+  Table *tbl = cm_->GetDB(db_name_)->GetTable(st.tb_name());
 
-    hdl_->WriteBlock(bp);
-    hdl_->WriteBlock(lastubp);
+  // the cursor, and any scan threads under it, end before the index is
+  // printed
+  {
+    RecordCursor cursor(cm_, hdl_, db_name_, st);
 
-  } else {
-    // initial or add a block
-    int next_block = tbl->first_block_num();
-    if (tbl->first_block_num() != -1) {
-      BlockInfo *upbp = GetBlockInfo(tbl, tbl->first_block_num());
-      upbp->SetPrevBlockNum(tbl->block_count());
-      hdl_->WriteBlock(upbp);
+    for (int i = 0; i < cursor.col_names().size(); ++i) {
+      cout << setw(9) << left << cursor.col_names()[i];
     }
-    tbl->set_first_block_num(tbl->block_count());
-    BlockInfo *bp = GetBlockInfo(tbl, tbl->first_block_num());
-
-    bp->SetPrevBlockNum(-1);
-    bp->SetNextBlockNum(next_block);
-    bp->SetRecordCount(1);
+    cout << endl;
 
-    content = bp->GetContentAddress();
-    for (vector<TKey>::iterator iter = tkey_values.begin();
-         iter != tkey_values.end(); ++iter) {
-      memcpy(content, iter->key(), iter->length());
-      content += iter->length();
+    vector<TKey> row;
+    while (cursor.Next(row)) {
+      for (int i = 0; i < row.size(); ++i) {
+        cout << row[i];
+      }
+      cout << endl;
     }
-
-    blocknum = tbl->block_count();
-    offset = 0;
-
-    hdl_->WriteBlock(bp);
-
-    tbl->IncreaseBlockCount();
   }
 
-  // add record to index
   if (tbl->GetIndexNum() != 0) {
-    BPlusTree tree(tbl->GetIndex(0), hdl_, cm_, db_name_);
-    for (int i = 0; i < tbl->ats().size(); ++i) {
-      if (tbl->GetIndex(0)->attr_name() == tbl->GetIndex(i)->name()) {
-        tree.Add(tkey_values[i], blocknum, offset);
-        break;
-      }
-    }
+    IndexMethod *tree =
+        IndexMethod::Open(tbl->GetIndex(0), hdl_, cm_, db_name_);
+    tree->Print();
+    delete tree;
   }
-  cm_->WriteArchiveFile();
-  hdl_->WriteToDisk();
 }
 
-void RecordManager::Select(SQLSelect &st) {
+void RecordManager::Delete(SQLDelete &st) {
 
   Table *tbl = cm_->GetDB(db_name_)->GetTable(st.tb_name());
 
-  for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
-    cout << setw(9) << left << tbl->ats()[i].attr_name();
+  // the rows carry the keys to remove from the indexes
+  vector<int> keys;
+  for (int i = 0; i < tbl->GetIndexNum(); ++i) {
+    keys.push_back(tbl->GetAttributeIndex(tbl->GetIndex(i)->attr_name()));
   }
-  cout << endl;
-
-  vector<vector<TKey>> tkey_values;
 
-  bool has_index = false;
-  int index_idx;
-  int where_idx;
+  Planner planner(cm_, hdl_, db_name_);
+  Operator *scan = planner.PlanScan(tbl, st.wheres(), keys, true);
 
-  if (tbl->GetIndexNum() != 0) {
-    for (int i = 0; i < tbl->GetIndexNum(); ++i) {
-      Index *idx = tbl->GetIndex(i);
-      for (int j = 0; j < st.wheres().size(); ++j) {
-        if (idx->attr_name() == st.wheres()[j].key) {
-          if (st.wheres()[j].sign_type == SIGN_EQ) {
-            has_index = true;
-            index_idx = i;
-            where_idx = j;
-          }
-        }
-      }
+  vector<long long> rids;
+  vector<vector<TKey> > rows;
+  vector<TKey> row;
+  while (scan->Next(row)) {
+    rids.push_back(scan->rid());
+    rows.push_back(row);
+  }
+  delete scan;
+
+  // the other records keep their RIDs, so the matches go in any order
+  for (int i = 0; i < rids.size(); ++i) {
+    DeleteRecord(tbl, RidBlockNum(rids[i]), RidOffset(rids[i]));
+    for (int j = 0; j < tbl->GetIndexNum(); ++j) {
+      IndexMethod *tree =
+          IndexMethod::Open(tbl->GetIndex(j), hdl_, cm_, db_name_);
+      tree->Remove(rows[i][j]);
+      delete tree;
     }
   }
 
-  if (!has_index) {
-    int block_num = tbl->first_block_num();
-    for (int i = 0; i < tbl->block_count(); ++i) {
-      BlockInfo *bp = GetBlockInfo(tbl, block_num);
-
-      for (int j = 0; j < bp->GetRecordCount(); ++j) {
-        vector<TKey> tkey_value = GetRecord(tbl, block_num, j);
-
-        bool sats = true;
-
-        for (int k = 0; k < st.wheres().size(); ++k) {
-          SQLWhere where = st.wheres()[k];
-          if (!SatisfyWhere(tbl, tkey_value, where)) {
-            sats = false;
-          }
-        }
-        if (sats) {
-          tkey_values.push_back(tkey_value);
-        }
-      }
+  if (NeedsVacuum(tbl)) {
+    cout << "Vacuuming table: " << tbl->tb_name() << endl;
+    Vacuum(tbl);
+    return;
+  }
+  cm_->WriteTable(db_name_, tbl->tb_name());
+  hdl_->Commit();
+}
 
-      block_num = bp->GetNextBlockNum();
+// Moves records from the last blocks into free space in earlier ones, then
+// cuts the emptied blocks off the end of the file. The moved records get
+// new RIDs, so their index entries are put back.
+void RecordManager::Vacuum(Table *tbl) {
+  for (int back = tbl->block_count() - 1; back > 0; --back) {
+    if (tbl->pages()[back] == 0) {
+      continue;
     }
-  } else { // if has index
-    BPlusTree tree(tbl->GetIndex(index_idx), hdl_, cm_, db_name_);
-
-    // build TKey for search
-    int type = tbl->GetIndex(index_idx)->key_type();
-    int length = tbl->GetIndex(index_idx)->key_len();
-    std::string value = st.wheres()[where_idx].value;
-    TKey dest_key(type, length);
-    dest_key.ReadValue(value);
-
-    int blocknum = tree.GetVal(dest_key);
-
-    if (blocknum != -1) {
-      int blockoffset = blocknum;
-      blocknum = blocknum >> 16;
-      blocknum = blocknum & 0xffff;
-      blockoffset = blockoffset & 0xffff;
-      vector<TKey> tkey_value = GetRecord(tbl, blocknum, blockoffset);
-      bool sats = true;
-
-      for (int k = 0; k < st.wheres().size(); ++k) {
-        SQLWhere where = st.wheres()[k];
-        if (!SatisfyWhere(tbl, tkey_value, where)) {
-          sats = false;
-        }
+    BlockInfo *bp = hdl_->PinFileBlock(db_name_, tbl->tb_name(), 0, back);
+    bool full = false;
+    for (int slot = 0; slot < bp->GetRecordCount() && !full; ++slot) {
+      if (bp->IsFreeSlot(slot)) {
+        continue;
       }
-      if (sats) {
-        tkey_values.push_back(tkey_value);
+      string data(bp->GetRecord(slot), bp->GetRecordLength(slot));
+      int block_num = FindBlock(tbl, data.size());
+      if (block_num == -1 || block_num >= back) {
+        full = true;
+        break;
+      }
+
+      vector<TKey> values = GetRecord(tbl, back, slot);
+      long long rid = StoreRecord(tbl, block_num, data);
+      bp->RemoveRecord(slot);
+      SyncPage(tbl, bp);
+      hdl_->WriteBlock(bp);
+
+      for (int i = 0; i < tbl->GetIndexNum(); ++i) {
+        Index *idx = tbl->GetIndex(i);
+        TKey &key = values[tbl->GetAttributeIndex(idx->attr_name())];
+        string payload = IndexPayload(tbl, idx, values);
+        IndexMethod *tree = IndexMethod::Open(idx, hdl_, cm_, db_name_);
+        tree->Remove(key);
+        tree->Add(key, RidBlockNum(rid), RidOffset(rid), payload.data());
+        delete tree;
       }
     }
+    hdl_->UnpinBlock(bp);
+    if (full) {
+      break;
+    }
   }
 
-  for (int i = 0; i < tkey_values.size(); ++i) {
-    for (int j = 0; j < tkey_values[i].size(); ++j) {
-      cout << tkey_values[i][j];
-    }
-    cout << endl;
+  int blocks = tbl->block_count();
+  while (blocks > 0 && tbl->pages()[blocks - 1] == 0) {
+    --blocks;
   }
-  if (tbl->GetIndexNum() != 0) {
-    BPlusTree tree(tbl->GetIndex(0), hdl_, cm_, db_name_);
-    tree.Print();
+  // the catalog drops the emptied blocks in the statement, and the file
+  // loses them after it commits
+  int old_blocks = tbl->block_count();
+  if (blocks < old_blocks) {
+    tbl->DropBlocks(blocks);
+  }
+  cm_->WriteTable(db_name_, tbl->tb_name());
+  hdl_->Commit();
+  if (blocks < old_blocks) {
+    // a checkpoint first, so the log holds no images of the blocks cut off
+    hdl_->WriteToDisk();
+    hdl_->TruncateFile(db_name_, tbl->tb_name(), 0, blocks);
   }
 }
 
-void RecordManager::Delete(SQLDelete &st) {
-
-  Table *tbl = cm_->GetDB(db_name_)->GetTable(st.tb_name());
-
-  bool has_index = false;
-  int index_idx;
-  int where_idx;
-
-  if (tbl->GetIndexNum() != 0) {
-    for (int i = 0; i < tbl->GetIndexNum(); ++i) {
-      Index *idx = tbl->GetIndex(i);
-      for (int j = 0; j < st.wheres().size(); ++j) {
-        if (idx->attr_name() == st.wheres()[j].key) {
-          index_idx = i;
-          if (st.wheres()[j].sign_type == SIGN_EQ) {
-            has_index = true;
-            where_idx = j;
-          }
-        }
-      }
-    }
+// Takes the statistics the planner estimates rows from.
+void RecordManager::Analyze(Table *tbl) {
+  CollectStatistics(*this, tbl);
+  for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
+    Attribute &attr = tbl->ats()[i];
+    cout << attr.attr_name() << ": " << (long long)attr.distinct()
+         << " distinct" << endl;
   }
+  cout << tbl->analyzed_rows() << " rows analyzed" << endl;
+  cm_->WriteTable(db_name_, tbl->tb_name());
+  hdl_->Commit();
+}
 
-  if (!has_index) {
-    int block_num = tbl->first_block_num();
-    for (int i = 0; i < tbl->block_count(); ++i) {
-      BlockInfo *bp = GetBlockInfo(tbl, block_num);
-      int count = bp->GetRecordCount();
-      for (int j = 0; j < count; ++j) {
-        vector<TKey> tkey_value = GetRecord(tbl, block_num, j);
-
-        bool sats = true;
-
-        for (int k = 0; k < st.wheres().size(); ++k) {
-          SQLWhere where = st.wheres()[k];
-          if (!SatisfyWhere(tbl, tkey_value, where)) {
-            sats = false;
-          }
-        }
-        if (sats) {
-          DeleteRecord(tbl, block_num, j);
-          if (tbl->GetIndexNum() != 0) {
-            BPlusTree tree(tbl->GetIndex(index_idx), hdl_, cm_, db_name_);
-
-            int idx = -1;
-            for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
-              if (tbl->ats()[i].attr_name() ==
-                  tbl->GetIndex(index_idx)->attr_name()) {
-                idx = i;
-              }
-            }
-
-            tree.Remove(tkey_value[idx]);
-          }
-        }
-      }
-
-      block_num = bp->GetNextBlockNum();
-    }
-  } else { // if has index
-    BPlusTree tree(tbl->GetIndex(index_idx), hdl_, cm_, db_name_);
-
-    // build TKey for search
-    int type = tbl->GetIndex(index_idx)->key_type();
-    int length = tbl->GetIndex(index_idx)->key_len();
-    std::string value = st.wheres()[where_idx].value;
-    TKey dest_key(type, length);
-    dest_key.ReadValue(value);
-
-    int blocknum = tree.GetVal(dest_key);
-
-    if (blocknum != -1) {
-      int blockoffset = blocknum;
-      blocknum = blocknum >> 16;
-      blocknum = blocknum & 0xffff;
-      blockoffset = blockoffset & 0xffff;
-      vector<TKey> tkey_value = GetRecord(tbl, blocknum, blockoffset);
-      bool sats = true;
-
-      for (int k = 0; k < st.wheres().size(); ++k) {
-        SQLWhere where = st.wheres()[k];
-        if (!SatisfyWhere(tbl, tkey_value, where)) {
-          sats = false;
-        }
-      }
-      if (sats) {
-        DeleteRecord(tbl, blocknum, blockoffset);
-        tree.Remove(dest_key);
-      }
-    }
+bool RecordManager::NeedsVacuum(Table *tbl) {
+  if (tbl->block_count() < AUTO_VACUUM_MIN_BLOCKS) {
+    return false;
   }
-
-  hdl_->WriteToDisk();
+  long long free = 0;
+  for (int i = 0; i < tbl->block_count(); ++i) {
+    free += tbl->free_space()[i];
+  }
+  return free * 100 >=
+         (long long)tbl->block_count() * (4096 - 12) * AUTO_VACUUM_FREE_PERCENT;
 }
 
 void RecordManager::Update(SQLUpdate &st) {
@@ -405,85 +290,324 @@ void RecordManager::Update(SQLUpdate &st) {
     }
   }
 
+  Planner planner(cm_, hdl_, db_name_);
+  vector<int> none;
+  vector<TKey> row;
+
   if (affect_index != -1) {
+    vector<SQLWhere> wheres(1);
+    wheres[0].key = tbl->ats()[pk_index].attr_name();
+    wheres[0].sign_type = SIGN_EQ;
+    wheres[0].value = st.keyvalues()[affect_index].value;
+
+    Operator *scan = planner.PlanScan(tbl, wheres, none, true);
+    bool conflict = scan->Next(row);
+    delete scan;
+    if (conflict) {
+      throw PrimaryKeyConflictException();
+    }
+  }
+
+  // the matches are found before any changes
+  vector<long long> rids;
+  Operator *scan = planner.PlanScan(tbl, st.wheres(), none, true);
+  while (scan->Next(row)) {
+    rids.push_back(scan->rid());
+  }
+  delete scan;
+
+  for (int i = 0; i < rids.size(); ++i) {
+    int block_num = RidBlockNum(rids[i]);
+    int offset = RidOffset(rids[i]);
+    vector<TKey> tkey_value = GetRecord(tbl, block_num, offset);
+
+    for (int j = 0; j < tbl->GetIndexNum(); ++j) {
+      IndexMethod *tree =
+          IndexMethod::Open(tbl->GetIndex(j), hdl_, cm_, db_name_);
+      int idx = tbl->GetAttributeIndex(tbl->GetIndex(j)->attr_name());
+      tree->Remove(tkey_value[idx]);
+      delete tree;
+    }
+
+    long long rid = UpdateRecord(tbl, block_num, offset, indices, values);
+    block_num = RidBlockNum(rid);
+    offset = RidOffset(rid);
+
     if (tbl->GetIndexNum() != 0) {
+      tkey_value = GetRecord(tbl, block_num, offset);
+    }
+    for (int j = 0; j < tbl->GetIndexNum(); ++j) {
+      IndexMethod *tree =
+          IndexMethod::Open(tbl->GetIndex(j), hdl_, cm_, db_name_);
+      int idx = tbl->GetAttributeIndex(tbl->GetIndex(j)->attr_name());
+      string payload = IndexPayload(tbl, tbl->GetIndex(j), tkey_value);
+      tree->Add(tkey_value[idx], block_num, offset, payload.data());
+      delete tree;
+    }
+  }
 
-      BPlusTree tree(tbl->GetIndex(0), hdl_, cm_, db_name_);
+  cm_->WriteTable(db_name_, tbl->tb_name());
+  hdl_->Commit();
+}
 
-      int value = tree.GetVal(values[affect_index]);
-      if (value != -1) {
-        throw PrimaryKeyConflictException();
-      }
-    } else {
-      int block_num = tbl->first_block_num();
-      for (int i = 0; i < tbl->block_count(); ++i) {
-        BlockInfo *bp = GetBlockInfo(tbl, block_num);
+// Copies the record count and free space of a block to the page directory.
+void RecordManager::SyncPage(Table *tbl, BlockInfo *bp) {
+  tbl->SetPage(bp->block_num(), bp->CountRecords(), bp->GetFreeSpace());
+}
 
-        for (int j = 0; j < bp->GetRecordCount(); ++j) {
-          vector<TKey> tkey_value = GetRecord(tbl, block_num, j);
+// A key as a zone map keeps it: its KeyBytes, cut to ZONE_KEY_BYTES.
+static std::string ZoneKey(TKey &key) {
+  string bytes = KeyBytes(key);
+  if (bytes.size() > ZONE_KEY_BYTES) {
+    bytes.resize(ZONE_KEY_BYTES);
+  }
+  return bytes;
+}
 
-          if (tkey_value[pk_index] == values[affect_index]) {
-            throw PrimaryKeyConflictException();
-          }
-        }
+// Orders two zone keys of a column of the type like CompareKeys.
+static int CompareZoneKeys(int type, const std::string &a,
+                           const std::string &b) {
+  if (type == T_INT) {
+    int x, y;
+    memcpy(&x, a.data(), sizeof(x));
+    memcpy(&y, b.data(), sizeof(y));
+    return x < y ? -1 : x > y;
+  }
+  if (type == T_FLOAT) {
+    float x, y;
+    memcpy(&x, a.data(), sizeof(x));
+    memcpy(&y, b.data(), sizeof(y));
+    return x < y ? -1 : x > y;
+  }
+  return a.compare(b);
+}
 
-        block_num = bp->GetNextBlockNum();
-      }
+// Widens the zone of a block to the keys of a record stored in it. The
+// first record of an empty block starts its zone afresh. Keys removed
+// later leave the zone as wide as it was, which is still right.
+void RecordManager::WidenZone(Table *tbl, int block_num, const char *record,
+                              bool fresh) {
+  vector<ZoneRange> *zone = tbl->GetZone(block_num);
+  if (zone == NULL && !fresh) {
+    return; // not summed up, and the block is never skipped
+  }
+  vector<ZoneRange> ranges;
+  if (!fresh) {
+    ranges = *zone;
+  }
+  bool changed = fresh;
+  for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
+    TKey value = GetColumn(tbl, record, i);
+    string key = ZoneKey(value);
+    int type = tbl->ats()[i].data_type();
+    if (fresh) {
+      ZoneRange range = {key, key};
+      ranges.push_back(range);
+      continue;
+    }
+    if (CompareZoneKeys(type, key, ranges[i].min) < 0) {
+      ranges[i].min = key;
+      changed = true;
     }
+    if (CompareZoneKeys(type, key, ranges[i].max) > 0) {
+      ranges[i].max = key;
+      changed = true;
+    }
+  }
+  if (changed) {
+    tbl->SetZone(block_num, ranges);
   }
+}
 
-  int block_num = tbl->first_block_num();
+// Sums up the zones of every block of a table from its records.
+void RecordManager::BuildZones(Table *tbl) {
+  string buffer(tbl->record_length(), 0);
   for (int i = 0; i < tbl->block_count(); ++i) {
-    BlockInfo *bp = GetBlockInfo(tbl, block_num);
-
-    for (int j = 0; j < bp->GetRecordCount(); ++j) {
-      vector<TKey> tkey_value = GetRecord(tbl, block_num, j);
-
-      bool sats = true;
+    if (tbl->pages()[i] == 0) {
+      continue;
+    }
+    BlockInfo *bp = hdl_->PinFileBlock(db_name_, tbl->tb_name(), 0, i);
+    bool fresh = true;
+    for (int slot = 0; slot < bp->GetRecordCount(); ++slot) {
+      if (bp->IsFreeSlot(slot)) {
+        continue;
+      }
+      WidenZone(tbl, i, RecordAt(tbl, bp, slot, &buffer[0]), fresh);
+      fresh = false;
+    }
+    hdl_->UnpinBlock(bp);
+  }
+}
 
-      for (int k = 0; k < st.wheres().size(); ++k) {
-        SQLWhere where = st.wheres()[k];
-        if (!SatisfyWhere(tbl, tkey_value, where)) {
-          sats = false;
-        }
+// True if no record of the block can pass conds: it is empty, its zone
+// shows a condition fails for every key of the column in it, or the Bloom
+// filter of a column tested for equality does not have the key.
+bool RecordManager::CanSkipBlock(Table *tbl, int block_num,
+                                 std::vector<Condition> &conds) {
+  if (tbl->pages()[block_num] == 0) {
+    return true;
+  }
+  vector<ZoneRange> *zone = tbl->GetZone(block_num);
+  for (int i = 0; zone != NULL && i < conds.size(); ++i) {
+    ZoneRange &range = (*zone)[conds[i].col];
+    int type = tbl->ats()[conds[i].col].data_type();
+    // a CHAR operand is only cut when set against a greatest key, which is
+    // cut too; the least key, cut, is no greater than the key it was cut
+    // from
+    string operand = KeyBytes(conds[i].operand);
+    string cut = ZoneKey(conds[i].operand);
+    int below_min = CompareZoneKeys(type, operand, range.min);
+    int above_max = CompareZoneKeys(type, cut, range.max);
+    bool exact = type != T_CHAR; // numbers are never cut
+    switch (conds[i].sign_type) {
+    case SIGN_EQ:
+      if (below_min < 0 || above_max > 0) {
+        return true;
       }
-      if (sats) {
-        if (tbl->GetIndexNum() != 0) {
-          BPlusTree tree(tbl->GetIndex(0), hdl_, cm_, db_name_);
-
-          int idx = -1;
-          for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
-            if (tbl->ats()[i].attr_name() == tbl->GetIndex(0)->attr_name()) {
-              idx = i;
-            }
-          }
+      break;
+    case SIGN_NE:
+      if (exact && below_min == 0 && above_max == 0) {
+        return true; // every key equals the operand
+      }
+      break;
+    case SIGN_LT:
+      if (below_min <= 0) {
+        return true;
+      }
+      break;
+    case SIGN_LE:
+      if (below_min < 0) {
+        return true;
+      }
+      break;
+    case SIGN_GT:
+      if (above_max > 0 || (exact && above_max == 0)) {
+        return true;
+      }
+      break;
+    case SIGN_GE:
+      if (above_max > 0) {
+        return true;
+      }
+      break;
+    }
+  }
 
-          tree.Remove(tkey_value[idx]);
-        }
+  for (int i = 0; i < tbl->GetIndexNum(); ++i) {
+    Index *idx = tbl->GetIndex(i);
+    if (idx->method() != INDEX_BLOOM) {
+      continue;
+    }
+    int col = tbl->GetAttributeIndex(idx->attr_name());
+    for (int j = 0; j < conds.size(); ++j) {
+      if (conds[j].col == col && conds[j].sign_type == SIGN_EQ &&
+          !BloomIndex(idx, hdl_, cm_, db_name_)
+               .MayContain(conds[j].operand, block_num)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
 
-        UpdateRecord(tbl, block_num, j, indices, values);
+// Records are stored as they are decoded, except that VARCHAR columns are
+// cut to their characters and preceded by a 2-byte length.
+std::string RecordManager::EncodeRecord(Table *tbl, const char *record) {
+  if (tbl->IsFixedLength()) {
+    return string(record, tbl->record_length());
+  }
+  string data;
+  for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
+    int length = tbl->ats()[i].length();
+    if (tbl->ats()[i].varying()) {
+      unsigned short chars = strnlen(record, length);
+      data.append((char *)&chars, sizeof(chars));
+      data.append(record, chars);
+    } else {
+      data.append(record, length);
+    }
+    record += length;
+  }
+  return data;
+}
 
-        tkey_value = GetRecord(tbl, block_num, j);
+void RecordManager::DecodeRecord(Table *tbl, const char *data, char *record) {
+  if (tbl->IsFixedLength()) {
+    memcpy(record, data, tbl->record_length());
+    return;
+  }
+  for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
+    int length = tbl->ats()[i].length();
+    if (tbl->ats()[i].varying()) {
+      unsigned short chars;
+      memcpy(&chars, data, sizeof(chars));
+      data += sizeof(chars);
+      memcpy(record, data, chars);
+      memset(record + chars, 0, length - chars);
+      data += chars;
+    } else {
+      memcpy(record, data, length);
+      data += length;
+    }
+    record += length;
+  }
+}
 
-        if (tbl->GetIndexNum() != 0) {
-          BPlusTree tree(tbl->GetIndex(0), hdl_, cm_, db_name_);
+// The decoded record in a slot: in the block itself if the table has no
+// VARCHAR, else decoded into the buffer.
+const char *RecordManager::RecordAt(Table *tbl, BlockInfo *bp, int slot,
+                                    char *buffer) {
+  if (tbl->IsFixedLength()) {
+    return bp->GetRecord(slot);
+  }
+  DecodeRecord(tbl, bp->GetRecord(slot), buffer);
+  return buffer;
+}
 
-          int idx = -1;
-          for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
-            if (tbl->ats()[i].attr_name() == tbl->GetIndex(0)->attr_name()) {
-              idx = i;
-            }
-          }
+// The first block with room for a stored record of the length and a new
+// slot, according to the page directory, or -1.
+int RecordManager::FindBlock(Table *tbl, int length) {
+  vector<int> &free = tbl->free_space();
+  for (int i = 0; i < tbl->block_count(); ++i) {
+    if (free[i] >= length + 4) {
+      return i;
+    }
+  }
+  return -1;
+}
 
-          tree.Add(tkey_value[idx], block_num, j);
-        }
+long long RecordManager::StoreRecord(Table *tbl, int block_num,
+                                     const std::string &data) {
+  BlockInfo *bp = GetBlockInfo(tbl, block_num);
+  bool fresh = tbl->pages()[block_num] == 0;
+  if (fresh) {
+    bp->InitPage();
+    // the Bloom filters forget the keys the block held before
+    for (int i = 0; i < tbl->GetIndexNum(); ++i) {
+      Index *idx = tbl->GetIndex(i);
+      if (idx->method() == INDEX_BLOOM) {
+        BloomIndex(idx, hdl_, cm_, db_name_).Clear(block_num);
       }
     }
-
-    block_num = bp->GetNextBlockNum();
   }
+  int slot = bp->AddRecord(data.data(), data.size());
+  string record(tbl->record_length(), 0);
+  DecodeRecord(tbl, data.data(), &record[0]);
+  WidenZone(tbl, block_num, record.data(), fresh);
+  SyncPage(tbl, bp);
+  hdl_->WriteBlock(bp);
+  return MakeRid(block_num, slot);
+}
 
-  hdl_->WriteToDisk();
+// Stores a decoded record in the first block with room for it, or in a new
+// one at the end of the file, and returns its RID.
+long long RecordManager::AddRecord(Table *tbl, const char *record) {
+  string data = EncodeRecord(tbl, record);
+  int block_num = FindBlock(tbl, data.size());
+  if (block_num == -1) {
+    block_num = tbl->AddBlock();
+  }
+  return StoreRecord(tbl, block_num, data);
 }
 
 std::vector<TKey> RecordManager::GetRecord(Table *tbl, int block_num,
@@ -491,7 +615,9 @@ std::vector<TKey> RecordManager::GetRecord(Table *tbl, int block_num,
   vector<TKey> keys;
   BlockInfo *bp = GetBlockInfo(tbl, block_num);
 
-  char *content = bp->data() + offset * tbl->record_length() + 12;
+  string record(tbl->record_length(), 0);
+  DecodeRecord(tbl, bp->GetRecord(offset), &record[0]);
+  const char *content = record.data();
 
   for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
     int value_type = tbl->ats()[i].data_type();
@@ -509,53 +635,127 @@ std::vector<TKey> RecordManager::GetRecord(Table *tbl, int block_num,
   return keys;
 }
 
-void RecordManager::DeleteRecord(Table *tbl, int block_num, int offset) {
-  BlockInfo *bp = GetBlockInfo(tbl, block_num);
+// Rebuilds a record from an index entry without reading the table. Columns
+// the index does not cover are left zeroed.
+void RecordManager::GetIndexedRecord(Table *tbl, Index *idx, TKey &key,
+                                     const char *payload, char *record) {
+  memset(record, 0, tbl->record_length());
+  memcpy(record + GetColumnOffset(tbl, tbl->GetAttributeIndex(idx->attr_name())),
+         key.key(), idx->key_len());
+
+  const char *content = payload;
+  for (unsigned int i = 0; i < idx->includes().size(); ++i) {
+    int col = tbl->GetAttributeIndex(idx->includes()[i]);
+    int length = tbl->ats()[col].length();
+    memcpy(record + GetColumnOffset(tbl, col), content, length);
+    content += length;
+  }
+}
 
-  char *content = bp->data() + offset * tbl->record_length() + 12;
-  char *replace =
-      bp->data() + (bp->GetRecordCount() - 1) * tbl->record_length() + 12;
-  memcpy(content, replace, tbl->record_length());
+int RecordManager::GetColumnOffset(Table *tbl, int col) {
+  int offset = 0;
+  for (int i = 0; i < col; ++i) {
+    offset += tbl->ats()[i].length();
+  }
+  return offset;
+}
 
-  bp->DecreaseRecordCount();
+TKey RecordManager::GetColumn(Table *tbl, const char *record, int col) {
+  TKey key(tbl->ats()[col].data_type(), tbl->ats()[col].length());
+  memcpy(key.key(), record + GetColumnOffset(tbl, col),
+         tbl->ats()[col].length());
+  return key;
+}
 
-  if (bp->GetRecordCount() == 0) { // add the block to rubbish block chain
+void RecordManager::DeleteRecord(Table *tbl, int block_num, int offset) {
+  BlockInfo *bp = GetBlockInfo(tbl, block_num);
 
-    int prevnum = bp->GetPrevBlockNum();
-    int nextnum = bp->GetNextBlockNum();
+  // the slot stays free for a later insert; an emptied block stays where
+  // it is, and the page directory shows it as free
+  bp->RemoveRecord(offset);
+  SyncPage(tbl, bp);
 
-    if (prevnum != -1) {
-      BlockInfo *pbp = GetBlockInfo(tbl, prevnum);
-      pbp->SetNextBlockNum(nextnum);
-      hdl_->WriteBlock(pbp);
+  hdl_->WriteBlock(bp);
+}
+
+// Tables from before the page directory get one, read from the record
+// counts in the block headers. Blocks on the old rubbish chain have none.
+// Tables of fixed-length records are then rewritten as slotted pages, and
+// their index rebuilt for the records' new positions.
+void RecordManager::MigrateTables() {
+  Database *db = cm_->GetDB(db_name_);
+  bool migrated = false;
+
+  for (list<Table>::iterator iter = db->tbs().begin(); iter != db->tbs().end();
+       ++iter) {
+    Table *tbl = &(*iter);
+    if (tbl->pages().size() == tbl->block_count() &&
+        tbl->format() == TABLE_FORMAT_CURRENT) {
+      // tables from before the zone maps get theirs
+      bool zoned = true;
+      for (int j = 0; j < tbl->block_count() && zoned; ++j) {
+        zoned = tbl->pages()[j] == 0 || tbl->GetZone(j) != NULL;
+      }
+      if (!zoned) {
+        std::cout << "Building zone map: " << tbl->tb_name() << std::endl;
+        BuildZones(tbl);
+        migrated = true;
+      }
+      continue;
     }
 
-    if (nextnum != -1) {
-      BlockInfo *nbp = GetBlockInfo(tbl, nextnum);
-      nbp->SetPrevBlockNum(prevnum);
-      hdl_->WriteBlock(nbp);
+    std::cout << "Migrating table: " << tbl->tb_name() << std::endl;
+    if (tbl->pages().size() != tbl->block_count()) {
+      tbl->pages().clear();
+      for (int j = 0; j < tbl->block_count(); ++j) {
+        tbl->pages().push_back(GetBlockInfo(tbl, j)->GetRecordCount());
+      }
     }
 
-    BlockInfo *firstrubbish = GetBlockInfo(tbl, tbl->first_rubbish_num());
-    bp->SetNextBlockNum(-1);
-    bp->SetPrevBlockNum(-1);
-    if (firstrubbish != NULL) {
-      firstrubbish->SetPrevBlockNum(block_num);
-      bp->SetNextBlockNum(firstrubbish->block_num());
+    if (tbl->format() == TABLE_FORMAT_FIXED) {
+      vector<string> records;
+      for (int j = 0; j < tbl->block_count(); ++j) {
+        BlockInfo *bp = GetBlockInfo(tbl, j);
+        for (int k = 0; k < tbl->pages()[j]; ++k) {
+          records.push_back(string(bp->GetContentAddress() +
+                                       k * tbl->record_length(),
+                                   tbl->record_length()));
+        }
+        bp->InitPage();
+        hdl_->WriteBlock(bp);
+        tbl->pages()[j] = 0;
+      }
+      tbl->free_space().assign(tbl->block_count(), 4096 - 12);
+      tbl->set_format(TABLE_FORMAT_SLOTTED);
+
+      for (unsigned int j = 0; j < records.size(); ++j) {
+        AddRecord(tbl, records[j].data());
+      }
+      IndexManager im(cm_, hdl_, db_name_);
+      for (unsigned int j = 0; j < tbl->GetIndexNum(); ++j) {
+        im.RebuildIndex(tbl, tbl->GetIndex(j));
+      }
     }
-    tbl->set_first_rubbish_num(block_num);
+    migrated = true;
   }
 
-  hdl_->WriteBlock(bp);
+  if (migrated) {
+    cm_->WriteArchiveFile();
+    hdl_->Commit();
+  }
 }
 
-void RecordManager::UpdateRecord(Table *tbl, int block_num, int offset,
-                                 std::vector<int> &indices,
-                                 std::vector<TKey> &values) {
+// Updates a record and returns its RID, which changes if a longer VARCHAR
+// leaves no room for the record in its block.
+long long RecordManager::UpdateRecord(Table *tbl, int block_num, int offset,
+                                      std::vector<int> &indices,
+                                      std::vector<TKey> &values) {
 
   BlockInfo *bp = GetBlockInfo(tbl, block_num);
 
-  char *content = bp->data() + offset * tbl->record_length() + 12;
+  string record(tbl->record_length(), 0);
+  DecodeRecord(tbl, bp->GetRecord(offset), &record[0]);
+  char *content = &record[0];
 
   for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
     vector<int>::iterator iter = find(indices.begin(), indices.end(), i);
@@ -567,39 +767,72 @@ void RecordManager::UpdateRecord(Table *tbl, int block_num, int offset,
     content += tbl->ats()[i].length();
   }
 
-  hdl_->WriteBlock(bp);
+  string data = EncodeRecord(tbl, record.data());
+  if (bp->ReplaceRecord(offset, data.data(), data.size())) {
+    WidenZone(tbl, block_num, record.data(), false);
+    SyncPage(tbl, bp);
+    hdl_->WriteBlock(bp);
+    return MakeRid(block_num, offset);
+  }
+  DeleteRecord(tbl, block_num, offset);
+  return AddRecord(tbl, record.data());
 }
 
 bool RecordManager::SatisfyWhere(Table *tbl, std::vector<TKey> keys,
                                  SQLWhere where) {
-  int idx = -1;
-  for (int i = 0; i < tbl->GetAttributeNum(); ++i) {
-    if (tbl->ats()[i].attr_name() == where.key) {
-      idx = i;
-    }
-  }
-  // cout << idx;
+  int idx = tbl->GetAttributeIndex(where.key);
 
   TKey tmp(tbl->ats()[idx].data_type(), tbl->ats()[idx].length());
   tmp.ReadValue(where.value.c_str());
-  switch (where.sign_type) {
+  return Compare(keys[idx], where.sign_type, tmp);
+}
+
+std::vector<Condition> RecordManager::GetConditions(
+    Table *tbl, std::vector<SQLWhere> &wheres) {
+  vector<Condition> conds;
+  for (int i = 0; i < wheres.size(); ++i) {
+    int col = tbl->GetAttributeIndex(wheres[i].key);
+    if (col == -1) {
+      throw AttributeNotExistException();
+    }
+    TKey operand(tbl->ats()[col].data_type(), tbl->ats()[col].length());
+    operand.ReadValue(wheres[i].value.c_str());
+    Condition cond = {col, wheres[i].sign_type, operand};
+    conds.push_back(cond);
+  }
+  return conds;
+}
+
+bool RecordManager::SatisfyConditions(Table *tbl, const char *record,
+                                      std::vector<Condition> &conds) {
+  for (int i = 0; i < conds.size(); ++i) {
+    TKey value = GetColumn(tbl, record, conds[i].col);
+    if (!Compare(value, conds[i].sign_type, conds[i].operand)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RecordManager::Compare(TKey &value, int sign_type, TKey &operand) {
+  switch (sign_type) {
   case SIGN_EQ:
-    return keys[idx] == tmp;
+    return value == operand;
     break;
   case SIGN_NE:
-    return keys[idx] != tmp;
+    return value != operand;
     break;
   case SIGN_LT:
-    return keys[idx] < tmp;
+    return value < operand;
     break;
   case SIGN_GT:
-    return keys[idx] > tmp;
+    return value > operand;
     break;
   case SIGN_LE:
-    return keys[idx] <= tmp;
+    return value <= operand;
     break;
   case SIGN_GE:
-    return keys[idx] >= tmp;
+    return value >= operand;
     break;
   default:
     return false;
@@ -12,6 +12,19 @@
 #include "../../Includes/exceptions.h"
 #include "../../SQL/sql_statement.h"
 
+// DELETE vacuums a table of at least this many blocks once this share of
+// its space is free.
+#define AUTO_VACUUM_MIN_BLOCKS 8
+#define AUTO_VACUUM_FREE_PERCENT 50
+
+// A WHERE condition resolved against a table: the column it tests and the
+// operand read as that column's type.
+typedef struct {
+  int col;
+  int sign_type;
+  TKey operand;
+} Condition;
+
 class RecordManager {
 private:
   BufferManager *hdl_;
@@ -22,18 +35,45 @@ public:
   RecordManager(CatalogManager *cm, BufferManager *hdl, std::string db)
       : cm_(cm), hdl_(hdl), db_name_(db) {}
   ~RecordManager() {}
+  CatalogManager *cm() { return cm_; }
+  BufferManager *hdl() { return hdl_; }
+  std::string db_name() { return db_name_; }
   void Insert(SQLInsert &st);
   void Select(SQLSelect &st);
   void Delete(SQLDelete &st);
   void Update(SQLUpdate &st);
+  void Vacuum(Table *tbl);
+  bool NeedsVacuum(Table *tbl);
+  void Analyze(Table *tbl);
+  void MigrateTables();
 
   BlockInfo *GetBlockInfo(Table *tbl, int block_num);
+  void SyncPage(Table *tbl, BlockInfo *bp);
+  void WidenZone(Table *tbl, int block_num, const char *record, bool fresh);
+  void BuildZones(Table *tbl);
+  bool CanSkipBlock(Table *tbl, int block_num, std::vector<Condition> &conds);
+  std::string EncodeRecord(Table *tbl, const char *record);
+  void DecodeRecord(Table *tbl, const char *data, char *record);
+  const char *RecordAt(Table *tbl, BlockInfo *bp, int slot, char *buffer);
+  int FindBlock(Table *tbl, int length);
+  long long StoreRecord(Table *tbl, int block_num, const std::string &data);
+  long long AddRecord(Table *tbl, const char *record);
   std::vector<TKey> GetRecord(Table *tbl, int block_num, int offset);
+  void GetIndexedRecord(Table *tbl, Index *idx, TKey &key,
+                        const char *payload, char *record);
+  int GetColumnOffset(Table *tbl, int col);
+  TKey GetColumn(Table *tbl, const char *record, int col);
   void DeleteRecord(Table *tbl, int block_num, int offset);
-  void UpdateRecord(Table *tbl, int block_num, int offset,
-                    std::vector<int> &indices, std::vector<TKey> &values);
+  long long UpdateRecord(Table *tbl, int block_num, int offset,
+                         std::vector<int> &indices,
+                         std::vector<TKey> &values);
 
   bool SatisfyWhere(Table *tbl, std::vector<TKey> keys, SQLWhere where);
+  std::vector<Condition> GetConditions(Table *tbl,
+                                       std::vector<SQLWhere> &wheres);
+  bool SatisfyConditions(Table *tbl, const char *record,
+                         std::vector<Condition> &conds);
+  bool Compare(TKey &value, int sign_type, TKey &operand);
 };
 
 #endif /* HackyDb_RECORD_MANAGER_H_ */
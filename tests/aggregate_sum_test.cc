@@ -0,0 +1,153 @@
+// SUM of an INT column is added up in 64 bits. A total that fits in an INT
+// is emitted as one, whether the rows are aggregated at once or in
+// partial aggregates merged afterwards, as on several threads; a total
+// that does not raises IntegerOverflowException instead of wrapping.
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../src/Executor/Operators/aggregates.h"
+#include "../src/Includes/commons.h"
+#include "../src/Includes/exceptions.h"
+
+using namespace std;
+
+#define CHECK(cond)                                                         \
+  do {                                                                      \
+    if (!(cond)) {                                                          \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__,      \
+              #cond);                                                       \
+      exit(1);                                                              \
+    }                                                                       \
+  } while (0)
+
+static TKey IntKey(int value) {
+  TKey key(T_INT, 4);
+  memcpy(key.key(), &value, 4);
+  return key;
+}
+
+static int IntValue(TKey &key) {
+  int value;
+  memcpy(&value, key.key(), 4);
+  return value;
+}
+
+// Rows (g, v) of INT columns, from memory.
+class Rows : public Operator {
+private:
+  vector<int> groups_;
+  vector<int> values_;
+  int next_;
+
+public:
+  Rows(vector<int> groups, vector<int> values)
+      : groups_(groups), values_(values), next_(0) {
+    names_.push_back("g");
+    names_.push_back("v");
+  }
+
+  bool Next(std::vector<TKey> &row) {
+    if (next_ == values_.size()) {
+      return false;
+    }
+    row.clear();
+    row.push_back(IntKey(groups_[next_]));
+    row.push_back(IntKey(values_[next_]));
+    ++next_;
+    return true;
+  }
+};
+
+// SUM(v), grouped on g when grouped is set.
+static HashAggregate *SumOf(vector<int> groups, vector<int> values,
+                            bool grouped) {
+  AggregateSpec sum = {AGG_SUM, 1, T_INT, 4};
+  vector<int> group_cols;
+  if (grouped) {
+    group_cols.push_back(0);
+  }
+  return new HashAggregate(new Rows(groups, values), group_cols,
+                           vector<AggregateSpec>(1, sum),
+                           vector<string>(1, "sum(v)"));
+}
+
+// The sums of the groups in the order they are emitted, or false if the
+// aggregate raised IntegerOverflowException.
+static bool Sums(HashAggregate *agg, vector<int> &sums) {
+  vector<TKey> row;
+  bool ok = true;
+  try {
+    while (agg->Next(row)) {
+      CHECK(row.back().key_type() == T_INT);
+      sums.push_back(IntValue(row.back()));
+    }
+  } catch (IntegerOverflowException &e) {
+    ok = false;
+  }
+  delete agg;
+  return ok;
+}
+
+// Sums values in one aggregate, and again split between two partial
+// aggregates that are merged; both must agree.
+static bool Sum(vector<int> values, int &sum) {
+  vector<int> groups(values.size(), 0);
+  vector<int> serial;
+  bool ok = Sums(SumOf(groups, values, false), serial);
+
+  int half = values.size() / 2;
+  HashAggregate *first =
+      SumOf(vector<int>(groups.begin(), groups.begin() + half),
+            vector<int>(values.begin(), values.begin() + half), false);
+  HashAggregate *second =
+      SumOf(vector<int>(groups.begin() + half, groups.end()),
+            vector<int>(values.begin() + half, values.end()), false);
+  CHECK(first->Partial(HASH_AGG_MEMORY));
+  CHECK(second->Partial(HASH_AGG_MEMORY));
+  first->Merge(second);
+  delete second;
+  first->Finish();
+  vector<int> merged;
+  CHECK(Sums(first, merged) == ok);
+
+  if (ok) {
+    CHECK(serial.size() == 1 && merged.size() == 1);
+    CHECK(serial[0] == merged[0]);
+    sum = serial[0];
+  }
+  return ok;
+}
+
+int main() {
+  int sum;
+
+  CHECK(Sum({1, 2, 3}, sum) && sum == 6);
+  CHECK(Sum({}, sum) && sum == 0);
+
+  // each half overflows an INT, but the whole comes back in range
+  CHECK(Sum({INT_MAX, INT_MAX, -INT_MAX, -INT_MAX + 5}, sum) && sum == 5);
+  CHECK(Sum({INT_MAX - 1, 1}, sum) && sum == INT_MAX);
+  CHECK(Sum({INT_MIN + 1, -1}, sum) && sum == INT_MIN);
+
+  // 6000000000 used to wrap to 1705032704
+  CHECK(!Sum({2000000000, 2000000000, 2000000000}, sum));
+  CHECK(!Sum({INT_MAX, 1}, sum));
+  CHECK(!Sum({INT_MIN, -1}, sum));
+
+  // one group out of range fails the query
+  vector<int> sums;
+  CHECK(!Sums(SumOf({1, 2, 2}, {7, INT_MAX, INT_MAX}, true), sums));
+  sums.clear();
+  CHECK(Sums(SumOf({1, 2, 2}, {7, INT_MAX, -3}, true), sums));
+  CHECK(sums.size() == 2);
+  CHECK((sums[0] == 7 && sums[1] == INT_MAX - 3) ||
+        (sums[1] == 7 && sums[0] == INT_MAX - 3));
+
+  printf("aggregate_sum_test: OK\n");
+  return 0;
+}
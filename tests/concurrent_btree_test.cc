@@ -0,0 +1,207 @@
+// Several threads insert into, remove from and look up one B+ tree in
+// concurrent mode, each through a BPlusTree of its own. Lookups of keys
+// that are known to be in the tree must never miss while other threads
+// split and merge nodes, and the tree must hold exactly the keys left
+// once the threads are done.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "../src/Core/Buffer/Buffer_manager/buffer_manager.h"
+#include "../src/Core/Log/Log_manager/log_manager.h"
+#include "../src/Includes/commons.h"
+#include "../src/managers/Index_manager/index_manager.h"
+
+using namespace std;
+
+#define WRITERS 4
+#define READERS 4
+#define KEYS 60000 // per round
+#define ROUNDS 20  // at most, until an optimistic walk has restarted
+
+#define CHECK(cond)                                                         \
+  do {                                                                      \
+    if (!(cond)) {                                                          \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__,      \
+              #cond);                                                       \
+      exit(1);                                                              \
+    }                                                                       \
+  } while (0)
+
+static TKey IntKey(int value) {
+  TKey key(T_INT, 4);
+  memcpy(key.key(), &value, 4);
+  return key;
+}
+
+// Key k is stored as the record (k / 1000, k % 1000).
+static long long Rid(int k) { return MakeRid(k / 1000, k % 1000); }
+
+typedef struct {
+  BufferManager *hdl;
+  Index *idx;
+  string db_name;
+} Tree;
+
+// The writers add the keys with their number modulo WRITERS, in ascending
+// order, so they all crowd the rightmost leaves. done[w] keys of writer w
+// are in the tree; the readers look up keys below it and must find them.
+static void Insert(Tree &t, int first_key) {
+  atomic<int> done[WRITERS];
+  atomic<bool> stop(false);
+  atomic<long long> lookups(0);
+  for (int w = 0; w < WRITERS; ++w) {
+    done[w] = 0;
+  }
+
+  vector<thread> threads;
+  for (int w = 0; w < WRITERS; ++w) {
+    threads.push_back(thread([&t, &done, w, first_key] {
+      BPlusTree tree(t.idx, t.hdl, NULL, t.db_name, true);
+      for (int i = 0; i < KEYS / WRITERS; ++i) {
+        int k = first_key + i * WRITERS + w;
+        TKey key = IntKey(k);
+        CHECK(tree.Add(key, k / 1000, k % 1000, NULL));
+        done[w].store(i + 1, memory_order_release);
+      }
+    }));
+  }
+  for (int r = 0; r < READERS; ++r) {
+    threads.push_back(thread([&t, &done, &stop, &lookups, r, first_key] {
+      BPlusTree tree(t.idx, t.hdl, NULL, t.db_name, true);
+      mt19937 random(r);
+      while (!stop.load(memory_order_acquire)) {
+        int w = random() % WRITERS;
+        int n = done[w].load(memory_order_acquire);
+        if (n == 0) {
+          continue;
+        }
+        // mostly the newest keys, whose leaves are being split
+        int i = random() % 4 ? n - 1 - random() % min(n, 64) : random() % n;
+        int k = first_key + i * WRITERS + w;
+        CHECK(tree.GetVal(IntKey(k)) == Rid(k));
+        lookups.fetch_add(1, memory_order_relaxed);
+      }
+    }));
+  }
+  for (int w = 0; w < WRITERS; ++w) {
+    threads[w].join();
+  }
+  stop.store(true, memory_order_release);
+  for (int r = 0; r < READERS; ++r) {
+    threads[WRITERS + r].join();
+  }
+  CHECK(lookups.load() > 0);
+}
+
+// The writers remove the odd keys of their share while the readers look
+// up even ones, which stay.
+static void Remove(Tree &t, int first_key, int count) {
+  atomic<bool> stop(false);
+  vector<thread> threads;
+  for (int w = 0; w < WRITERS; ++w) {
+    threads.push_back(thread([&t, w, first_key, count] {
+      BPlusTree tree(t.idx, t.hdl, NULL, t.db_name, true);
+      for (int k = first_key + 1 + 2 * w; k < first_key + count;
+           k += 2 * WRITERS) {
+        CHECK(tree.Remove(IntKey(k)));
+      }
+    }));
+  }
+  for (int r = 0; r < READERS; ++r) {
+    threads.push_back(thread([&t, &stop, r, first_key, count] {
+      BPlusTree tree(t.idx, t.hdl, NULL, t.db_name, true);
+      mt19937 random(100 + r);
+      while (!stop.load(memory_order_acquire)) {
+        int k = first_key + random() % (count / 2) * 2;
+        CHECK(tree.GetVal(IntKey(k)) == Rid(k));
+      }
+    }));
+  }
+  for (int w = 0; w < WRITERS; ++w) {
+    threads[w].join();
+  }
+  stop.store(true, memory_order_release);
+  for (int r = 0; r < READERS; ++r) {
+    threads[WRITERS + r].join();
+  }
+}
+
+// Walks the leaves and checks they hold exactly the keys wanted, in order.
+static void Verify(Tree &t, vector<int> &wanted) {
+  BPlusTree tree(t.idx, t.hdl, NULL, t.db_name);
+  CHECK(t.idx->key_count() == wanted.size());
+
+  int leaf = tree.FirstLeaf();
+  int n = 0;
+  while (leaf != -1) {
+    BPlusTreeNode *node = tree.GetNode(leaf);
+    for (int i = 0; i < node->GetCount(); ++i) {
+      int k;
+      memcpy(&k, node->GetKeys(i).key(), 4);
+      CHECK(n < wanted.size() && k == wanted[n]);
+      CHECK(node->GetValues(i) == Rid(k));
+      ++n;
+    }
+    leaf = node->GetNextLeaf();
+    delete node;
+  }
+  CHECK(n == wanted.size());
+  for (int i = 0; i < wanted.size(); ++i) {
+    CHECK(tree.GetVal(IntKey(wanted[i])) == Rid(wanted[i]));
+  }
+}
+
+int main() {
+  string path = (boost::filesystem::temp_directory_path() /
+                 boost::filesystem::unique_path("HackyDbTest-%%%%%%%%"))
+                    .string() +
+                "/";
+  Tree t;
+  t.db_name = "test";
+  boost::filesystem::create_directories(path + t.db_name);
+
+  LogManager *log = new LogManager(path);
+  t.hdl = new BufferManager(path, log);
+
+  int round = 0;
+  long long restarts = 0;
+  for (; round < ROUNDS && restarts == 0; ++round) {
+    // a small rank, so leaves split every few keys
+    string name = "k" + to_string(round);
+    ofstream((path + t.db_name + "/" + name + ".index").c_str());
+    Index idx(name, "id", T_INT, 4, 4);
+    t.idx = &idx;
+
+    Insert(t, 0);
+    CHECK(idx.level() > 2);
+    Insert(t, KEYS);
+    Remove(t, 0, KEYS);
+
+    vector<int> wanted;
+    for (int k = 0; k < 2 * KEYS; ++k) {
+      if (k >= KEYS || k % 2 == 0) {
+        wanted.push_back(k);
+      }
+    }
+    Verify(t, wanted);
+    restarts = IndexLatches::Get(t.db_name, name)->restarts();
+  }
+  CHECK(restarts > 0);
+  printf("concurrent_btree_test: %d round(s), %lld restarts: OK\n", round,
+         restarts);
+
+  delete t.hdl;
+  delete log;
+  boost::filesystem::remove_all(path);
+  return 0;
+}